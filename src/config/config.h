@@ -1,7 +1,9 @@
 #ifndef __CONFIG_H
 #define __CONFIG_H
 
+#include <algorithm>
 #include <memory>
+#include <string>
 #include "common.h"
 #include <spdlog/common.h>
 #include <spdlog/details/registry.h>
@@ -180,11 +182,68 @@ namespace tasarch::config {
     };
 
     /**
-     * @brief Root configuration object. Currently only holds logging config.
+     * @brief Holds all configuration regarding the gdbstub.
+     *
+     * @code {.toml}
+     * [gdb]
+     * address = "unix:/run/tasarch.sock"
+     * rle = true
+     * packet_size = 65536
+     * transport_buffer_size = 4096
+     * @endcode
+     */
+    struct Gdb {
+        /**
+         * @brief Where the gdbstub listens for connections, see `gdb::listen_address::parse()` for the accepted formats.
+         * @note Only applies when the server is (re)started.
+         */
+        std::string address = "tcp:5555";
+
+        /**
+         * @brief Whether responses sent to gdb should be run length encoded.
+         * Only worth disabling for debugging the protocol, since e.g. memory dumps get a lot smaller with it.
+         */
+        bool rle = true;
+
+        /**
+         * @brief Largest packet we accept and the `PacketSize` we advertise, gdb sizes its memory reads / writes after this.
+         * Bigger is better for bulk dumps. Responses larger than this are streamed, so they work regardless.
+         */
+        size_t packet_size = default_packet_size;
+
+        /**
+         * @brief How much we try to read from the socket at once.
+         */
+        size_t transport_buffer_size = default_transport_buffer_size;
+
+        /**
+         * @brief gdb needs room for at least a register dump in a single packet, so dont go below this.
+         */
+        static constexpr size_t min_packet_size = 0x400;
+        static constexpr size_t default_packet_size = 0x8000;
+        static constexpr size_t default_transport_buffer_size = 0x1000;
+
+        /**
+         * @brief Load the gdb config from the toml value. Missing values are reset to their default.
+         * @note Only applies to new connections.
+         * @param v 
+         */
+        void load_from(const toml::value& v)
+        {
+            this->address = toml::find_or(v, "address", std::string("tcp:5555"));
+            this->rle = toml::find_or(v, "rle", true);
+            this->packet_size = std::max(toml::find_or(v, "packet_size", size_t{default_packet_size}), min_packet_size);
+            this->transport_buffer_size = std::max(toml::find_or(v, "transport_buffer_size", size_t{default_transport_buffer_size}), size_t{1});
+        }
+    };
+
+    /**
+     * @brief Root configuration object. Currently only holds logging and gdbstub config.
      * @todo add much more config.
      */
     struct config {
         Logging logging;
+        Gdb gdb;
         bool testing = false;
 
         static auto instance() -> std::shared_ptr<config>;
@@ -198,6 +257,7 @@ namespace tasarch::config {
         void load_from(const toml::value& v)
         {
             this->logging.load_from(toml::find_or(v, "logging", toml::table()));
+            this->gdb.load_from(toml::find_or(v, "gdb", toml::table()));
         }
 
         /**
@@ -0,0 +1,496 @@
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <fmt/core.h>
+#include "agent_expr.h"
+
+namespace tasarch::gdb::ax {
+    struct expression::machine
+    {
+        const op* code;
+        /**
+         * @brief One past the top of the stack, i.e. the top is `sp[-1]`.
+         */
+        u64* sp;
+        context* ctx;
+        bool big_endian;
+        size_t jumps_left;
+        bool failed = false;
+    };
+
+    namespace {
+        using op = expression::op;
+        using machine = expression::machine;
+
+        auto fail(machine& m) -> const op*
+        {
+            m.failed = true;
+            return nullptr;
+        }
+
+    #pragma mark Operations
+
+        constexpr auto do_add(u64 a, u64 b) -> u64 { return a + b; }
+        constexpr auto do_sub(u64 a, u64 b) -> u64 { return a - b; }
+        constexpr auto do_mul(u64 a, u64 b) -> u64 { return a * b; }
+        constexpr auto do_lsh(u64 a, u64 b) -> u64 { return b >= 64 ? 0 : a << b; }
+        constexpr auto do_rsh_signed(u64 a, u64 b) -> u64 { return static_cast<u64>(static_cast<int64_t>(a) >> std::min<u64>(b, 63)); }
+        constexpr auto do_rsh_unsigned(u64 a, u64 b) -> u64 { return b >= 64 ? 0 : a >> b; }
+        constexpr auto do_bit_and(u64 a, u64 b) -> u64 { return a & b; }
+        constexpr auto do_bit_or(u64 a, u64 b) -> u64 { return a | b; }
+        constexpr auto do_bit_xor(u64 a, u64 b) -> u64 { return a ^ b; }
+        constexpr auto do_equal(u64 a, u64 b) -> u64 { return a == b ? 1 : 0; }
+        constexpr auto do_less_signed(u64 a, u64 b) -> u64 { return static_cast<int64_t>(a) < static_cast<int64_t>(b) ? 1 : 0; }
+        constexpr auto do_less_unsigned(u64 a, u64 b) -> u64 { return a < b ? 1 : 0; }
+
+        using binary_fn = u64 (*)(u64, u64);
+
+        auto binary_for(opcode code) -> binary_fn
+        {
+            switch (code) {
+            case opcode::add: return &do_add;
+            case opcode::sub: return &do_sub;
+            case opcode::mul: return &do_mul;
+            case opcode::lsh: return &do_lsh;
+            case opcode::rsh_signed: return &do_rsh_signed;
+            case opcode::rsh_unsigned: return &do_rsh_unsigned;
+            case opcode::bit_and: return &do_bit_and;
+            case opcode::bit_or: return &do_bit_or;
+            case opcode::bit_xor: return &do_bit_xor;
+            case opcode::equal: return &do_equal;
+            case opcode::less_signed: return &do_less_signed;
+            case opcode::less_unsigned: return &do_less_unsigned;
+            default: return nullptr;
+            }
+        }
+
+    #pragma mark Handlers
+
+        template<binary_fn Fn>
+        auto binary(const op* ip, machine& m) -> const op*
+        {
+            u64 b = *--m.sp;
+            m.sp[-1] = Fn(m.sp[-1], b);
+            return ip + 1;
+        }
+
+        /**
+         * @brief A constant followed by a binary operation, fused.
+         */
+        template<binary_fn Fn>
+        auto binary_imm(const op* ip, machine& m) -> const op*
+        {
+            m.sp[-1] = Fn(m.sp[-1], ip->operand);
+            return ip + 1;
+        }
+
+        template<bool Signed, bool Rem>
+        auto divide(const op* ip, machine& m) -> const op*
+        {
+            u64 b = *--m.sp;
+            u64& a = m.sp[-1];
+            if (b == 0) {
+                return fail(m);
+            }
+            if constexpr (Signed) {
+                auto sb = static_cast<int64_t>(b);
+                if (sb == -1) {
+                    // INT64_MIN / -1 overflows, so negate in unsigned arithmetic instead.
+                    a = Rem ? 0 : u64{0} - a;
+                } else {
+                    auto sa = static_cast<int64_t>(a);
+                    a = static_cast<u64>(Rem ? sa % sb : sa / sb);
+                }
+            } else {
+                a = Rem ? a % b : a / b;
+            }
+            return ip + 1;
+        }
+
+        auto log_not(const op* ip, machine& m) -> const op*
+        {
+            m.sp[-1] = m.sp[-1] == 0 ? 1 : 0;
+            return ip + 1;
+        }
+
+        auto bit_not(const op* ip, machine& m) -> const op*
+        {
+            m.sp[-1] = ~m.sp[-1];
+            return ip + 1;
+        }
+
+        auto sign_extend(const op* ip, machine& m) -> const op*
+        {
+            if (ip->operand < 64) {
+                u64 shift = 64 - ip->operand;
+                m.sp[-1] = static_cast<u64>(static_cast<int64_t>(m.sp[-1] << shift) >> shift);
+            }
+            return ip + 1;
+        }
+
+        auto zero_extend(const op* ip, machine& m) -> const op*
+        {
+            if (ip->operand < 64) {
+                m.sp[-1] &= (u64{1} << ip->operand) - 1;
+            }
+            return ip + 1;
+        }
+
+        template<size_t Size>
+        auto read_value(machine& m, u64 address, u64& value) -> bool
+        {
+            std::array<u8, Size> bytes {};
+            if (m.ctx->read_memory(address, bytes) != Size) {
+                return false;
+            }
+            value = 0;
+            for (size_t i = 0; i < Size; i++) {
+                value |= static_cast<u64>(bytes[m.big_endian ? Size - 1 - i : i]) << (8 * i);
+            }
+            return true;
+        }
+
+        template<size_t Size>
+        auto load(const op* ip, machine& m) -> const op*
+        {
+            if (!read_value<Size>(m, m.sp[-1], m.sp[-1])) {
+                return fail(m);
+            }
+            return ip + 1;
+        }
+
+        /**
+         * @brief A constant address followed by a memory reference, fused.
+         */
+        template<size_t Size>
+        auto load_abs(const op* ip, machine& m) -> const op*
+        {
+            if (!read_value<Size>(m, ip->operand, *m.sp)) {
+                return fail(m);
+            }
+            m.sp++;
+            return ip + 1;
+        }
+
+        auto push_const(const op* ip, machine& m) -> const op*
+        {
+            *m.sp++ = ip->operand;
+            return ip + 1;
+        }
+
+        auto push_reg(const op* ip, machine& m) -> const op*
+        {
+            auto value = m.ctx->register_value(ip->operand);
+            if (!value.has_value()) {
+                return fail(m);
+            }
+            *m.sp++ = value.value();
+            return ip + 1;
+        }
+
+        auto jump(const op* ip, machine& m) -> const op*
+        {
+            if (m.jumps_left-- == 0) {
+                return fail(m);
+            }
+            return m.code + ip->operand;
+        }
+
+        auto if_goto(const op* ip, machine& m) -> const op*
+        {
+            if (*--m.sp == 0) {
+                return ip + 1;
+            }
+            return jump(ip, m);
+        }
+
+        auto end(const op* /*ip*/, machine& /*m*/) -> const op*
+        {
+            return nullptr;
+        }
+
+        auto dup(const op* ip, machine& m) -> const op*
+        {
+            *m.sp = m.sp[-1];
+            m.sp++;
+            return ip + 1;
+        }
+
+        auto pop(const op* ip, machine& m) -> const op*
+        {
+            m.sp--;
+            return ip + 1;
+        }
+
+        auto swap(const op* ip, machine& m) -> const op*
+        {
+            std::swap(m.sp[-1], m.sp[-2]);
+            return ip + 1;
+        }
+
+        auto pick(const op* ip, machine& m) -> const op*
+        {
+            *m.sp = m.sp[-1 - static_cast<ptrdiff_t>(ip->operand)];
+            m.sp++;
+            return ip + 1;
+        }
+
+        auto rot(const op* ip, machine& m) -> const op*
+        {
+            // a b c => c a b
+            u64 c = m.sp[-1];
+            m.sp[-1] = m.sp[-2];
+            m.sp[-2] = m.sp[-3];
+            m.sp[-3] = c;
+            return ip + 1;
+        }
+
+        template<binary_fn Fn>
+        constexpr auto binary_handlers() -> std::array<expression::handler, 2>
+        {
+            return {&binary<Fn>, &binary_imm<Fn>};
+        }
+
+        /**
+         * @brief Plain and fused (`_imm`) handler of every binary operation.
+         */
+        auto binary_handler(opcode code, bool imm) -> expression::handler
+        {
+            std::array<expression::handler, 2> handlers {};
+            switch (code) {
+            case opcode::add: handlers = binary_handlers<&do_add>(); break;
+            case opcode::sub: handlers = binary_handlers<&do_sub>(); break;
+            case opcode::mul: handlers = binary_handlers<&do_mul>(); break;
+            case opcode::lsh: handlers = binary_handlers<&do_lsh>(); break;
+            case opcode::rsh_signed: handlers = binary_handlers<&do_rsh_signed>(); break;
+            case opcode::rsh_unsigned: handlers = binary_handlers<&do_rsh_unsigned>(); break;
+            case opcode::bit_and: handlers = binary_handlers<&do_bit_and>(); break;
+            case opcode::bit_or: handlers = binary_handlers<&do_bit_or>(); break;
+            case opcode::bit_xor: handlers = binary_handlers<&do_bit_xor>(); break;
+            case opcode::equal: handlers = binary_handlers<&do_equal>(); break;
+            case opcode::less_signed: handlers = binary_handlers<&do_less_signed>(); break;
+            case opcode::less_unsigned: handlers = binary_handlers<&do_less_unsigned>(); break;
+            default: return nullptr;
+            }
+            return handlers[imm ? 1 : 0];
+        }
+
+        auto load_handler(opcode code, bool imm) -> expression::handler
+        {
+            switch (code) {
+            case opcode::ref8: return imm ? &load_abs<1> : &load<1>;
+            case opcode::ref16: return imm ? &load_abs<2> : &load<2>;
+            case opcode::ref32: return imm ? &load_abs<4> : &load<4>;
+            case opcode::ref64: return imm ? &load_abs<8> : &load<8>;
+            default: return nullptr;
+            }
+        }
+
+    #pragma mark Decoding
+
+        struct op_info
+        {
+            bool valid = false;
+            u8 operand_size = 0;
+            u8 pops = 0;
+            u8 pushes = 0;
+        };
+
+        constexpr auto infos = []{
+            std::array<op_info, 256> ret {};
+            auto set = [&ret](opcode code, u8 operand_size, u8 pops, u8 pushes) {
+                ret[static_cast<u8>(code)] = op_info { .valid = true, .operand_size = operand_size, .pops = pops, .pushes = pushes };
+            };
+            for (auto code : {opcode::add, opcode::sub, opcode::mul, opcode::div_signed, opcode::div_unsigned, opcode::rem_signed, opcode::rem_unsigned,
+                              opcode::lsh, opcode::rsh_signed, opcode::rsh_unsigned, opcode::bit_and, opcode::bit_or, opcode::bit_xor,
+                              opcode::equal, opcode::less_signed, opcode::less_unsigned}) {
+                set(code, 0, 2, 1);
+            }
+            for (auto code : {opcode::log_not, opcode::bit_not, opcode::ref8, opcode::ref16, opcode::ref32, opcode::ref64}) {
+                set(code, 0, 1, 1);
+            }
+            set(opcode::ext, 1, 1, 1);
+            set(opcode::zero_ext, 1, 1, 1);
+            set(opcode::if_goto, 2, 1, 0);
+            set(opcode::goto_, 2, 0, 0);
+            set(opcode::const8, 1, 0, 1);
+            set(opcode::const16, 2, 0, 1);
+            set(opcode::const32, 4, 0, 1);
+            set(opcode::const64, 8, 0, 1);
+            set(opcode::reg, 2, 0, 1);
+            set(opcode::end, 0, 1, 1);
+            set(opcode::dup, 0, 1, 2);
+            set(opcode::pop, 0, 1, 0);
+            set(opcode::swap, 0, 2, 2);
+            // needs `n + 1` entries, checked separately.
+            set(opcode::pick, 1, 0, 1);
+            set(opcode::rot, 0, 3, 3);
+            return ret;
+        }();
+
+        struct decoded
+        {
+            opcode code;
+            u64 operand;
+        };
+
+        auto is_const(opcode code) -> bool
+        {
+            return code == opcode::const8 || code == opcode::const16 || code == opcode::const32 || code == opcode::const64;
+        }
+
+        auto is_jump(opcode code) -> bool
+        {
+            return code == opcode::if_goto || code == opcode::goto_;
+        }
+
+        constexpr size_t no_index = std::numeric_limits<size_t>::max();
+    } // namespace
+
+    auto expression::compile(std::span<const u8> bytecode) -> expression
+    {
+        // Decode, remembering which instruction starts at which offset.
+        std::vector<decoded> insns;
+        std::vector<size_t> index_of(bytecode.size(), no_index);
+        for (size_t offset = 0; offset < bytecode.size();) {
+            const auto& info = infos[bytecode[offset]];
+            if (!info.valid) {
+                throw std::invalid_argument(fmt::format("unsupported opcode 0x{:02x} at {}", bytecode[offset], offset));
+            }
+            if (offset + 1 + info.operand_size > bytecode.size()) {
+                throw std::invalid_argument(fmt::format("truncated operand at {}", offset));
+            }
+            u64 operand = 0;
+            for (size_t i = 0; i < info.operand_size; i++) {
+                operand = (operand << 8) | bytecode[offset + 1 + i];
+            }
+            index_of[offset] = insns.size();
+            insns.push_back(decoded { .code = static_cast<opcode>(bytecode[offset]), .operand = operand });
+            offset += 1 + info.operand_size;
+        }
+        if (insns.empty()) {
+            throw std::invalid_argument("empty expression");
+        }
+
+        // Jumps target byte offsets, from here on they refer to instructions.
+        std::vector<bool> is_target(insns.size(), false);
+        for (auto& insn : insns) {
+            if (is_jump(insn.code)) {
+                if (insn.operand >= bytecode.size() || index_of[insn.operand] == no_index) {
+                    throw std::invalid_argument(fmt::format("jump to {}, which is not the start of an instruction", insn.operand));
+                }
+                insn.operand = index_of[insn.operand];
+                is_target[insn.operand] = true;
+            }
+            if ((insn.code == opcode::ext || insn.code == opcode::zero_ext) && (insn.operand == 0 || insn.operand > 64)) {
+                throw std::invalid_argument(fmt::format("cannot extend from {} bits", insn.operand));
+            }
+        }
+
+        // Every instruction has to be reached with the same stack depth on all paths, so the handlers never have to check it.
+        std::vector<size_t> depth(insns.size(), no_index);
+        std::vector<size_t> pending = {0};
+        depth[0] = 0;
+        auto reach = [&](size_t idx, size_t at) {
+            if (idx >= insns.size()) {
+                throw std::invalid_argument("execution falls off the end");
+            }
+            if (depth[idx] == no_index) {
+                depth[idx] = at;
+                pending.push_back(idx);
+            } else if (depth[idx] != at) {
+                throw std::invalid_argument(fmt::format("instruction {} is reached with stack depths {} and {}", idx, depth[idx], at));
+            }
+        };
+        while (!pending.empty()) {
+            size_t idx = pending.back();
+            pending.pop_back();
+            const auto& insn = insns[idx];
+            const auto& info = infos[static_cast<u8>(insn.code)];
+            size_t needed = insn.code == opcode::pick ? insn.operand + 1 : info.pops;
+            if (depth[idx] < needed) {
+                throw std::invalid_argument(fmt::format("stack underflow at instruction {}", idx));
+            }
+            size_t after = depth[idx] - info.pops + info.pushes;
+            if (after > max_stack) {
+                throw std::invalid_argument(fmt::format("expression needs more than {} stack entries", max_stack));
+            }
+            if (insn.code == opcode::end) {
+                continue;
+            }
+            if (is_jump(insn.code)) {
+                reach(insn.operand, after);
+            }
+            if (insn.code != opcode::goto_) {
+                reach(idx + 1, after);
+            }
+        }
+
+        // Translate into threaded code, fusing constants into the following instruction where no jump goes in between.
+        expression ret;
+        std::vector<size_t> compiled_index(insns.size(), no_index);
+        for (size_t idx = 0; idx < insns.size(); idx++) {
+            const auto& insn = insns[idx];
+            compiled_index[idx] = ret.code.size();
+            if (is_const(insn.code) && idx + 1 < insns.size() && !is_target[idx + 1]) {
+                opcode next = insns[idx + 1].code;
+                handler fused = binary_for(next) != nullptr ? binary_handler(next, true) : load_handler(next, true);
+                if (fused != nullptr) {
+                    ret.code.push_back(op { .fn = fused, .operand = insn.operand });
+                    idx++;
+                    continue;
+                }
+            }
+            handler fn = nullptr;
+            switch (insn.code) {
+            case opcode::div_signed: fn = &divide<true, false>; break;
+            case opcode::div_unsigned: fn = &divide<false, false>; break;
+            case opcode::rem_signed: fn = &divide<true, true>; break;
+            case opcode::rem_unsigned: fn = &divide<false, true>; break;
+            case opcode::log_not: fn = &log_not; break;
+            case opcode::bit_not: fn = &bit_not; break;
+            case opcode::ext: fn = &sign_extend; break;
+            case opcode::zero_ext: fn = &zero_extend; break;
+            case opcode::if_goto: fn = &if_goto; break;
+            case opcode::goto_: fn = &jump; break;
+            case opcode::const8:
+            case opcode::const16:
+            case opcode::const32:
+            case opcode::const64: fn = &push_const; break;
+            case opcode::reg: fn = &push_reg; break;
+            case opcode::end: fn = &end; break;
+            case opcode::dup: fn = &dup; break;
+            case opcode::pop: fn = &pop; break;
+            case opcode::swap: fn = &swap; break;
+            case opcode::pick: fn = &pick; break;
+            case opcode::rot: fn = &rot; break;
+            default:
+                fn = binary_for(insn.code) != nullptr ? binary_handler(insn.code, false) : load_handler(insn.code, false);
+                break;
+            }
+            ret.code.push_back(op { .fn = fn, .operand = insn.operand });
+        }
+        for (size_t idx = 0; idx < insns.size(); idx++) {
+            if (is_jump(insns[idx].code)) {
+                ret.code[compiled_index[idx]].operand = compiled_index[insns[idx].operand];
+            }
+        }
+        return ret;
+    }
+
+    auto expression::evaluate(context& ctx) const -> std::optional<u64>
+    {
+        std::array<u64, max_stack> stack; // NOLINT: only ever read after being written.
+        machine m { .code = this->code.data(), .sp = stack.data(), .ctx = &ctx, .big_endian = ctx.big_endian(), .jumps_left = max_jumps };
+        for (const op* ip = m.code; ip != nullptr;) {
+            ip = ip->fn(ip, m);
+        }
+        if (m.failed) {
+            return std::nullopt;
+        }
+        return m.sp[-1];
+    }
+} // namespace tasarch::gdb::ax
@@ -0,0 +1,149 @@
+/**
+ * @file agent_expr.h
+ * @brief gdb's agent expressions, the bytecode used for breakpoint conditions evaluated by the target (`Z0,addr,kind;X len,expr`).
+ *
+ * Without these, every hit of a conditional breakpoint means stopping, gdb reading memory and resuming again, possibly thousands of times per second.
+ * Instead, the condition is evaluated right on the emulation thread, and only true conditions stop the target.
+ *
+ * The bytecode is verified and compiled once, when the breakpoint is inserted: every instruction becomes a pointer to its handler plus its decoded operand (threaded code).
+ * Since stack depths are checked statically, handlers never have to check for under- or overflow and common pairs
+ * (e.g. a constant followed by a comparison or a memory reference) are fused into a single instruction.
+ * See https://sourceware.org/gdb/onlinedocs/gdb/Bytecode-Descriptions.html for the semantics of all instructions.
+ * Floating point, tracing and trace state variables are not supported, gdb does not use them for conditions.
+ */
+#ifndef __GDB_AGENT_EXPR_H
+#define __GDB_AGENT_EXPR_H
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+#include "util/defines.h"
+
+namespace tasarch::gdb::ax {
+    enum class opcode : u8
+    {
+        add = 0x02,
+        sub = 0x03,
+        mul = 0x04,
+        div_signed = 0x05,
+        div_unsigned = 0x06,
+        rem_signed = 0x07,
+        rem_unsigned = 0x08,
+        lsh = 0x09,
+        rsh_signed = 0x0a,
+        rsh_unsigned = 0x0b,
+        log_not = 0x0e,
+        bit_and = 0x0f,
+        bit_or = 0x10,
+        bit_xor = 0x11,
+        bit_not = 0x12,
+        equal = 0x13,
+        less_signed = 0x14,
+        less_unsigned = 0x15,
+        ext = 0x16,
+        ref8 = 0x17,
+        ref16 = 0x18,
+        ref32 = 0x19,
+        ref64 = 0x1a,
+        if_goto = 0x20,
+        goto_ = 0x21,
+        const8 = 0x22,
+        const16 = 0x23,
+        const32 = 0x24,
+        const64 = 0x25,
+        reg = 0x26,
+        end = 0x27,
+        dup = 0x28,
+        pop = 0x29,
+        zero_ext = 0x2a,
+        swap = 0x2b,
+        pick = 0x32,
+        rot = 0x33,
+    };
+
+    /**
+     * @brief What an expression can look at, usually the target itself.
+     */
+    class context
+    {
+    public:
+        context() = default;
+        context(const context&) = default;
+        auto operator=(const context&) -> context& = default;
+        context(context&&) = default;
+        auto operator=(context&&) -> context& = default;
+        virtual ~context() = default;
+
+        /**
+         * @brief Same as `Debugger::read_memory()`.
+         */
+        virtual auto read_memory(size_t address, std::span<u8> dst) -> size_t = 0;
+
+        /**
+         * @brief Value of register `idx` (numbered like for `p`), `std::nullopt` if there is no such register.
+         */
+        virtual auto register_value(size_t idx) -> std::optional<u64> = 0;
+
+        /**
+         * @brief Byte order of memory references.
+         */
+        [[nodiscard]] virtual auto big_endian() const -> bool
+        {
+            return false;
+        }
+    };
+
+    class expression
+    {
+    public:
+        /**
+         * @brief The deepest the stack can get, longer expressions are rejected by `compile()`.
+         */
+        static constexpr size_t max_stack = 64;
+
+        /**
+         * @brief How many jumps are taken before evaluation is aborted, so a condition can never hang the emulator.
+         */
+        static constexpr size_t max_jumps = 10000;
+
+        /**
+         * @brief Verify and compile `bytecode`.
+         * @throws std::invalid_argument if it is not valid, uses unsupported instructions or needs more than `max_stack` entries.
+         */
+        static auto compile(std::span<const u8> bytecode) -> expression;
+
+        /**
+         * @brief Run the expression.
+         * @return The top of the stack once `end` is reached, or `std::nullopt` on errors (e.g. unreadable memory, division by zero).
+         */
+        auto evaluate(context& ctx) const -> std::optional<u64>;
+
+        /**
+         * @brief Number of compiled instructions, i.e. after fusing.
+         */
+        [[nodiscard]] auto size() const -> size_t
+        {
+            return this->code.size();
+        }
+
+        struct machine;
+        struct op;
+        using handler = auto (*)(const op* ip, machine& m) -> const op*;
+        struct op
+        {
+            handler fn;
+            /**
+             * @brief Decoded operand, e.g. the constant, the register number or the index of the jump target.
+             */
+            u64 operand;
+        };
+
+    private:
+        expression() = default;
+
+        std::vector<op> code;
+    };
+} // namespace tasarch::gdb::ax
+
+#endif /* __GDB_AGENT_EXPR_H */
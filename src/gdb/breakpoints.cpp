@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <fmt/core.h>
+#include "breakpoints.h"
+
+namespace tasarch::gdb {
+    namespace {
+        auto is_execution(breakpoint_type type) -> bool
+        {
+            return type == breakpoint_type::software || type == breakpoint_type::hardware;
+        }
+    } // namespace
+
+    auto breakpoint_manager::add(breakpoint_type type, size_t address, size_t kind, std::vector<ax::expression> conditions) -> bool
+    {
+        if (!is_execution(type)) {
+            throw std::invalid_argument(fmt::format("watchpoints (type {}) are not supported", static_cast<int>(type)));
+        }
+        std::lock_guard guard(this->lock);
+        auto next = std::make_unique<table_type>(*this->current);
+        auto pos = lower_bound(*next, address, type);
+        if (pos != next->cend() && pos->bp.address == address && pos->bp.type == type) {
+            auto& existing = (*next)[static_cast<size_t>(pos - next->cbegin())].bp;
+            existing.kind = kind;
+            existing.conditions = std::move(conditions);
+            this->publish(std::move(next));
+            return false;
+        }
+        next->insert(pos, entry{
+            .bp = breakpoint{ .address = address, .type = type, .kind = kind, .conditions = std::move(conditions) },
+            .hits = std::make_shared<std::atomic<u64>>(0),
+        });
+        // Published first, so `hit()` finds it once the bit is set.
+        this->publish(std::move(next));
+
+        size_t offset = address & (page_size - 1);
+        this->page_for(address).bits[offset / 64].fetch_or(u64{1} << (offset % 64), std::memory_order_release);
+        return true;
+    }
+
+    auto breakpoint_manager::remove(breakpoint_type type, size_t address) -> bool
+    {
+        std::lock_guard guard(this->lock);
+        auto pos = lower_bound(*this->current, address, type);
+        if (pos == this->current->cend() || pos->bp.address != address || pos->bp.type != type) {
+            return false;
+        }
+        auto next = std::make_unique<table_type>(*this->current);
+        auto after = next->erase(next->cbegin() + (pos - this->current->cbegin()));
+
+        // A breakpoint of another type can still be there.
+        auto same_address = [address](const entry& e) { return e.bp.address == address && is_execution(e.bp.type); };
+        bool still_set = (after != next->end() && same_address(*after)) || (after != next->begin() && same_address(*std::prev(after)));
+        if (!still_set) {
+            size_t offset = address & (page_size - 1);
+            this->page_for(address).bits[offset / 64].fetch_and(~(u64{1} << (offset % 64)), std::memory_order_release);
+        }
+        this->publish(std::move(next));
+        return true;
+    }
+
+    void breakpoint_manager::clear()
+    {
+        std::lock_guard guard(this->lock);
+        // The pages stay around, the emulation thread might be looking at them right now.
+        for (auto& pg : this->pages) {
+            for (auto& word : pg->bits) {
+                word.store(0, std::memory_order_release);
+            }
+        }
+        this->publish(std::make_unique<const table_type>());
+    }
+
+    auto breakpoint_manager::hit(size_t address, ax::context& ctx) -> bool
+    {
+        // Counted before looking at the table, so `publish()` does not free it under us.
+        struct reader_guard
+        {
+            std::atomic<size_t>& readers;
+            explicit reader_guard(std::atomic<size_t>& count) : readers(count) { readers.fetch_add(1, std::memory_order_seq_cst); }
+            reader_guard(const reader_guard&) = delete;
+            auto operator=(const reader_guard&) -> reader_guard& = delete;
+            reader_guard(reader_guard&&) = delete;
+            auto operator=(reader_guard&&) -> reader_guard& = delete;
+            ~reader_guard() { readers.fetch_sub(1, std::memory_order_release); }
+        } guard(this->readers);
+        const table_type& snapshot = *this->table.load(std::memory_order_seq_cst);
+
+        bool stop = false;
+        for (auto it = lower_bound(snapshot, address, breakpoint_type::software); it != snapshot.cend() && it->bp.address == address; it++) {
+            if (!is_execution(it->bp.type)) {
+                continue;
+            }
+            bool triggered = it->bp.conditions.empty();
+            for (const auto& cond : it->bp.conditions) {
+                // Like gdbserver, a condition that cannot be evaluated stops, so the user gets to see why.
+                auto value = cond.evaluate(ctx);
+                if (!value.has_value() || value.value() != 0) {
+                    triggered = true;
+                    break;
+                }
+            }
+            if (triggered) {
+                it->hits->fetch_add(1, std::memory_order_relaxed);
+                stop = true;
+            }
+        }
+        return stop;
+    }
+
+    auto breakpoint_manager::find(breakpoint_type type, size_t address) const -> std::optional<breakpoint>
+    {
+        std::lock_guard guard(this->lock);
+        auto pos = lower_bound(*this->current, address, type);
+        if (pos == this->current->cend() || pos->bp.address != address || pos->bp.type != type) {
+            return std::nullopt;
+        }
+        breakpoint ret = pos->bp;
+        ret.hits = pos->hits->load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    auto breakpoint_manager::size() const -> size_t
+    {
+        std::lock_guard guard(this->lock);
+        return this->current->size();
+    }
+
+    void breakpoint_manager::publish(std::unique_ptr<const table_type> next)
+    {
+        // Both seq_cst, together with the ones in `hit()`: if we see no reader below, any reader coming later sees `next` already.
+        this->table.store(next.get(), std::memory_order_seq_cst);
+        this->retired.push_back(std::move(this->current));
+        this->current = std::move(next);
+        if (this->readers.load(std::memory_order_seq_cst) == 0) {
+            this->retired.clear();
+        }
+    }
+
+    auto breakpoint_manager::page_for(size_t address) -> page&
+    {
+        size_t number = address >> page_bits;
+        auto& bucket = this->buckets[number & (num_buckets - 1)];
+        for (page* pg = bucket.load(std::memory_order_relaxed); pg != nullptr; pg = pg->next.load(std::memory_order_relaxed)) {
+            if (pg->number == number) {
+                return *pg;
+            }
+        }
+        // Fully set up before it is published, readers either see all of it or nothing.
+        auto& pg = this->pages.emplace_back(std::make_unique<page>(number));
+        pg->next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        bucket.store(pg.get(), std::memory_order_release);
+        return *pg;
+    }
+
+    auto breakpoint_manager::lower_bound(const table_type& table, size_t address, breakpoint_type type) -> table_type::const_iterator
+    {
+        return std::lower_bound(table.begin(), table.end(), std::make_tuple(address, type), [](const entry& e, const auto& key) {
+            return std::make_tuple(e.bp.address, e.bp.type) < key;
+        });
+    }
+} // namespace tasarch::gdb
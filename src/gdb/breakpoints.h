@@ -0,0 +1,187 @@
+/**
+ * @file breakpoints.h
+ * @brief Breakpoints set by gdb (`Z0` / `Z1`), checked by the emulator for every executed instruction.
+ *
+ * Checking every pc against a list (or even a tree) of breakpoints would slow down emulation noticeably, so the check is a lookup in per page bitmaps instead:
+ * the page number selects a bucket, the page in it (almost always the first one) has one bit per address.
+ * That is three loads for an address with a breakpoint somewhere on its page and two for anything else.
+ * All details (type, hit counts, conditions, ...) live in a sorted side table, which is only looked at once a bit is set.
+ *
+ * The bitmaps are only ever modified with atomics and pages are never freed while the manager is alive.
+ * The side table is never modified in place either: every change publishes a new copy and older ones are only freed once no `hit()` is looking at them.
+ * So gdb can add and remove breakpoints at any time, without ever blocking the emulation thread in `contains()` or `hit()`.
+ */
+#ifndef __GDB_BREAKPOINTS_H
+#define __GDB_BREAKPOINTS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include "agent_expr.h"
+#include "util/defines.h"
+
+namespace tasarch::gdb {
+    /**
+     * @brief Type of a breakpoint, numbered as in the `Z` / `z` packets.
+     */
+    enum class breakpoint_type : u8
+    {
+        software = 0,
+        hardware = 1,
+        write_watch = 2,
+        read_watch = 3,
+        access_watch = 4,
+    };
+
+    struct breakpoint
+    {
+        size_t address;
+        breakpoint_type type;
+        /**
+         * @brief Target specific, e.g. the size of the instruction to replace. We never patch memory, so it is only kept for gdb.
+         */
+        size_t kind = 0;
+        /**
+         * @brief How often it stopped execution, i.e. was reached with one of its conditions true (or without any).
+         */
+        u64 hits = 0;
+        /**
+         * @brief Execution only stops if one of these evaluates to non-zero (or fails to evaluate). Always stops if there are none.
+         */
+        std::vector<ax::expression> conditions;
+    };
+
+    class breakpoint_manager
+    {
+    public:
+        static constexpr size_t page_bits = 12;
+        static constexpr size_t page_size = size_t{1} << page_bits;
+        /**
+         * @brief Pages are hashed into this many buckets by their page number, i.e. 16MB of contiguous code never share one.
+         */
+        static constexpr size_t num_buckets = 4096;
+
+        breakpoint_manager() = default;
+        breakpoint_manager(const breakpoint_manager&) = delete;
+        auto operator=(const breakpoint_manager&) -> breakpoint_manager& = delete;
+        breakpoint_manager(breakpoint_manager&&) = delete;
+        auto operator=(breakpoint_manager&&) -> breakpoint_manager& = delete;
+        ~breakpoint_manager() = default;
+
+        /**
+         * @brief Whether execution has to stop at `address`, i.e. whether there is an (execution) breakpoint there.
+         * This is the hot path, called by the emulator for every instruction. It never blocks.
+         */
+        [[nodiscard]] auto contains(size_t address) const noexcept -> bool
+        {
+            size_t number = address >> page_bits;
+            const page* pg = this->buckets[number & (num_buckets - 1)].load(std::memory_order_acquire);
+            while (pg != nullptr && pg->number != number) [[unlikely]] {
+                pg = pg->next.load(std::memory_order_acquire);
+            }
+            if (pg == nullptr) {
+                return false;
+            }
+            size_t offset = address & (page_size - 1);
+            return ((pg->bits[offset / 64].load(std::memory_order_relaxed) >> (offset % 64)) & 1) != 0;
+        }
+
+        /**
+         * @brief Add a breakpoint. If it already exists, only `kind` and the conditions are replaced (gdb inserts it again whenever they change).
+         * @throws std::invalid_argument for watchpoints, only execution breakpoints are supported.
+         * @return Whether the breakpoint is new.
+         */
+        auto add(breakpoint_type type, size_t address, size_t kind, std::vector<ax::expression> conditions = {}) -> bool;
+
+        /**
+         * @brief Remove a breakpoint.
+         * @return Whether there was such a breakpoint.
+         */
+        auto remove(breakpoint_type type, size_t address) -> bool;
+
+        /**
+         * @brief Remove all breakpoints, no matter which connection set them.
+         */
+        void clear();
+
+        /**
+         * @brief Execution reached `address` and `contains()` said so: evaluates the conditions of all breakpoints there (on the calling, i.e. emulation thread) and counts their hits.
+         * Works on the latest published table, so it never waits for a modification in progress.
+         * @return Whether execution has to stop, false if all conditions were false or the breakpoints were removed in the meantime.
+         */
+        auto hit(size_t address, ax::context& ctx) -> bool;
+
+        [[nodiscard]] auto find(breakpoint_type type, size_t address) const -> std::optional<breakpoint>;
+
+        [[nodiscard]] auto size() const -> size_t;
+
+    private:
+        struct page
+        {
+            explicit page(size_t number) : number(number) {}
+
+            const size_t number;
+            std::array<std::atomic<u64>, page_size / 64> bits {};
+            /**
+             * @brief Next page in the same bucket.
+             */
+            std::atomic<page*> next = nullptr;
+        };
+
+        struct entry
+        {
+            breakpoint bp;
+            /**
+             * @brief Shared by all copies of the table, so hits counted on an older one are not lost. `bp.hits` is unused.
+             */
+            std::shared_ptr<std::atomic<u64>> hits;
+        };
+        using table_type = std::vector<entry>;
+
+        /**
+         * @brief The page for `address`, created if needed. Only called with `lock` held.
+         */
+        auto page_for(size_t address) -> page&;
+        /**
+         * @brief First entry of `table` at or after (`address`, `type`).
+         */
+        static auto lower_bound(const table_type& table, size_t address, breakpoint_type type) -> table_type::const_iterator;
+        /**
+         * @brief Make `next` the table seen by `hit()`. Only called with `lock` held.
+         */
+        void publish(std::unique_ptr<const table_type> next);
+
+        std::array<std::atomic<page*>, num_buckets> buckets {};
+
+        /**
+         * @brief Serializes all modifications, never taken by `contains()` or `hit()`.
+         */
+        mutable std::mutex lock;
+        /**
+         * @brief Owns all pages, they are only freed together with the manager.
+         */
+        std::vector<std::unique_ptr<page>> pages;
+        /**
+         * @brief All breakpoints, sorted by address and type. Never modified once published, see `publish()`.
+         */
+        std::unique_ptr<const table_type> current = std::make_unique<const table_type>();
+        /**
+         * @brief `current`, for `hit()`.
+         */
+        std::atomic<const table_type*> table = current.get();
+        /**
+         * @brief How many `hit()` calls are looking at a table right now.
+         */
+        std::atomic<size_t> readers = 0;
+        /**
+         * @brief Replaced tables, freed by the next `publish()` that finds no `hit()` running.
+         */
+        std::vector<std::unique_ptr<const table_type>> retired;
+    };
+} // namespace tasarch::gdb
+
+#endif /* __GDB_BREAKPOINTS_H */
@@ -8,9 +8,12 @@
 #include <asio.hpp>
 #include <asio/buffer.hpp>
 #include "util/defines.h"
+#include "buffer_pool.h"
 #include <fmt/core.h>
 #include <concepts>
+#include <span>
 #include <string>
+#include <string_view>
 #include "util/warnings.h"
 #include "util/concepts.h"
 
@@ -44,6 +47,20 @@ namespace tasarch::gdb {
         {TBuffer((decltype(buf.data()))ptr, num)} -> std::same_as<TBuffer>;
     };
 
+    /**
+     * @concept BufferView
+     * @brief Like `Bufferable`, but for types that only look at data owned by someone else, e.g. `std::string_view` or `std::span<const u8>`.
+     * Every `Bufferable` is also a `BufferView`.
+     *
+     * @tparam TView
+     */
+    template<typename TView>
+    concept BufferView = requires(TView view, const u8* ptr, size_t num) {
+        {view.data()} -> convertible_to<const void*>;
+        {view.size()} -> convertible_to<size_t>;
+        {TView((decltype(view.data()))ptr, num)} -> std::same_as<TView>;
+    };
+
     /**
      * @brief Buffer with static storage, that allows both reading and writing to it, while keeping track of current read and write head.
      *
@@ -60,10 +77,7 @@ public:
          * 
          * @param size 
          */
-        explicit buffer(const size_t size) : max_size(size)
-        {
-            this->storage.resize(size);
-        }
+        explicit buffer(const size_t size) : max_size(size), storage(buffer_pool::shared().acquire(size)) {}
 
         /**
          * @name Simple Accessors 
@@ -112,6 +126,19 @@ public:
             return TBuffer((decltype(TBuffer().data()))(this->read_data()), this->read_size());
         }
 
+        /**
+         * @brief Like `read_buf()`, but returns a view of all unread data, so nothing is ever copied.
+         * @warning The view is only valid until the buffer is written to (or reset) again.
+         *
+         * @tparam TView
+         * @return TView
+         */
+        template<BufferView TView = std::string_view>
+        auto read_view() -> TView
+        {
+            return TView((decltype(TView().data()))(this->read_data()), this->read_size());
+        }
+
         /**
          * @brief The current free space we can write to.
          * 
@@ -166,7 +193,7 @@ public:
             if (this->read_size() < 1) {
                 throw std::out_of_range("No more bytes left!");
             }
-            u8 val = this->storage.at(this->read_off);
+            u8 val = this->storage.data()[this->read_off];
             this->read_off++;
             return val;
         }
@@ -212,6 +239,37 @@ public:
             return ret;
         }
 
+        /**
+         * @brief Like `get_buf()`, but returns a view, so nothing is copied.
+         * @warning The same limitation as for `read_view()` apply.
+         * @throws std::out_of_range if not enough bytes are available.
+         * @tparam TView
+         * @param num
+         * @return TView
+         */
+        template<BufferView TView = std::string_view>
+        auto get_view(size_t num) -> TView
+        {
+            this->read_require(num);
+            TView ret((decltype(TView().data()))this->read_data(), num);
+            this->read_off += num;
+            return ret;
+        }
+
+        /**
+         * @brief Like `get_str()`, but returns a `std::string_view` into the buffer instead of a copy.
+         * If `num = 0`, then all of the current read buffer will be returned.
+         * @warning The same limitation as for `read_view()` apply.
+         * @throws std::out_of_range if not enough bytes are available.
+         * @param num
+         * @return std::string_view
+         */
+        auto get_sv(size_t num = 0) -> std::string_view
+        {
+            if (num == 0) { num = this->read_size(); }
+            return this->get_view<std::string_view>(num);
+        }
+
         /**
          * @brief Convenience function for consuming and returning `num` bytes of the current read buffer as an `std::string`.
          * If `num = 0`, then all of the current read buffer will be returned.
@@ -276,7 +334,7 @@ public:
             if (this->write_size() < 1) {
                 throw buffer_too_small(max_size);
             }
-            this->storage.at(this->write_off) = val;
+            this->storage.data()[this->write_off] = val;
             this->write_off++;
         }
 
@@ -288,8 +346,8 @@ public:
          * @tparam TBuffer 
          * @param buf 
          */
-        template<typename TBuffer>
-        void append_buf(TBuffer& buf) requires Bufferable<TBuffer>
+        template<BufferView TBuffer>
+        void append_buf(const TBuffer& buf)
         {
             this->write_require(buf.size());
             std::memcpy(this->write_data(), buf.data(), buf.size());
@@ -374,9 +432,11 @@ public:
          * @note Originally, this was an `std::array` and hence the buffer's size was determined at compile time.
          * This was however rather annoying, as any functions taking a buffer as an argument had to have a template parameter for the size.
          * Therefore, it was deemed easier to just use a vector that is only resized once.
-         * 
+         * Nowadays, it comes from `buffer_pool`, so that connections do not allocate (and fault in) their buffers anew every time.
+         * This also means buffers can be moved, but not copied.
+         *
          */
-        std::vector<u8> storage;
+        buffer_pool::block storage;
     };
 
 } // namespace tasarch::gdb
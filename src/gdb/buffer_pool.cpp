@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <new>
+#include "buffer_pool.h"
+
+namespace tasarch::gdb {
+    namespace {
+        auto allocate_block(size_t size) -> u8*
+        {
+            auto* ptr = static_cast<u8*>(::operator new(size, std::align_val_t(buffer_alignment)));
+            // Fault in every page now, instead of on the first packet. Also matches what the std::vector storage used to do.
+            std::memset(ptr, 0, size);
+            return ptr;
+        }
+
+        void free_block(u8* ptr)
+        {
+            ::operator delete(ptr, std::align_val_t(buffer_alignment));
+        }
+    } // namespace
+
+    void buffer_pool::block::reset()
+    {
+        if (this->ptr != nullptr) {
+            this->pool->release(this->ptr, this->cap, this->size_class);
+        }
+        this->pool = nullptr;
+        this->ptr = nullptr;
+        this->cap = 0;
+    }
+
+    auto buffer_pool::pool_stats::total_bytes() const -> size_t
+    {
+        size_t total = this->oversized_bytes;
+        for (const auto& cls : this->classes) {
+            total += (cls.in_use + cls.idle) * cls.block_size;
+        }
+        return total;
+    }
+
+    buffer_pool::~buffer_pool()
+    {
+        this->trim();
+    }
+
+    auto buffer_pool::shared() -> buffer_pool&
+    {
+        static buffer_pool pool;
+        return pool;
+    }
+
+    auto buffer_pool::class_for(size_t size) -> size_t
+    {
+        if (size > max_block_size) {
+            return oversized;
+        }
+        size_t block_size = std::bit_ceil(std::max(size, min_block_size));
+        return static_cast<size_t>(std::countr_zero(block_size) - std::countr_zero(min_block_size));
+    }
+
+    auto buffer_pool::acquire(size_t size) -> block
+    {
+        size_t idx = class_for(size);
+        if (idx == oversized) {
+            size_t cap = (size + buffer_alignment - 1) & ~(buffer_alignment - 1);
+            {
+                std::lock_guard lock(this->oversized_lock);
+                this->oversized_in_use++;
+                this->oversized_bytes += cap;
+            }
+            return block(this, allocate_block(cap), cap, oversized);
+        }
+
+        size_t cap = min_block_size << idx;
+        auto& cls = this->classes.at(idx);
+        {
+            std::lock_guard lock(cls.lock);
+            cls.stats.in_use++;
+            if (cls.idle != nullptr) {
+                idle_block* head = cls.idle;
+                cls.idle = head->next;
+                cls.stats.idle--;
+                cls.stats.reuses++;
+                return block(this, reinterpret_cast<u8*>(head), cap, idx);
+            }
+            cls.stats.allocations++;
+        }
+        // Allocate outside of the lock, faulting in a large block takes a while.
+        return block(this, allocate_block(cap), cap, idx);
+    }
+
+    void buffer_pool::release(u8* ptr, size_t cap, size_t size_class)
+    {
+        if (size_class == oversized) {
+            {
+                std::lock_guard lock(this->oversized_lock);
+                this->oversized_in_use--;
+                this->oversized_bytes -= cap;
+            }
+            free_block(ptr);
+            return;
+        }
+
+        auto& cls = this->classes.at(size_class);
+        size_t max_idle = std::max(retained_bytes_per_class / cap, min_retained_blocks);
+        {
+            std::lock_guard lock(cls.lock);
+            cls.stats.in_use--;
+            if (cls.stats.idle < max_idle) {
+                auto* idle = reinterpret_cast<idle_block*>(ptr);
+                idle->next = cls.idle;
+                cls.idle = idle;
+                cls.stats.idle++;
+                return;
+            }
+        }
+        free_block(ptr);
+    }
+
+    auto buffer_pool::stats() const -> pool_stats
+    {
+        pool_stats res;
+        for (size_t i = 0; i < num_size_classes; i++) {
+            const auto& cls = this->classes.at(i);
+            std::lock_guard lock(cls.lock);
+            res.classes.at(i) = cls.stats;
+            res.classes.at(i).block_size = min_block_size << i;
+        }
+        std::lock_guard lock(this->oversized_lock);
+        res.oversized_in_use = this->oversized_in_use;
+        res.oversized_bytes = this->oversized_bytes;
+        return res;
+    }
+
+    void buffer_pool::trim()
+    {
+        for (auto& cls : this->classes) {
+            idle_block* head = nullptr;
+            {
+                std::lock_guard lock(cls.lock);
+                head = std::exchange(cls.idle, nullptr);
+                cls.stats.idle = 0;
+            }
+            while (head != nullptr) {
+                free_block(reinterpret_cast<u8*>(std::exchange(head, head->next)));
+            }
+        }
+    }
+} // namespace tasarch::gdb
@@ -0,0 +1,202 @@
+/**
+ * @file buffer_pool.h
+ * @brief Pool of storage for `buffer`s, shared across all gdb connections.
+ *
+ * Every connection needs a couple of packet sized buffers (see `connection` and `PacketIO`), which used to be allocated and zero filled on every connect.
+ * Instead, storage is now handed out from size classes (powers of two), already faulted in and cache line aligned, and returned once the `buffer` goes away.
+ */
+#ifndef __GDB_BUFFER_POOL_H
+#define __GDB_BUFFER_POOL_H
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include "util/defines.h"
+#include "util/literals.h"
+
+namespace tasarch::gdb {
+    /**
+     * @brief Alignment of all storage handed out by `buffer_pool`, so buffers never share a cache line.
+     */
+    static constexpr size_t buffer_alignment = 64;
+
+    class buffer_pool
+    {
+    public:
+        /**
+         * @brief Smallest size class, smaller requests are rounded up to this.
+         */
+        static constexpr size_t min_block_size = 256;
+
+        /**
+         * @brief Size classes go from `min_block_size` to `max_block_size`, larger requests are allocated directly and never kept around.
+         */
+        static constexpr size_t num_size_classes = 13;
+        static constexpr size_t max_block_size = min_block_size << (num_size_classes - 1);
+
+        /**
+         * @brief How much memory each size class keeps around when idle, but always at least `min_retained_blocks`.
+         * Anything released on top of this is freed immediately.
+         */
+        static constexpr size_t retained_bytes_per_class = 2_MB;
+        static constexpr size_t min_retained_blocks = 8;
+
+        /**
+         * @brief Storage handed out by `acquire()`, given back to the pool on destruction.
+         */
+        class block
+        {
+        public:
+            block() = default;
+            block(const block&) = delete;
+            auto operator=(const block&) -> block& = delete;
+
+            block(block&& other) noexcept :
+                pool(std::exchange(other.pool, nullptr)), ptr(std::exchange(other.ptr, nullptr)), cap(std::exchange(other.cap, 0)), size_class(other.size_class)
+            {}
+
+            auto operator=(block&& other) noexcept -> block&
+            {
+                if (this != &other) {
+                    this->reset();
+                    this->pool = std::exchange(other.pool, nullptr);
+                    this->ptr = std::exchange(other.ptr, nullptr);
+                    this->cap = std::exchange(other.cap, 0);
+                    this->size_class = other.size_class;
+                }
+                return *this;
+            }
+
+            ~block()
+            {
+                this->reset();
+            }
+
+            [[nodiscard]] auto data() const -> u8*
+            {
+                return this->ptr;
+            }
+
+            /**
+             * @brief Usable size, this is the size of the size class and hence may be larger than what was requested.
+             */
+            [[nodiscard]] auto capacity() const -> size_t
+            {
+                return this->cap;
+            }
+
+            /**
+             * @brief Give the storage back to the pool early.
+             */
+            void reset();
+
+        private:
+            friend class buffer_pool;
+
+            block(buffer_pool* pool, u8* ptr, size_t cap, size_t size_class) : pool(pool), ptr(ptr), cap(cap), size_class(size_class) {}
+
+            buffer_pool* pool = nullptr;
+            u8* ptr = nullptr;
+            size_t cap = 0;
+            size_t size_class = 0;
+        };
+
+        /**
+         * @brief Occupancy of a single size class, see `stats()`.
+         */
+        struct size_class_stats
+        {
+            size_t block_size = 0;
+            /**
+             * @brief Blocks currently owned by a `buffer`.
+             */
+            size_t in_use = 0;
+            /**
+             * @brief Blocks kept around for the next `acquire()`.
+             */
+            size_t idle = 0;
+            /**
+             * @brief How often `acquire()` had to allocate (and fault in) a new block.
+             */
+            size_t allocations = 0;
+            /**
+             * @brief How often `acquire()` could hand out an idle block instead.
+             */
+            size_t reuses = 0;
+        };
+
+        struct pool_stats
+        {
+            std::array<size_class_stats, num_size_classes> classes {};
+            /**
+             * @brief Blocks larger than `max_block_size`, these are not pooled.
+             */
+            size_t oversized_in_use = 0;
+            size_t oversized_bytes = 0;
+
+            /**
+             * @brief Bytes held by the pool, both in use and idle.
+             */
+            [[nodiscard]] auto total_bytes() const -> size_t;
+        };
+
+        buffer_pool() = default;
+        buffer_pool(const buffer_pool&) = delete;
+        auto operator=(const buffer_pool&) -> buffer_pool& = delete;
+        buffer_pool(buffer_pool&&) = delete;
+        auto operator=(buffer_pool&&) -> buffer_pool& = delete;
+        ~buffer_pool();
+
+        /**
+         * @brief The pool used by all `buffer`s.
+         */
+        static auto shared() -> buffer_pool&;
+
+        /**
+         * @brief Storage for at least `size` bytes. Thread safe.
+         *
+         * @param size
+         * @return block Either an idle block of the matching size class or a newly allocated one, which is zero filled.
+         */
+        auto acquire(size_t size) -> block;
+
+        /**
+         * @brief Snapshot of the current occupancy, for monitoring.
+         */
+        [[nodiscard]] auto stats() const -> pool_stats;
+
+        /**
+         * @brief Free all idle blocks.
+         */
+        void trim();
+
+    private:
+        /**
+         * @brief Idle blocks form a singly linked list, with the link stored in the block itself, so releasing never allocates.
+         */
+        struct idle_block
+        {
+            idle_block* next;
+        };
+
+        struct size_class
+        {
+            mutable std::mutex lock;
+            idle_block* idle = nullptr;
+            size_class_stats stats;
+        };
+
+        static constexpr size_t oversized = num_size_classes;
+
+        static auto class_for(size_t size) -> size_t;
+        void release(u8* ptr, size_t cap, size_t size_class);
+
+        std::array<size_class, num_size_classes> classes;
+        mutable std::mutex oversized_lock;
+        size_t oversized_in_use = 0;
+        size_t oversized_bytes = 0;
+    };
+} // namespace tasarch::gdb
+
+#endif /* __GDB_BUFFER_POOL_H */
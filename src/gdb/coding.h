@@ -11,19 +11,26 @@
 #ifndef __GDB_CODING_H
 #define __GDB_CODING_H
 
+#include <algorithm>
 #include <functional>
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <system_error>
 #include <tuple>
 #include <concepts>
 #include <type_traits>
 #include <fmt/core.h>
 #include <charconv>
+#include <cstring>
+#include <span>
 #include <vector>
 #include "buffer.h"
+#include "gdb_err.h"
+#include "hex_codec.h"
 #include "util/concepts.h"
+#include "util/small_vector.h"
 
 namespace tasarch::gdb {
 
@@ -86,19 +93,54 @@ namespace tasarch::gdb {
         {TDecoder::decode_from(buf)} -> convertible_to<TValue>;
     };
 
+    /**
+     * @brief Where a coder encodes to, given the `loc_type` it decodes from.
+     *
+     * Most coders decode from a slice of the packet (a `std::string_view` pointing into the `buffer`), so decoding never copies.
+     * Obviously, nothing can be encoded into a view, so those encode into a `std::string` instead.
+     *
+     * @tparam TLocation
+     */
+    template<typename TLocation>
+    struct encode_location
+    {
+        using type = TLocation;
+    };
+
+    template<>
+    struct encode_location<std::string_view>
+    {
+        using type = std::string;
+    };
+
+    template<typename TLocation>
+    using encode_location_t = typename encode_location<TLocation>::type;
+
     /**
      * @brief Combines `Encoding` and `Decoding` to a single `Coding` concept. This allows us to require both.
      * 
      * @tparam TCoder 
      */
     template<typename TCoder>
-    concept Coding = Encoding<TCoder, typename TCoder::value_type, typename TCoder::loc_type>
+    concept Coding = Encoding<TCoder, typename TCoder::value_type, encode_location_t<typename TCoder::loc_type>>
                         and Decoding<TCoder, typename TCoder::value_type, typename TCoder::loc_type>
                         and requires {
                             typename TCoder::value_type;
                             typename TCoder::loc_type;
                         };
 
+    /**
+     * @brief A coder that knows exactly how many bytes a value will encode to, and can then write it to raw memory without any further checks.
+     * This is what allows `encode_buffer()` to reserve space only once for a whole response.
+     *
+     * @tparam TCoder
+     */
+    template<typename TCoder>
+    concept SizedEncoding = Coding<TCoder> and requires(const typename TCoder::value_type& val, u8* dst) {
+        {TCoder::encoded_size(val)} -> convertible_to<size_t>;
+        {TCoder::write_to(val, dst)} -> convertible_to<u8*>;
+    };
+
     /**
      * @name Black Magic
      * The stuff below is used to provide a generic function, that can decode a sequence of values, then call a callback with the decoded values as arguments.
@@ -205,6 +247,33 @@ namespace tasarch::gdb {
         std::apply(callback, std::tuple{TCoders::decode_from(buf)...});
     }
 
+    /**
+     * @brief The counterpart to `decode_buffer()`, encodes a sequence of values, described by the template arguments, into the buffer.
+     * The exact size is calculated upfront, the space is reserved once and everything is written in place, so nothing is allocated.
+     *
+     * @m_class{m-block m-success}
+     * @par Example
+     * Encoding a remote file io request (`Fname,args`):
+     * @code {.cpp}
+     using namespace tasarch::gdb::coders;
+     encode_buffer<Id<std::string_view>, Str<Id<std::string_view>, ','>, Id<std::string_view>>(some_buf, "F", name, args);
+     * @endcode
+     *
+     * @tparam TCoders
+     * @param buf
+     * @param args
+     * @throws buffer_too_small if the encoded values do not fit, in which case nothing is written.
+     */
+    template<tasarch::gdb::SizedEncoding ...TCoders>
+    void encode_buffer(tasarch::gdb::buffer& buf, const extract_arg<TCoders>&... args)
+    {
+        size_t size = (size_t{0} + ... + static_cast<size_t>(TCoders::encoded_size(args)));
+        buf.write_require(size);
+        u8* dst = buf.write_data();
+        ((dst = TCoders::write_to(args, dst)), ...);
+        buf.put_count(size);
+    }
+
     ///@}
 
     /**
@@ -216,6 +285,7 @@ namespace tasarch::gdb {
     /**
      * @brief Like id function, does nothing to its input.
      * Useful as default cases for certain coders that have a "child".
+     * Use `IdCoder<std::string_view>` if the value does not need to outlive the packet, that way nothing is copied.
      * 
      * @tparam TLocation 
      */
@@ -223,23 +293,34 @@ namespace tasarch::gdb {
     struct IdCoder
     {
         using value_type = TLocation;
-        using loc_type = TLocation;
+        using loc_type = std::string_view;
 
-        static auto decode_from(loc_type& buf) -> value_type
+        static auto decode_from(loc_type slice) -> value_type
         {
-            return buf;
+            return value_type(slice);
         }
 
-        static auto encode_to(value_type& value, loc_type& buf)
+        static auto encode_to(value_type& value, std::string& buf)
         {
             buf = value;
         }
+
+        static auto encoded_size(const value_type& value) -> size_t
+        {
+            return value.size();
+        }
+
+        static auto write_to(const value_type& value, u8* dst) -> u8*
+        {
+            std::memcpy(dst, value.data(), value.size());
+            return dst + value.size();
+        }
     };
 
     /**
      * @brief Decodes the contents of buffer up until it can find the separator `Sep` or the end of the buffer is reached.
      * If `SepReq` is true, an exception is thrown, if the end of string is reached before finding the separator.
-     * Once it has a string of characters, it calls upon the underlying child coder to decode the string into a useful value.
+     * Once it has found the slice of characters (with `memchr`, no copying), it calls upon the underlying child coder to decode the slice into a useful value.
      * This allows nicely nesting coders, to e.g. decode a hex number separated by a comma.
      * If you need to have the full string returned, you can use the `IdCoder` as mentioned before.
      * @note This alone does not help you implement optional arguments, but it can help.
@@ -256,25 +337,20 @@ namespace tasarch::gdb {
 
         static auto decode_from(loc_type& buf) -> value_type
         {
-            std::string ret;
-            u8 curr = 0;
-            while (true) {
-                if (buf.read_size() < 1) {
-                    if (SepReq) {
-                        // crash if this is uncommented
-                        // std::string error_msg = fmt::format("Unexpected end of string, expected to find {:c} first!", Sep);
-                        throw std::runtime_error("Unexpected end of string!");
-                    }
-                    break;
-                }
-                curr = buf.get_byte();
-                
-                if (curr == Sep) { break; }
-
-                ret += curr;
+            std::string_view rest = buf.read_view();
+            const void* sep_pos = std::memchr(rest.data(), Sep, rest.size());
+            if (sep_pos == nullptr && SepReq) {
+                // crash if this is uncommented
+                // std::string error_msg = fmt::format("Unexpected end of string, expected to find {:c} first!", Sep);
+                throw std::runtime_error("Unexpected end of string!");
             }
 
-            return TChildCoder::decode_from(ret);
+            size_t len = sep_pos == nullptr ? rest.size() : static_cast<const char*>(sep_pos) - rest.data();
+            std::string_view slice = rest.substr(0, len);
+            // skip the separator as well
+            buf.get_count(sep_pos == nullptr ? len : len + 1);
+
+            return TChildCoder::decode_from(slice);
         }
 
         /**
@@ -290,6 +366,28 @@ namespace tasarch::gdb {
             TChildCoder::encode_to(val,  ret);
             buf.append_buf(ret);
         }
+
+        /**
+         * @brief Size of the child's encoding, plus the separator (unless it is `\0`).
+         */
+        static auto encoded_size(const value_type& val) -> size_t
+            requires SizedEncoding<TChildCoder>
+        {
+            return TChildCoder::encoded_size(val) + (Sep == '\0' ? 0 : 1);
+        }
+
+        /**
+         * @brief Writes the child's encoding followed by the separator (unless it is `\0`), i.e. exactly what `decode_from()` consumes.
+         */
+        static auto write_to(const value_type& val, u8* dst) -> u8*
+            requires SizedEncoding<TChildCoder>
+        {
+            dst = TChildCoder::write_to(val, dst);
+            if constexpr (Sep != '\0') {
+                *dst++ = Sep;
+            }
+            return dst;
+        }
     };
 
     static_assert(Coding<StrCoder<>>, "Expected StrCoder to conform to coding!");
@@ -317,27 +415,46 @@ namespace tasarch::gdb {
 
             return TChildCoder::encode_to(value.value(),  buf);
         }
+
+        static auto encoded_size(const value_type& value) -> size_t
+            requires SizedEncoding<TChildCoder>
+        {
+            return value.has_value() ? TChildCoder::encoded_size(value.value()) : 0;
+        }
+
+        static auto write_to(const value_type& value, u8* dst) -> u8*
+            requires SizedEncoding<TChildCoder>
+        {
+            return value.has_value() ? TChildCoder::write_to(value.value(), dst) : dst;
+        }
     };
 
     static_assert(Coding<OptCoder<StrCoder<>>>, "Expected OptCoder to conform to coding!");
 
-    template<integral T, size_t Base = 0>
+    /**
+     * @brief Decodes / encodes a number in the given base.
+     *
+     * @tparam T
+     * @tparam Base
+     * @tparam Width Minimum number of digits when encoding, shorter numbers are padded with zeros (e.g. `E01`).
+     */
+    template<integral T, size_t Base = 0, size_t Width = 0>
     struct NumCoder
     {
         using value_type = T;
-        using loc_type = std::string;
+        using loc_type = std::string_view;
 
-        static auto decode_from(loc_type& buf) -> value_type
+        static auto decode_from(loc_type slice) -> value_type
         {
             value_type ret;
-            auto [ptr, error] = std::from_chars(buf.data(), buf.data() + buf.size(), ret, Base);
+            auto [ptr, error] = std::from_chars(slice.data(), slice.data() + slice.size(), ret, Base);
             if (error != std::errc()) {
                 throw std::system_error(std::make_error_code(error));
             }
             return ret;
         }
 
-        static auto encode_to(value_type& val, loc_type& buf)
+        static auto encode_to(value_type& val, std::string& buf)
         {
             buf.resize(17);
             
@@ -348,15 +465,73 @@ namespace tasarch::gdb {
             size_t diff = ptr - buf.data();
             buf.resize(diff);
         }
+
+        static constexpr auto encoded_size(const value_type& val) -> size_t
+            requires (Base >= 2)
+        {
+            return (is_negative(val) ? 1 : 0) + std::max(num_digits(magnitude(val)), Width);
+        }
+
+        static auto write_to(const value_type& val, u8* dst) -> u8*
+            requires (Base >= 2)
+        {
+            auto* out = reinterpret_cast<char*>(dst);
+            if (is_negative(val)) {
+                *out++ = '-';
+            }
+            auto mag = magnitude(val);
+            size_t digits = num_digits(mag);
+            for (size_t i = digits; i < Width; i++) {
+                *out++ = '0';
+            }
+            // cannot fail, encoded_size() made sure there is enough room.
+            std::to_chars(out, out + digits, mag, Base);
+            return reinterpret_cast<u8*>(out + digits);
+        }
+
+    private:
+        using unsigned_type = std::make_unsigned_t<value_type>;
+
+        static constexpr auto is_negative(const value_type& val) -> bool
+        {
+            if constexpr (std::is_signed_v<value_type>) {
+                return val < 0;
+            }
+            return false;
+        }
+
+        static constexpr auto magnitude(const value_type& val) -> unsigned_type
+        {
+            auto mag = static_cast<unsigned_type>(val);
+            return is_negative(val) ? static_cast<unsigned_type>(unsigned_type{0} - mag) : mag;
+        }
+
+        static constexpr auto num_digits(unsigned_type mag) -> size_t
+        {
+            size_t digits = 1;
+            while (mag >= Base) {
+                mag /= Base;
+                digits++;
+            }
+            return digits;
+        }
     };
 
     static_assert(Coding<NumCoder<size_t>>, "Expected NumCoder to conform to coding!");
 
-    template<integral T = size_t>
-    using HexNumCoder = NumCoder<T, 16>;
+    template<integral T = size_t, size_t Width = 0>
+    using HexNumCoder = NumCoder<T, 16, Width>;
     
     static_assert(Coding<HexNumCoder<>>, "Expected HexNumCoder to conform to coding!");
+    static_assert(SizedEncoding<HexNumCoder<>>, "Expected HexNumCoder to have a sized encoding!");
 
+    /**
+     * @brief Hex encoded data, e.g. for the `M` packet. Elements are decoded from / encoded to memory order, i.e. the bytes of each element as they are in memory.
+     *
+     * Both directions work on the whole buffer at once (see `hex_codec.h`), instead of a nibble at a time.
+     *
+     * @tparam TContainer
+     */
     template<MyContainer TContainer>
     struct BytesCoder
     {
@@ -367,48 +542,109 @@ namespace tasarch::gdb {
         using size_type = typename TContainer::size_type;
 
         /**
-         * @brief 
-         * @todo HEX ERROR CHECKING!
+         * @brief Decodes the rest of the buffer.
+         * @throws gdb_error (`invalid_hex`) if there is an invalid digit or the number of digits does not make up whole elements.
          * @param buf 
          * @return value_type 
          */
         static auto decode_from(loc_type& buf) -> value_type
         {
+            size_t num = buf.read_size();
+            if (num % (2 * elem_size) != 0) {
+                throw gdb_error(invalid_hex, fmt::format("Expected a multiple of {} hex digits, got {}", 2 * elem_size, num));
+            }
+
             value_type ret;
-            while (buf.read_size() > 0) {
-                elem_type elem;
-                u8* ptr = reinterpret_cast<u8*>(&elem);
-                for (size_t i = 0; i < elem_size; i++) {
-                    u8 hi = buf.get_byte();
-                    u8 lo = buf.get_byte();
-                    u8 bval = (decode_hex(hi) << 4) | decode_hex(lo);
-                    *ptr = bval;
-                    ptr++;
-                }
-                ret.push_back(elem);
+            ret.resize(static_cast<size_type>(num / (2 * elem_size)));
+            size_t valid = codec::hex_decode(buf.read_data(), num, reinterpret_cast<u8*>(ret.data()));
+            if (valid != num) {
+                throw gdb_error(invalid_hex, fmt::format("Invalid hex digit 0x{:02x} at offset {}", buf.read_data()[valid], valid));
             }
+            buf.get_count(num);
             return ret;
         }
 
+        /**
+         * @brief 
+         * @throws buffer_too_small if the encoded data does not fit, in which case nothing is written.
+         * @param val 
+         * @param buf 
+         */
         static auto encode_to(value_type& val, loc_type& buf)
         {
-            for (size_type i = 0; i < val.size(); i++) {
-                elem_type elem = val.at(i);
-                u8* ptr = reinterpret_cast<u8*>(&elem);
-                for (size_t i = 0; i < elem_size; i++) {
-                    u8 bval = *ptr;
-                    ptr++;
-                    u8 hi = bval >> 4;
-                    u8 lo = bval & 0xf;
-                    buf.put_byte(encode_hex(hi));
-                    buf.put_byte(encode_hex(lo));
-                }
-            }
+            size_t num = static_cast<size_t>(val.size()) * elem_size;
+            buf.write_require(2 * num);
+            codec::hex_encode(reinterpret_cast<const u8*>(val.data()), num, buf.write_data());
+            buf.put_count(2 * num);
+        }
+
+        static auto encoded_size(const value_type& val) -> size_t
+        {
+            return 2 * static_cast<size_t>(val.size()) * elem_size;
+        }
+
+        static auto write_to(const value_type& val, u8* dst) -> u8*
+        {
+            size_t num = static_cast<size_t>(val.size()) * elem_size;
+            codec::hex_encode(reinterpret_cast<const u8*>(val.data()), num, dst);
+            return dst + 2 * num;
         }
     };
 
     static_assert(Coding<BytesCoder<std::vector<u8>>>, "Expected BytesCoder to conform to coding!");
 
+    /**
+     * @brief How many bytes of a memory payload are stored inline in `payload_bytes`. Most writes only patch a variable, so they fit easily.
+     */
+    static constexpr size_t inline_payload_size = 32;
+
+    /**
+     * @brief Container for decoded memory payloads (e.g. `M`), small ones never touch the heap.
+     */
+    using payload_bytes = small_vector<u8, inline_payload_size>;
+
+    static_assert(Coding<BytesCoder<payload_bytes>>, "Expected BytesCoder to conform to coding with payload_bytes!");
+
+    /**
+     * @brief Takes the rest of the buffer as raw binary data, e.g. for the `X` packet.
+     *
+     * In contrast to `BytesCoder`, there is no hex involved and nothing is copied, the decoded span points straight into the buffer.
+     * Escaping was already undone by `PacketIO`, so the bytes are exactly what gdb sent.
+     * @warning The span is only valid as long as the buffer is not touched again.
+     */
+    struct BinaryCoder
+    {
+        using value_type = std::span<const u8>;
+        using loc_type = buffer;
+
+        static auto decode_from(loc_type& buf) -> value_type
+        {
+            value_type ret(buf.read_data(), buf.read_size());
+            buf.get_count(ret.size());
+            return ret;
+        }
+
+        static auto encode_to(value_type& val, loc_type& buf)
+        {
+            buf.write_require(val.size());
+            std::memcpy(buf.write_data(), val.data(), val.size());
+            buf.put_count(val.size());
+        }
+
+        static auto encoded_size(const value_type& val) -> size_t
+        {
+            return val.size();
+        }
+
+        static auto write_to(const value_type& val, u8* dst) -> u8*
+        {
+            std::memcpy(dst, val.data(), val.size());
+            return dst + val.size();
+        }
+    };
+
+    static_assert(Coding<BinaryCoder>, "Expected BinaryCoder to conform to coding!");
+
     template<Coding TChildCoder = IdCoder<std::string>, char Sep = ';'>
     struct ArrayCoder
     {
@@ -440,9 +676,32 @@ namespace tasarch::gdb {
                 }
             }
         }
+
+        static auto encoded_size(const value_type& val) -> size_t
+            requires SizedEncoding<TChildCoder>
+        {
+            size_t size = val.empty() ? 0 : val.size() - 1;
+            for (const auto& elem : val) {
+                size += TChildCoder::encoded_size(elem);
+            }
+            return size;
+        }
+
+        static auto write_to(const value_type& val, u8* dst) -> u8*
+            requires SizedEncoding<TChildCoder>
+        {
+            for (size_type i = 0; i < val.size(); i++) {
+                if (i != 0) {
+                    *dst++ = Sep;
+                }
+                dst = TChildCoder::write_to(val[i], dst);
+            }
+            return dst;
+        }
     };
 
     static_assert(Coding<ArrayCoder<HexNumCoder<size_t>>>, "Expected ArrayCoder to conform to coding!");
+    static_assert(SizedEncoding<ArrayCoder<HexNumCoder<size_t>>>, "Expected ArrayCoder of numbers to have a sized encoding!");
 
     namespace coders {
         using Hex = HexNumCoder<size_t>;
@@ -456,6 +715,8 @@ namespace tasarch::gdb {
         template<MyContainer TContainer = std::vector<u8>>
         using Bytes = BytesCoder<TContainer>;
 
+        using Binary = BinaryCoder;
+
         template<Coding TChildCoder>
         using Opt = OptCoder<TChildCoder>;
 
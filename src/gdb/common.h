@@ -10,12 +10,18 @@
 #include <chrono>
 #include <exception>
 #include <stdexcept>
+#include <type_traits>
 #include <variant>
 #include "asio.h"
 #include <asio.hpp>
 #include <asio/awaitable.hpp>
 #include <asio/deadline_timer.hpp>
 #include <asio/basic_waitable_timer.hpp>
+#include <asio/bind_cancellation_slot.hpp>
+#include <asio/bind_executor.hpp>
+#include <asio/cancellation_signal.hpp>
+#include <asio/steady_timer.hpp>
+#include <asio/this_coro.hpp>
 #include <asio/experimental/awaitable_operators.hpp>
 #include <asio/use_awaitable.hpp>
 #include "bg_executor.h"
@@ -50,6 +56,8 @@ namespace tasarch::gdb {
 
     /**
      * @brief Use to await something with a timeout.
+     *
+     * Creates a new timer and spawns a parallel group every time, so prefer `deadline` for anything done per packet.
      * 
      * @code {.cpp}
      * using namespace std::chrono_literals; // for nice duration literals.
@@ -92,6 +100,86 @@ namespace tasarch::gdb {
         asio::awaitable<bool> temp_await = temp();
         co_await awaitable_with_timeout<bool>(std::move(temp_await), timeout);
     }
+
+    /**
+     * @brief Reusable timeout for async operations, that does not allocate once warmed up.
+     *
+     * Instead of racing the operation against a fresh timer like `awaitable_with_timeout()`, it re-arms the same `asio::steady_timer` for every operation and cancels the operation through its cancellation slot when it expires.
+     * Only one operation can be running per deadline at a time, so use one per direction (e.g. reading and writing a socket).
+     *
+     * @code {.cpp}
+     * size_t num = co_await this->read_deadline.run([&](auto token) {
+     *     return this->socket.async_receive(this->read_buf, token);
+     * }, 1000ms);
+     * @endcode
+     */
+    class deadline
+    {
+    public:
+        using token_type = asio::cancellation_slot_binder<asio::use_awaitable_t<>, asio::cancellation_slot>;
+
+        explicit deadline(const asio::any_io_executor& executor) : timer(executor) {}
+
+        /**
+         * @brief Start the operation by calling `op` with a completion token and await it, cancelling it if it does not complete within `timeout`.
+         * @throws timed_out When the timeout was reached.
+         *
+         * @tparam TOp Callable taking `token_type` and returning an `asio::awaitable`.
+         * @param op
+         * @param timeout
+         */
+        template<typename TOp>
+        auto run(TOp op, std::chrono::steady_clock::duration timeout) -> std::invoke_result_t<TOp, token_type>
+        {
+            this->arm(timeout, co_await asio::this_coro::executor);
+            try {
+                disarm_guard guard{ *this };
+                co_return co_await op(asio::bind_cancellation_slot(this->signal.slot(), asio::use_awaitable));
+            } catch (asio::system_error& e) {
+                if (this->fired) {
+                    throw timed_out();
+                }
+                throw;
+            }
+        }
+
+    private:
+        asio::steady_timer timer;
+        asio::cancellation_signal signal;
+
+        /**
+         * @brief Bumped on every arm / disarm, so a timer handler that was already queued does not cancel the next operation.
+         */
+        size_t generation = 0;
+        bool fired = false;
+
+        struct disarm_guard
+        {
+            deadline& owner;
+            ~disarm_guard() { owner.disarm(); }
+        };
+
+        /**
+         * @brief The handler runs on `executor`, i.e. the awaiting coroutine's, so emitting the cancellation is synchronized with the operation.
+         */
+        void arm(std::chrono::steady_clock::duration timeout, const asio::any_io_executor& executor)
+        {
+            this->fired = false;
+            this->timer.expires_after(timeout);
+            this->timer.async_wait(asio::bind_executor(executor, [this, gen = ++this->generation](const asio::error_code& ec) {
+                if (!ec && gen == this->generation) {
+                    this->fired = true;
+                    this->signal.emit(asio::cancellation_type::all);
+                }
+            }));
+        }
+
+        void disarm()
+        {
+            ++this->generation;
+            this->timer.cancel();
+        }
+    };
     
 } // namespace tasarch::gdb
 
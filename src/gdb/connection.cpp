@@ -10,28 +10,62 @@
 #include <asio/awaitable.hpp>
 #include <asio/co_spawn.hpp>
 #include <asio/detached.hpp>
+#include <asio/post.hpp>
 #include <asio/use_awaitable.hpp>
 #include <fmt/core.h>
+#include "config/config.h"
 #include "easter_eggs.h"
+#include "gdb/hex_codec.h"
 #include "gdb/packet_io.h"
 #include "gdb/protocol.h"
 	
 namespace tasarch::gdb {
-    connection::connection(tcp::socket sock, std::shared_ptr<Debugger> debugger) : log::WithLogger("gdb.conn"), debugger(std::move(debugger)), packet_io(sock)
+    connection::connection(transport sock, std::shared_ptr<Debugger> debugger) : log::WithLogger("gdb.conn"),
+        packet_size(config::conf()->gdb.packet_size), debugger(std::move(debugger)), packet_io(sock, config::conf()->gdb.transport_buffer_size),
+        strand(asio::make_strand(packet_io.socket.get_executor())),
+        free_packets(strand, gdb_read_ahead_depth), ready_packets(strand, gdb_read_ahead_depth + 1), stops(strand, 1)
     {
         using namespace tasarch::gdb::coders;
-        bind_handler<Str<Hex, ',', true>, Str<Hex>>(read_mem, &connection::handle_read_mem);
-        bind_handler<Str<Hex, ',', true>, Str<Hex, ':', true>, Bytes<std::vector<u8>>>(write_mem, &connection::handle_write_mem);
-        bind_handler<>(get, [](connection* self){ self->handle_query(get_val); });
-        bind_handler<>(set, [](connection* self){ self->handle_query(set_val); });
-        bind_handler<Str<NumCoder<int64_t, 16>, ','>, Opt<Str<Hex, ','>>, Opt<Str<IdCoder<std::string>, ';'>>, Opt<Str<>>>(file_io, &connection::handle_file_reply);
-
-        add_query("Supported").bind_get_query<ArrayCoder<FeatureCoder>>(&connection::handle_supported);
+        bind_handler<"%x,%x", &connection::handle_read_mem>(read_mem);
+        bind_handler<"%x,%x:%b", &connection::handle_write_mem>(write_mem);
+        bind_handler<"%x,%x", &connection::handle_read_mem_bin>(read_mem_bin);
+        bind_handler<"%x,%x:%r", &connection::handle_write_mem_bin>(write_mem_bin);
+        bind_handler<&connection::handle_stop_reason>(query_stop_reason);
+        bind_handler<&connection::handle_detach>(detach);
+        bind_handler<&connection::handle_read_registers>(read_gpr);
+        bind_handler<"%s", &connection::handle_write_registers>(write_gpr);
+        bind_handler<"%x", &connection::handle_read_register>(read_reg);
+        bind_handler<"%x=%s", &connection::handle_write_register>(write_reg);
+        bind_handler<"%x,%x,%x[;%s]", &connection::handle_add_breakpoint>(add_break);
+        bind_handler<"%x,%x,%x", &connection::handle_remove_breakpoint>(del_break);
+        bind_handler<[](connection* self){ self->handle_query(get_val); }>(get);
+        bind_handler<[](connection* self){ self->handle_query(set_val); }>(set);
+        bind_handler<"%i[,%x[,%s[;%s]]]", &connection::handle_file_reply>(file_io);
+
+        std::string packet_size_str;
+        size_t pkt_size = this->packet_size;
+        Hex::encode_to(pkt_size, packet_size_str);
+        our_features.emplace_back("PacketSize", packet_size_str);
+        // x packet, X is probed by gdb instead.
+        our_features.emplace_back("binary-upload", true);
+
+        packet_io.set_rle(config::conf()->gdb.rle);
+        packet_io.set_dedicated_reader(true);
+
+        // Buffers cannot be copied, their storage comes from the shared buffer_pool.
+        packet_pool.reserve(gdb_read_ahead_depth);
+        for (size_t i = 0; i < gdb_read_ahead_depth; i++) {
+            packet_pool.emplace_back(packet_size);
+        }
+        for (auto& buf : packet_pool) {
+            free_packets.try_send(asio::error_code{}, received_packet{ .buf = &buf });
+        }
 
-        std::string packet_size;
-        size_t pkt_size = gdb_packet_buffer_size;
-        Hex::encode_to(pkt_size, packet_size);
-        our_features.emplace_back("PacketSize", packet_size);
+        if (this->debugger) {
+            this->regs.emplace(*this->debugger);
+            // Z0 / Z1 with agent expressions, evaluated by the target itself.
+            our_features.emplace_back("ConditionalBreakpoints", true);
+        }
 
         internal_mem::init();
     }
@@ -44,8 +78,9 @@ namespace tasarch::gdb {
         }
         this->running = true;
         this->should_stop = false;
-        asio::co_spawn(this->packet_io.socket.get_executor(), this->process(), asio::detached);
-        asio::co_spawn(this->packet_io.socket.get_executor(), this->remote_io_testing(), asio::detached);
+        asio::co_spawn(this->strand, this->read_packets(), asio::detached);
+        asio::co_spawn(this->strand, this->process(), asio::detached);
+        asio::co_spawn(this->strand, this->remote_io_testing(), asio::detached);
     }
 
     void connection::stop()
@@ -64,48 +99,116 @@ namespace tasarch::gdb {
         this->should_stop = true;
     }
 
-    auto connection::process() -> asio::awaitable<void>
+    auto connection::read_packets() -> asio::awaitable<void>
     {
-        this->logger->info("Starting processing loop...");
+        this->logger->debug("Starting reader...");
         try {
             while (true) {
-                this->logger->trace("process loop iteration");
                 if (!this->packet_io.socket.is_open()) {
-                    this->logger->info("Remote socket {} closed, exiting...", this->packet_io.socket.remote_endpoint());
+                    this->logger->info("Remote socket closed, stopping reader...");
                     break;
                 }
                 if (should_stop) {
-                    this->logger->info("Got stop signal, exiting...");
+                    this->logger->debug("Got stop signal, stopping reader...");
                     break;
                 }
-                this->logger->trace("reading remote packet...");
+                // Acks and interrupts need no buffer, so they are picked up even while process() is lagging behind.
+                // Otherwise, a response waiting for its ack could never get it.
                 bool did_break = false;
                 try {
-                    did_break = co_await this->packet_io.receive_packet(this->packet_buf);
+                    did_break = co_await this->packet_io.receive_control();
                 } catch (timed_out& e) {
                     this->logger->trace("recv timed out");
                     continue;
-                } /*catch (...) {
-                    auto eptr = std::current_exception();
-                    try {
-                        std::rethrow_exception(eptr);
-                    } catch (timed_out& e) {
-                        this->logger->critical("what???");
-                    }
-                }*/
-                
-                auto req = this->packet_buf.read_buf<std::string>();
-                this->logger->trace("received remote packet:\n\t{}", req);
+                }
+                if (did_break) {
+                    this->received_break();
+                    continue;
+                }
+
+                // Only blocks if process() is lagging behind gdb_read_ahead_depth packets.
+                auto pkt = co_await this->free_packets.async_receive(asio::use_awaitable);
+                this->logger->trace("reading remote packet...");
+                try {
+                    pkt.did_break = co_await this->packet_io.receive_packet(*pkt.buf);
+                } catch (timed_out& e) {
+                    this->logger->trace("recv timed out");
+                    this->free_packets.try_send(asio::error_code{}, pkt);
+                    continue;
+                }
+
+                if (pkt.did_break) {
+                    this->free_packets.try_send(asio::error_code{}, pkt);
+                    this->received_break();
+                    continue;
+                }
+                co_await this->ready_packets.async_send(asio::error_code{}, pkt, asio::use_awaitable);
+            }
+        } catch (std::exception& e) {
+            this->logger->info("Reader exiting: {}", e.what());
+        }
+        // Wakes up process(), in case it is waiting for the next packet.
+        this->ready_packets.close();
+        // Or for the target, which might never stop on its own. Nobody would be left to stop it later on either.
+        if (this->target_running) {
+            this->logger->info("Stopping target, the remote is gone");
+            this->debugger->request_break();
+        }
+        this->stops.close();
+    }
+
+    void connection::received_break()
+    {
+        this->logger->info("Remote requested a break!");
+        if (this->pending_interrupt.exchange(true)) {
+            // Still being handled, one stop reply answers all of them.
+            return;
+        }
+        if (this->debugger) {
+            this->debugger->request_break();
+        }
+        if (!this->break_queued) {
+            // Without a buffer, so it never waits for process(). There is room for exactly this one besides all buffers.
+            this->break_queued = true;
+            this->ready_packets.try_send(asio::error_code{}, received_packet{ .buf = nullptr, .did_break = true });
+        }
+    }
+
+    auto connection::process() -> asio::awaitable<void>
+    {
+        this->logger->info("Starting processing loop...");
+        try {
+            while (true) {
+                this->logger->trace("process loop iteration");
+                if (should_stop) {
+                    this->logger->info("Got stop signal, exiting...");
+                    break;
+                }
+                received_packet pkt;
+                try {
+                    pkt = co_await this->ready_packets.async_receive(asio::use_awaitable);
+                } catch (asio::system_error& e) {
+                    this->logger->info("Reader stopped ({}), exiting...", e.what());
+                    break;
+                }
+                bool did_break = pkt.did_break;
+                if (did_break) {
+                    this->break_queued = false;
+                } else {
+                    this->packet_buf = pkt.buf;
+                    this->logger->trace("received remote packet:\n\t{}", this->packet_buf->read_view());
+                }
                 this->resp_buf.reset();
+                this->resp_stream.reset();
                 this->should_respond = true;
                 try {
                     if (did_break) {
-                        this->logger->info("Remote requested a break!");
-                        //this->debugger->request_break();
-                        if (this->packet_buf.read_size() > 0) {
-                            this->logger->warn("Got packet and break request!");
+                        if (this->pending_interrupt.exchange(false)) {
+                            this->append_stop_reply(this->debugger ? this->debugger->last_stop() : stop_reason{});
+                        } else {
+                            // The target already stopped because of it and `resume_target()` replied.
+                            this->should_respond = false;
                         }
-                        this->append_str("S05");
                     } else {
                         co_await this->process_pkt();
                     }
@@ -126,6 +229,17 @@ namespace tasarch::gdb {
                     this->logger->debug("Something else responded already, doing nothing now...");
                 }
 
+                if (this->pending_no_ack) {
+                    // The OK for QStartNoAckMode still had to be acked, from here on nothing is.
+                    this->logger->info("Entering no-ack mode");
+                    this->pending_no_ack = false;
+                    this->packet_io.set_no_ack();
+                }
+
+                if (this->packet_buf != nullptr) {
+                    this->packet_buf = nullptr;
+                    this->free_packets.try_send(asio::error_code{}, pkt);
+                }
             }
         } catch (std::exception& e) {
             this->logger->error("Unhandled exception in processing loop: {}", e.what());
@@ -134,38 +248,35 @@ namespace tasarch::gdb {
             this->logger->critical("Completely unknown exception wtf????");
             this->stop();
         }
+        // In case the reader is waiting for us to give back a buffer.
+        this->free_packets.close();
+        // Otherwise, they would still hit (and stop the target) with nobody left to tell.
+        this->remove_own_breakpoints();
     }
     
     asio::awaitable<void> connection::process_pkt()
     {
-        u8 ident = this->packet_buf.get_byte();
+        u8 ident = this->packet_buf->get_byte();
         auto type = static_cast<packet_type>(ident);
         switch (type) {
-        case query_stop_reason:
-        this->logger->trace("Queried stop reason");
-        this->append_str("S05");
-        break;
-
-        case read_gpr:
-        this->append_str("0000000000000000000000000000000000000000000000000000000000000000");
-        break;
-
-        case read_reg:
-        this->append_str("0000");
-        break;
-
         case cont:
+        case step:
         {
-            this->wakeup_request();
+            if (!this->io_req.empty() || !this->debugger) {
+                // A pending remote io call answers instead, see `remote_io()`.
+                this->wakeup_request();
+            } else {
+                co_await this->resume_target(type == step ? resume_mode::step : resume_mode::cont);
+            }
         }
         break;
 
         default:
         {
-            if (packet_handlers.contains(type)) {
-                packet_handlers[type]();
+            if (const auto& handler = packet_handlers[static_cast<u8>(type)]; handler.has_value()) {
+                (*handler)(this);
             } else {
-                std::string res = this->packet_buf.get_str();
+                std::string res = this->packet_buf->get_str();
                 throw unknown_request(fmt::format("ident {:c}, rest: {}", ident, res));
             }
         }
@@ -177,34 +288,87 @@ namespace tasarch::gdb {
 
     void connection::append_error(err_code code)
     {
-        std::string err_str = fmt::format("E{:02X}", code);
-        this->resp_buf.append_buf(err_str);
+        using namespace coders;
+        encode_response<Id<std::string_view>, HexNumCoder<u8, 2>>("E", code);
     }
 
     void connection::append_ok()
     {
-        std::string ok_str = "OK";
-        this->resp_buf.append_buf(ok_str);
+        this->resp_buf.append_buf(std::string_view("OK"));
     }
 
-    void connection::append_str(std::string s)
+    void connection::append_str(std::string_view s)
     {
         this->resp_buf.append_buf(s);
     }
 
-    void connection::append_hex(std::string s)
+    void connection::append_hex(std::span<const u8> data)
+    {
+        this->resp_buf.write_require(2 * data.size());
+        codec::hex_encode(data.data(), data.size(), this->resp_buf.write_data());
+        this->resp_buf.put_count(2 * data.size());
+    }
+
+    void connection::append_stop_reply(stop_reason reason)
     {
-        for (auto car : s) {
-            u8 low = car & 0xf;
-            u8 hi = (car >> 4) & 0xf;
-            this->resp_buf.put_byte(encode_hex(hi));
-            this->resp_buf.put_byte(encode_hex(low));
+        using namespace coders;
+        std::string_view kind = "S";
+        switch (reason.type) {
+        case stop_reason::kind::signal:
+            kind = "S";
+            break;
+        case stop_reason::kind::exited:
+            kind = "W";
+            break;
+        case stop_reason::kind::terminated:
+            kind = "X";
+            break;
         }
+        encode_response<Id<std::string_view>, HexNumCoder<u8, 2>>(kind, reason.signal);
+    }
+
+    auto connection::resume_target(resume_mode mode) -> asio::awaitable<void>
+    {
+        this->logger->debug("Resuming target ({})", mode == resume_mode::step ? "step" : "continue");
+        // Pending register writes reach the target now, afterwards they can change.
+        this->registers().invalidate();
+        // The handler can run on any thread (or right away), so it only hands the reason over to our strand.
+        // It can also run after we are gone, so it must not keep us (or our strand) alive.
+        this->target().resume(mode, [weak = this->weak_from_this(), strand = this->strand](stop_reason reason) {
+            asio::post(strand, [weak, reason] {
+                if (auto self = weak.lock()) {
+                    self->stops.try_send(asio::error_code{}, reason);
+                }
+            });
+        });
+        this->target_running = true;
+        stop_reason reason;
+        try {
+            reason = co_await this->stops.async_receive(asio::use_awaitable);
+        } catch (asio::system_error& e) {
+            // The reader closed `stops`, since the remote is gone. Nobody to reply to.
+            this->logger->info("Stopped waiting for the target: {}", e.what());
+            this->target_running = false;
+            this->should_respond = false;
+            co_return;
+        }
+        this->target_running = false;
+        this->logger->debug("Target stopped with signal {}", reason.signal);
+        // Whatever interrupt arrived meanwhile is answered by this stop.
+        this->pending_interrupt = false;
+        this->append_stop_reply(reason);
     }
 
     auto connection::send_response() -> asio::awaitable<void>
     {
-        auto resp = this->resp_buf.read_buf<std::string>();
+        if (this->resp_stream) {
+            this->logger->trace("streaming response packet");
+            auto stream = std::move(this->resp_stream);
+            co_await this->packet_io.send_streamed(*stream, this->resp_buf);
+            co_return;
+        }
+
+        auto resp = this->resp_buf.read_view();
         this->logger->trace("sending response packet:\n\t{}", resp);
         co_await this->packet_io.send_packet(this->resp_buf);
     }
@@ -216,7 +380,8 @@ namespace tasarch::gdb {
         co_await this->wait_for_request();
 
         this->logger->debug("Got chance to respond!");
-        this->append_str(fmt::format("F{},{}", name, args));
+        using namespace coders;
+        encode_response<Id<std::string_view>, Str<Id<std::string_view>, ','>, Id<std::string_view>>("F", name, args);
 
         this->logger->debug("Waiting for response...");
 
@@ -2,35 +2,51 @@
 #define __CONNECTION_H
 
 #include "protocol.h"
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <tuple>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 #include <queue>
+#include <span>
 #include "asio.h"
 #include <asio/awaitable.hpp>
 #include <asio/basic_waitable_timer.hpp>
 #include <asio/buffer.hpp>
+#include <asio/experimental/channel.hpp>
+#include <asio/strand.hpp>
 #include "log/logging.h"
 #include "debugger.h"
 #include "packet_io.h"
 #include "buffer.h"
 #include "gdb_err.h"
 #include "coding.h"
+#include "packet_format.h"
 #include "query_handler.h"
+#include "register_cache.h"
+#include "util/function_ref.h"
 
 namespace tasarch::gdb {
 	using asio::ip::tcp;
 
-	class connection : log::WithLogger, std::enable_shared_from_this<connection>
+	/**
+	 * @brief How many packets a connection can have received, including the one currently being handled.
+	 *
+	 * The reader stops reading from the socket once all of them are in use, so this bounds how far pipelined requests are parsed ahead.
+	 */
+	static constexpr size_t gdb_read_ahead_depth = 4;
+
+	class connection : log::WithLogger, public std::enable_shared_from_this<connection>
 	{
 	public:
-		explicit connection(tcp::socket sock, std::shared_ptr<Debugger> debugger);
+		explicit connection(transport sock, std::shared_ptr<Debugger> debugger);
 
 		void start();
 		void stop();
@@ -38,80 +54,259 @@ namespace tasarch::gdb {
 		auto process() -> asio::awaitable<void>;
 		asio::awaitable<void>  process_pkt();
 
+		/**
+		 * @brief Whether the remote sent an interrupt that has not been answered yet.
+		 *
+		 * Set by the reader as soon as the break character arrives, even while another packet is still being handled.
+		 */
+		[[nodiscard]] auto interrupt_pending() const -> bool { return this->pending_interrupt; }
+
 	private:
-		buffer packet_buf = buffer(gdb_packet_buffer_size);
-		buffer resp_buf = buffer(gdb_packet_buffer_size);
+		/**
+		 * @brief A packet parsed by `read_packets()`, waiting to be handled by `process()`.
+		 * Interrupts come without a buffer (`buf` is null and `did_break` set).
+		 */
+		struct received_packet
+		{
+			buffer* buf = nullptr;
+			bool did_break = false;
+		};
+		using packet_channel = asio::experimental::channel<void(asio::error_code, received_packet)>;
+
+		/**
+		 * @brief Size of our packet buffers (`gdb.packet_size`), fixed for the lifetime of the connection.
+		 */
+		size_t packet_size;
+
+		/**
+		 * @brief Storage for received packets, handed back and forth between reader and `process()` through `free_packets` and `ready_packets`.
+		 */
+		std::vector<buffer> packet_pool;
+
+		/**
+		 * @brief The packet currently being handled, points into `packet_pool`.
+		 */
+		buffer* packet_buf = nullptr;
+		buffer resp_buf = buffer(packet_size);
+		/**
+		 * @brief Raw target data (memory, registers) is read into this before being encoded into `resp_buf`, so handlers never allocate.
+		 */
+		buffer scratch_buf = buffer(packet_size);
+
+		/**
+		 * @brief If set, the response is sent from this instead of `resp_buf`, see `PacketIO::send_streamed()`.
+		 */
+		std::unique_ptr<packet_source> resp_stream;
 
 		std::shared_ptr<Debugger> debugger;
+		/**
+		 * @brief Registers of the stopped target, only set if we have a debugger. Invalidated by `resume_target()`.
+		 */
+		std::optional<register_cache> regs;
 		bool should_stop = false;
 		bool running = false;
 		bool should_respond = true;
+		std::atomic<bool> pending_interrupt = false;
+		/**
+		 * @brief Set while `resume_target()` waits for the target to stop, so the reader can stop it if the remote goes away.
+		 */
+		bool target_running = false;
+		/**
+		 * @brief Whether an interrupt is waiting in `ready_packets`, there is never more than one.
+		 */
+		bool break_queued = false;
+		/**
+		 * @brief Set by `QStartNoAckMode`, we only switch `packet_io` over once the `OK` has been acked.
+		 */
+		bool pending_no_ack = false;
+		/**
+		 * @brief Breakpoints inserted by this connection, which it removes again once it ends.
+		 * The target's `breakpoint_manager` is shared by all connections, so we must not touch the ones set by others.
+		 * If two connections insert the same one, it is the same breakpoint though and removed by whoever ends first.
+		 */
+		std::vector<std::pair<breakpoint_type, size_t>> own_breakpoints;
 		PacketIO packet_io;
 
+		/**
+		 * @brief All coroutines of this connection run here, so reader and handler never run concurrently.
+		 */
+		asio::strand<asio::any_io_executor> strand;
+		packet_channel free_packets;
+		packet_channel ready_packets;
+		/**
+		 * @brief The debugger's stop handler sends here (through `strand`), where `resume_target()` is waiting for it.
+		 */
+		asio::experimental::channel<void(asio::error_code, stop_reason)> stops;
+
+		/**
+		 * @brief Keeps receiving packets into free buffers of `packet_pool` and queues them for `process()`.
+		 *
+		 * This way, pipelined requests are already parsed while we are still handling the previous one and interrupts are noticed immediately.
+		 */
+		auto read_packets() -> asio::awaitable<void>;
+		/**
+		 * @brief The reader got a `break_character`: stops the target right away and queues the interrupt for `process()`, which replies if the target did not already.
+		 */
+		void received_break();
+
 	#pragma mark Response Helpers
 
 		auto send_response() -> asio::awaitable<void>;
 		void append_error(err_code code);
 		void append_ok();
-		void append_str(std::string s);
-		void append_hex(std::string s);
+		void append_str(std::string_view s);
+		void append_hex(std::span<const u8> data);
+		/**
+		 * @brief `S`, `W` or `X` followed by the signal / exit status, as sent for `?` and once the target stops after `c` / `s`.
+		 */
+		void append_stop_reply(stop_reason reason);
+
+		/**
+		 * @brief Encodes `args` into `resp_buf`, with space for all of them reserved at once, see `encode_buffer()`.
+		 */
+		template<SizedEncoding ...TCoders>
+		void encode_response(const extract_arg<TCoders>&... args)
+		{
+			encode_buffer<TCoders...>(this->resp_buf, args...);
+		}
 
 	#pragma mark Packet Handling
-		std::unordered_map<packet_type, std::function<void()>> packet_handlers;
+		/**
+		 * @brief Indexed by the packet's identifier, the handlers are bound in the constructor.
+		 */
+		std::array<std::optional<function_ref<void(connection*)>>, 256> packet_handlers {};
+
+		/**
+		 * @brief Decodes the current packet with `TCoders` and calls `Fn` with the result.
+		 * `Fn` is a template argument, so that this can be referenced by a `function_ref` without anything to store.
+		 */
+		template<auto Fn, Coding ...TCoders>
+			requires Callback<decltype(Fn), connection*, extract_arg<TCoders>...>
+		static void decode_and_call(connection* self)
+		{
+			decode_buffer<TCoders...>(*self->packet_buf, [self](extract_arg<TCoders>... args) { std::invoke(Fn, self, std::move(args)...); });
+		}
 
-		template<Coding ...TCoders, Callback<connection*, extract_arg<TCoders>...> TCallback>
-		void bind_handler(packet_type type, TCallback callback)
+		/**
+		 * @brief Same as `decode_and_call()`, but with the arguments described by a format string (see `packet_format.h`).
+		 */
+		template<fixed_string Fmt, auto Fn>
+			requires FormatCallback<decltype(Fn), Fmt, connection*>
+		static void parse_and_call(connection* self)
 		{
-			auto fn = [=]{
-				decode_buffer<TCoders...>(this->packet_buf, [this, callback](extract_arg<TCoders>... args) { std::apply(callback, std::tuple{this, args...}); });
-			};
-			packet_handlers[type] = fn;
+			parse_packet<Fmt>(*self->packet_buf, [self](auto&&... args) { std::invoke(Fn, self, std::forward<decltype(args)>(args)...); });
 		}
 
+		/**
+		 * @brief Calls `Fn` with the packet decoded by `TCoders`, e.g. `bind_handler<&connection::handle_supported, ArrayCoder<FeatureCoder>>(...)`.
+		 */
+		template<auto Fn, Coding ...TCoders>
+			requires Callback<decltype(Fn), connection*, extract_arg<TCoders>...>
+		void bind_handler(packet_type type)
+		{
+			packet_handlers[static_cast<u8>(type)] = function_ref<void(connection*)>(nontype<&connection::decode_and_call<Fn, TCoders...>>);
+		}
+
+		/**
+		 * @brief Same as above, but with the arguments described by a format string, e.g. `bind_handler<"%x,%x", &connection::handle_read_mem>(read_mem)`.
+		 */
+		template<fixed_string Fmt, auto Fn>
+			requires FormatCallback<decltype(Fn), Fmt, connection*>
+		void bind_handler(packet_type type)
+		{
+			packet_handlers[static_cast<u8>(type)] = function_ref<void(connection*)>(nontype<&connection::parse_and_call<Fmt, Fn>>);
+		}
+
+		/**
+		 * @brief The target, for packets that cannot be served without one.
+		 * @throws gdb_error if we do not have a debugger.
+		 */
+		auto target() -> Debugger&;
+		/**
+		 * @brief The target's registers, see `regs`.
+		 * @throws gdb_error if we do not have a debugger.
+		 */
+		auto registers() -> register_cache&;
+		/**
+		 * @brief All of `scratch_buf`, to read raw target data into.
+		 */
+		auto scratch() -> std::span<u8>;
+		/**
+		 * @brief Hex decode `hex` into `scratch_buf`, for register writes.
+		 * @throws gdb_error if it is not valid hex or too large.
+		 */
+		auto decode_to_scratch(std::string_view hex) -> std::span<const u8>;
+
+		/**
+		 * @brief Resumes the target and waits until it stops again, then replies with why.
+		 */
+		auto resume_target(resume_mode mode) -> asio::awaitable<void>;
+
 		void handle_query(query_type type = get_val);
+		void handle_stop_reason();
+		/**
+		 * @brief `D`, remove our breakpoints and let the target run on its own. The connection stops once the `OK` is sent.
+		 */
+		void handle_detach();
+		void handle_read_registers();
+		void handle_write_registers(std::string_view hex);
+		void handle_read_register(size_t idx);
+		void handle_write_register(size_t idx, std::string_view hex);
+		/**
+		 * @brief `Z` / `z`, only execution breakpoints (types 0 and 1). For watchpoints, we reply empty, i.e. not supported.
+		 * Conditions (`;X len,bytecode...`) are compiled here and evaluated by the target, see `ax::expression`.
+		 */
+		void handle_add_breakpoint(size_t type, size_t address, size_t kind, std::optional<std::string_view> conds);
+		void handle_remove_breakpoint(size_t type, size_t address, size_t kind);
+		/**
+		 * @brief Remove all of `own_breakpoints` from the target, e.g. on detach.
+		 */
+		void remove_own_breakpoints();
+		/**
+		 * @brief Compile the `X len,bytecode` conditions of a `Z` packet, separated by `;`.
+		 * @throws gdb_error if one is malformed or cannot be compiled.
+		 */
+		auto parse_conditions(std::string_view conds) -> std::vector<ax::expression>;
 		void handle_read_mem(size_t address, size_t len);
-		void handle_write_mem(size_t address, size_t len, std::vector<u8> data);
+		void handle_write_mem(size_t address, size_t len, payload_bytes data);
+		void handle_read_mem_bin(size_t address, size_t len);
+		void handle_write_mem_bin(size_t address, size_t len, std::span<const u8> data);
 
-		void handle_file_reply(int64_t retcode, std::optional<size_t> errorno, std::optional<std::string> ctrlc, std::optional<std::string> attachement);
+		void handle_file_reply(int64_t retcode, std::optional<size_t> errorno, std::optional<std::string_view> ctrlc, std::optional<std::string_view> attachement);
 
 	#pragma mark Query Handling
-		std::unordered_map<std::string, query_handler> query_handlers;
+		/**
+		 * @brief All queries we understand, built at compile time, see `query_table`.
+		 */
+		static auto queries() -> const query_table<connection>&;
 		std::vector<feature> remote_features;
 		std::vector<feature> our_features;
 
-		struct query_handler_builder
-		{
-			connection* conn;
-			query_handler& handler;
-
-			template<Coding ...TCoders, Callback<connection*, extract_arg<TCoders>...> TCallback>
-			void bind_get_query(TCallback callback)
-			{
-				auto conn = this->conn;
-				auto fn = [=]{
-					decode_buffer<TCoders...>(conn->packet_buf, [conn, callback](extract_arg<TCoders>... args) { std::apply(callback, std::tuple{conn, args...}); });
-				};
-				handler.get_handler = fn;
-			}
-
-			template<Coding ...TCoders, Callback<connection*, extract_arg<TCoders>...> TCallback>
-			void bind_set_query(TCallback callback)
-			{
-				auto conn = this->conn;
-				auto fn = [=]{
-					decode_buffer<TCoders...>(conn->packet_buf, [conn, callback](extract_arg<TCoders>... args) { std::apply(callback, std::tuple{conn, args...}); });
-				};
-				handler.set_handler = fn;
-			}
-		};
-
-		auto add_query(std::string name, char separator = ':', bool advertise = false) -> query_handler_builder
-		{
-			query_handlers[name] = query_handler { .name = name, .separator = separator, .advertise = advertise };
-			return query_handler_builder { this, query_handlers[name] };
-		}
-
 		void handle_supported(std::vector<feature> features);
+		void handle_start_no_ack();
+		/**
+		 * @brief `qSearch:memory`, so gdb's `find` does not have to read the whole range.
+		 */
+		void handle_search_memory(size_t address, size_t len, std::span<const u8> pattern);
+		/**
+		 * @brief `qCRC`, so `compare-sections` does not have to download the whole section.
+		 */
+		void handle_crc(size_t address, size_t len);
+
+		[[nodiscard]] auto has_target() const -> bool;
+		[[nodiscard]] auto has_memory_map() const -> bool;
+		/**
+		 * @brief `qXfer:features:read`, the target description so gdb knows the architecture and registers.
+		 */
+		void handle_xfer_features(std::string_view annex, size_t offset, size_t len);
+		/**
+		 * @brief `qXfer:memory-map:read`, so gdb knows which memory it can access at all.
+		 */
+		void handle_xfer_memory_map(std::string_view annex, size_t offset, size_t len);
+		/**
+		 * @brief Reply to a `qXfer` read of `doc`: `m` or `l` (for the last one) followed by up to `len` bytes from `offset`.
+		 */
+		void append_xfer(std::string_view doc, size_t offset, size_t len);
 
 	#pragma mark Remote IO
 		struct remote_io_reply
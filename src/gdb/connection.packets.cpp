@@ -1,71 +1,349 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <memory>
 #include <stdexcept>
 #include <utility>
 #include <fmt/core.h>
 #include "connection.h"
 #include "easter_eggs.h"
 #include "gdb/gdb_err.h"
+#include "gdb/crc32.h"
+#include "gdb/hex_codec.h"
+#include "gdb/mem_search.h"
 
 namespace tasarch::gdb {
+    namespace {
+        /**
+         * @brief Read target memory, except for our own scratch space used by remote io (see `internal_mem`).
+         * @return How many bytes could be read.
+         */
+        auto read_target(Debugger* debugger, size_t address, std::span<u8> dst) -> size_t
+        {
+            if (internal_mem::has_addr(address)) {
+                auto data = internal_mem::view_data(address, dst.size());
+                std::copy(data.begin(), data.end(), dst.begin());
+                return data.size();
+            }
+            if (debugger == nullptr) {
+                return 0;
+            }
+            return debugger->read_memory(address, dst);
+        }
+
+        /**
+         * @brief Counterpart of `read_target()`.
+         */
+        auto write_target(Debugger* debugger, size_t address, std::span<const u8> src) -> size_t
+        {
+            if (internal_mem::has_addr(address)) {
+                size_t len = internal_mem::view_data(address, src.size()).size();
+                internal_mem::write_data(address, src.first(len));
+                return len;
+            }
+            if (debugger == nullptr) {
+                return 0;
+            }
+            return debugger->write_memory(address, src);
+        }
+
+        /**
+         * @brief Streams a memory read that does not fit into `resp_buf`, either hex encoded (`m`) or binary (`x`).
+         * Every chunk is read into `scratch` first, it stops early at the first inaccessible byte.
+         */
+        class memory_source : public packet_source
+        {
+        public:
+            memory_source(Debugger* debugger, std::span<u8> scratch, size_t address, size_t len, bool binary) : debugger(debugger), scratch(scratch), address(address), len(len), binary(binary) {}
+
+            void rewind() override
+            {
+                this->offset = 0;
+            }
+
+            auto next(buffer& chunk) -> bool override
+            {
+                if (this->offset == 0 && this->binary) {
+                    chunk.put_byte('b');
+                }
+                size_t room = std::min(this->binary ? chunk.write_size() : chunk.write_size() / 2, this->scratch.size());
+                size_t want = std::min(this->len - this->offset, room);
+                size_t done = read_target(this->debugger, this->address + this->offset, this->scratch.first(want));
+                auto data = this->scratch.first(done);
+                if (this->binary) {
+                    BinaryCoder::encode_to(data, chunk);
+                } else {
+                    chunk.write_require(2 * data.size());
+                    codec::hex_encode(data.data(), data.size(), chunk.write_data());
+                    chunk.put_count(2 * data.size());
+                }
+                this->offset += done;
+                return done == want && this->offset < this->len;
+            }
+
+        private:
+            Debugger* debugger;
+            std::span<u8> scratch;
+            size_t address;
+            size_t len;
+            size_t offset = 0;
+            bool binary;
+        };
+    } // namespace
+
+    auto connection::target() -> Debugger&
+    {
+        if (!this->debugger) {
+            throw gdb_error(unknown, "no target to debug");
+        }
+        return *this->debugger;
+    }
+
+    auto connection::registers() -> register_cache&
+    {
+        if (!this->regs.has_value()) {
+            throw gdb_error(unknown, "no target to debug");
+        }
+        return this->regs.value();
+    }
+
+    auto connection::scratch() -> std::span<u8>
+    {
+        this->scratch_buf.reset();
+        return {this->scratch_buf.write_data(), this->scratch_buf.write_size()};
+    }
+
+    auto connection::decode_to_scratch(std::string_view hex) -> std::span<const u8>
+    {
+        auto dst = this->scratch();
+        if (hex.size() % 2 != 0) {
+            throw gdb_error(invalid_hex, fmt::format("odd number of hex digits: {}", hex.size()));
+        }
+        if (hex.size() / 2 > dst.size()) {
+            throw gdb_error(buf_too_small, fmt::format("0x{:x} bytes do not fit into 0x{:x}", hex.size() / 2, dst.size()));
+        }
+        if (codec::hex_decode(reinterpret_cast<const u8*>(hex.data()), hex.size(), dst.data()) != hex.size()) {
+            throw gdb_error(invalid_hex, "invalid hex digit");
+        }
+        return dst.first(hex.size() / 2);
+    }
+
     void connection::handle_read_mem(size_t address, size_t len)
     {
         logger->info("reading memory from 0x{:x}", address);
-        if (internal_mem::has_addr(address)) {
-            auto data = internal_mem::read_data(address, len);
-            std::string s(reinterpret_cast<char*>(data.data()), data.size());
-            this->append_hex(s);
-        } else {
-            this->append_hex("a");
+        // gdb never asks for more than our PacketSize allows (unless told otherwise), anything larger than resp_buf is streamed.
+        auto dst = this->scratch();
+        if (2 * len > this->resp_buf.write_size()) {
+            if (len > 0 && read_target(this->debugger.get(), address, dst.first(1)) == 0) {
+                throw gdb_error(unknown, fmt::format("cannot read memory at 0x{:x}", address));
+            }
+            this->resp_stream = std::make_unique<memory_source>(this->debugger.get(), dst, address, len, false);
+            return;
         }
+        size_t done = read_target(this->debugger.get(), address, dst.first(len));
+        if (len > 0 && done == 0) {
+            throw gdb_error(unknown, fmt::format("cannot read memory at 0x{:x}", address));
+        }
+        this->append_hex(dst.first(done));
     }
 
-    void connection::handle_write_mem(size_t address, size_t len, std::vector<u8> data)
+    void connection::handle_write_mem(size_t address, size_t len, payload_bytes data)
     {
         logger->info("writing memory to 0x{:x}", address);
-        if (internal_mem::has_addr(address)) {
-            internal_mem::write_data(address, len, data);
-        } else {
+        if (data.size() != len) {
+            throw gdb_error(unknown, fmt::format("expected 0x{:x} bytes, got 0x{:x}", len, data.size()));
+        }
+        std::span<const u8> src(data.data(), data.size());
+        if (write_target(this->debugger.get(), address, src) != len) {
+            throw gdb_error(unknown, fmt::format("cannot write memory at 0x{:x}", address));
         }
         this->append_ok();
     }
 
-    void connection::handle_query(query_type type)
+    void connection::handle_read_mem_bin(size_t address, size_t len)
     {
-        std::string name;
-        auto it = query_handlers.end();
-        bool did_find = false;
-        u8 curr = 0;
-        while (packet_buf.read_size() > 0) {
-            if (it != query_handlers.end() && it->second.separator == '\0') {
-                did_find = true;
-                break;
+        logger->info("reading binary memory from 0x{:x}", address);
+        auto dst = this->scratch();
+        if (1 + len > this->resp_buf.write_size()) {
+            if (len > 0 && read_target(this->debugger.get(), address, dst.first(1)) == 0) {
+                throw gdb_error(unknown, fmt::format("cannot read memory at 0x{:x}", address));
+            }
+            this->resp_stream = std::make_unique<memory_source>(this->debugger.get(), dst, address, len, true);
+            return;
+        }
+        size_t done = read_target(this->debugger.get(), address, dst.first(len));
+        if (len > 0 && done == 0) {
+            throw gdb_error(unknown, fmt::format("cannot read memory at 0x{:x}", address));
+        }
+        encode_response<coders::Id<std::string_view>, coders::Binary>("b", std::span<const u8>(dst.first(done)));
+    }
+
+    void connection::handle_write_mem_bin(size_t address, size_t len, std::span<const u8> data)
+    {
+        logger->info("writing binary memory to 0x{:x}", address);
+        if (data.size() != len) {
+            throw gdb_error(unknown, fmt::format("expected 0x{:x} bytes, got 0x{:x}", len, data.size()));
+        }
+        // len == 0 is how gdb probes for X support, so that has to succeed.
+        if (len > 0 && write_target(this->debugger.get(), address, data) != len) {
+            throw gdb_error(unknown, fmt::format("cannot write memory at 0x{:x}", address));
+        }
+        this->append_ok();
+    }
+
+    void connection::handle_stop_reason()
+    {
+        this->logger->trace("Queried stop reason");
+        this->append_stop_reply(this->debugger ? this->debugger->last_stop() : stop_reason{});
+    }
+
+    void connection::handle_detach()
+    {
+        this->logger->info("Remote detached");
+        if (this->debugger) {
+            this->remove_own_breakpoints();
+            this->registers().invalidate();
+            this->debugger->resume(resume_mode::cont, [](stop_reason) {});
+        }
+        this->append_ok();
+        this->stop();
+    }
+
+    void connection::handle_read_registers()
+    {
+        this->append_str(this->registers().hex());
+    }
+
+    void connection::handle_write_registers(std::string_view hex)
+    {
+        this->registers().write(this->decode_to_scratch(hex));
+        this->append_ok();
+    }
+
+    void connection::handle_read_register(size_t idx)
+    {
+        this->append_str(this->registers().hex(idx));
+    }
+
+    void connection::handle_write_register(size_t idx, std::string_view hex)
+    {
+        this->registers().write(idx, this->decode_to_scratch(hex));
+        this->append_ok();
+    }
+
+    namespace {
+        auto execution_breakpoint(size_t type) -> breakpoint_type
+        {
+            // Check before narrowing, otherwise e.g. type 256 would wrap around to a software breakpoint.
+            if (type > static_cast<size_t>(breakpoint_type::hardware)) {
+                throw unknown_request(fmt::format("breakpoint type {}", type));
             }
+            return static_cast<breakpoint_type>(type);
+        }
+    } // namespace
 
-            curr = packet_buf.get_byte();
-            
-            if (it != query_handlers.end() && it->second.separator == curr) {
-                did_find = true;
+    auto connection::parse_conditions(std::string_view conds) -> std::vector<ax::expression>
+    {
+        std::vector<ax::expression> ret;
+        while (!conds.empty()) {
+            // Commands to run on the target are not supported, gdb runs them itself once we stop.
+            if (conds.starts_with("cmds:")) {
                 break;
             }
+            size_t end = std::min(conds.find(';'), conds.size());
+            auto item = conds.substr(0, end);
+            conds.remove_prefix(std::min(end + 1, conds.size()));
 
-            name += curr;
-            it = query_handlers.find(name);
+            // X<len>,<bytecode as hex>
+            size_t comma = item.find(',');
+            size_t len = 0;
+            if (!item.starts_with('X') || comma == std::string_view::npos
+                || std::from_chars(item.data() + 1, item.data() + comma, len, 16).ptr != item.data() + comma
+                || item.size() - comma - 1 != 2 * len) {
+                throw gdb_error(malformed_packet, fmt::format("invalid breakpoint condition {}", item));
+            }
+            try {
+                ret.push_back(ax::expression::compile(this->decode_to_scratch(item.substr(comma + 1))));
+            } catch (const std::invalid_argument& e) {
+                throw gdb_error(malformed_packet, fmt::format("invalid breakpoint condition: {}", e.what()));
+            }
         }
+        return ret;
+    }
 
-        if (did_find) {
-            if (type == get_val) {
-                if (it->second.get_handler.has_value()) {
-                    it->second.get_handler.value()();
-                    return;
-                }
-                throw std::runtime_error(fmt::format("query {} is not gettable!", name));
-            }
-            if (it->second.set_handler.has_value()) {
-                it->second.set_handler.value()();
+    void connection::handle_add_breakpoint(size_t type, size_t address, size_t kind, std::optional<std::string_view> conds)
+    {
+        auto bp_type = execution_breakpoint(type);
+        auto conditions = conds.has_value() ? this->parse_conditions(conds.value()) : std::vector<ax::expression>{};
+        logger->debug("adding breakpoint at 0x{:x} with {} conditions", address, conditions.size());
+        this->target().breakpoints().add(bp_type, address, kind, std::move(conditions));
+        auto key = std::make_pair(bp_type, address);
+        if (std::find(this->own_breakpoints.begin(), this->own_breakpoints.end(), key) == this->own_breakpoints.end()) {
+            this->own_breakpoints.push_back(key);
+        }
+        this->append_ok();
+    }
+
+    void connection::handle_remove_breakpoint(size_t type, size_t address, size_t /*kind*/)
+    {
+        auto bp_type = execution_breakpoint(type);
+        logger->debug("removing breakpoint at 0x{:x}", address);
+        std::erase(this->own_breakpoints, std::make_pair(bp_type, address));
+        if (!this->target().breakpoints().remove(bp_type, address)) {
+            throw gdb_error(unknown, fmt::format("no breakpoint at 0x{:x}", address));
+        }
+        this->append_ok();
+    }
+
+    void connection::remove_own_breakpoints()
+    {
+        if (!this->debugger) {
+            return;
+        }
+        logger->debug("removing our {} breakpoints", this->own_breakpoints.size());
+        for (const auto& [type, address] : this->own_breakpoints) {
+            this->debugger->breakpoints().remove(type, address);
+        }
+        this->own_breakpoints.clear();
+    }
+
+    auto connection::queries() -> const query_table<connection>&
+    {
+        using entry = query_handler<connection>;
+        static constexpr auto entries = std::to_array<entry>({
+            entry { .name = "Supported", .get_handler = nontype<&connection::decode_and_call<&connection::handle_supported, ArrayCoder<FeatureCoder>>> },
+            entry { .name = "StartNoAckMode", .separator = '\0', .set_handler = nontype<&connection::decode_and_call<&connection::handle_start_no_ack>>, .advertise = true },
+            entry { .name = "CRC", .get_handler = nontype<&connection::parse_and_call<"%x,%x", &connection::handle_crc>> },
+            entry { .name = "Search:memory", .get_handler = nontype<&connection::parse_and_call<"%x;%x;%r", &connection::handle_search_memory>> },
+            entry { .name = "Xfer:features:read", .get_handler = nontype<&connection::parse_and_call<"%s:%x,%x", &connection::handle_xfer_features>>, .advertise = true, .available = nontype<&connection::has_target> },
+            entry { .name = "Xfer:memory-map:read", .get_handler = nontype<&connection::parse_and_call<"%s:%x,%x", &connection::handle_xfer_memory_map>>, .advertise = true, .available = nontype<&connection::has_memory_map> },
+        });
+        static constexpr auto nodes = build_query_trie<query_trie_size(entries)>(entries);
+        static constexpr auto table = make_query_table(entries, nodes);
+        return table;
+    }
+
+    void connection::handle_query(query_type type)
+    {
+        auto packet = packet_buf->read_view();
+        auto [handler, consumed] = queries().find(packet);
+        if (handler == nullptr) {
+            throw unknown_request(fmt::format("query {} not recognized!", packet.substr(0, packet.find(':'))));
+        }
+        packet_buf->get_count(consumed);
+
+        if (type == get_val) {
+            if (handler->get_handler.has_value()) {
+                (*handler->get_handler)(this);
                 return;
             }
-            throw std::runtime_error(fmt::format("query {} is not settable", name));
+            throw std::runtime_error(fmt::format("query {} is not gettable!", handler->name));
         }
-        throw unknown_request(fmt::format("query {} not recognized!", name));
+        if (handler->set_handler.has_value()) {
+            (*handler->set_handler)(this);
+            return;
+        }
+        throw std::runtime_error(fmt::format("query {} is not settable", handler->name));
     }
 
     void connection::handle_supported(std::vector<feature> features)
@@ -80,23 +358,120 @@ namespace tasarch::gdb {
 
         std::vector<feature> response = this->our_features;
 
-        for (auto& pair : query_handlers) {
-            if (pair.second.advertise) {
+        for (const auto& query : queries().all()) {
+            if (query.advertise && (!query.available.has_value() || (*query.available)(this))) {
                 std::string feat_name;
-                if (pair.second.type() == get_val) {
+                if (query.type() == get_val) {
                     feat_name += "q";
                 } else {
                     feat_name += "Q";
                 }
-                feat_name += pair.second.name;
-                feat_name += "+";
+                feat_name += query.name;
+                response.emplace_back(feat_name, true);
             }
         }
 
-        ArrayCoder<FeatureCoder>::encode_to(response, this->resp_buf);
+        encode_response<ArrayCoder<FeatureCoder>>(response);
     }
 
-    void connection::handle_file_reply(int64_t retcode, std::optional<size_t> errorno, std::optional<std::string> ctrlc, std::optional<std::string> attachement)
+    void connection::handle_start_no_ack()
+    {
+        logger->debug("Remote requested no-ack mode");
+        this->pending_no_ack = true;
+        this->append_ok();
+    }
+
+    void connection::handle_search_memory(size_t address, size_t len, std::span<const u8> pattern)
+    {
+        logger->debug("searching 0x{:x} bytes from 0x{:x} for {} byte pattern", len, address, pattern.size());
+        auto window = this->scratch();
+        if (pattern.empty() || pattern.size() > window.size() / 2) {
+            throw gdb_error(buf_too_small, fmt::format("cannot search for a {} byte pattern", pattern.size()));
+        }
+        // Searched one window at a time, the last `pattern.size() - 1` bytes are kept for matches crossing windows.
+        size_t offset = 0;
+        size_t kept = 0;
+        while (offset < len) {
+            size_t want = std::min(window.size() - kept, len - offset);
+            size_t done = read_target(this->debugger.get(), address + offset, window.subspan(kept, want));
+            if (offset == 0 && done == 0) {
+                throw gdb_error(unknown, fmt::format("cannot search memory at 0x{:x}", address));
+            }
+            auto found = search::find(window.first(kept + done), pattern);
+            if (found.has_value()) {
+                encode_response<coders::Id<std::string_view>, HexNumCoder<>>("1,", address + offset - kept + found.value());
+                return;
+            }
+            offset += done;
+            if (done < want) {
+                break;
+            }
+            size_t keep = std::min(pattern.size() - 1, kept + done);
+            std::copy(window.begin() + static_cast<ptrdiff_t>(kept + done - keep), window.begin() + static_cast<ptrdiff_t>(kept + done), window.begin());
+            kept = keep;
+        }
+        this->append_str("0");
+    }
+
+    void connection::handle_crc(size_t address, size_t len)
+    {
+        logger->debug("calculating crc of 0x{:x} bytes at 0x{:x}", len, address);
+        auto window = this->scratch();
+        u32 crc = crc::initial;
+        for (size_t offset = 0; offset < len;) {
+            size_t want = std::min(window.size(), len - offset);
+            size_t done = read_target(this->debugger.get(), address + offset, window.first(want));
+            if (done != want) {
+                // a crc over less than asked for would just look like a mismatch.
+                throw gdb_error(unknown, fmt::format("cannot read 0x{:x} bytes at 0x{:x}", len, address));
+            }
+            crc = crc::crc32(window.first(done), crc);
+            offset += done;
+        }
+        encode_response<coders::Id<std::string_view>, HexNumCoder<u32>>("C", crc);
+    }
+
+    auto connection::has_target() const -> bool
+    {
+        return this->debugger != nullptr;
+    }
+
+    auto connection::has_memory_map() const -> bool
+    {
+        return this->debugger != nullptr && !this->debugger->memory_map().empty();
+    }
+
+    void connection::handle_xfer_features(std::string_view annex, size_t offset, size_t len)
+    {
+        logger->debug("reading target description {} at 0x{:x}", annex, offset);
+        if (annex != "target.xml") {
+            throw gdb_error(unknown, fmt::format("no target description {}", annex));
+        }
+        this->append_xfer(this->target().target_xml(), offset, len);
+    }
+
+    void connection::handle_xfer_memory_map(std::string_view annex, size_t offset, size_t len)
+    {
+        logger->debug("reading memory map at 0x{:x}", offset);
+        if (!annex.empty()) {
+            throw gdb_error(unknown, fmt::format("unexpected annex {} for memory map", annex));
+        }
+        this->append_xfer(this->target().memory_map_xml(), offset, len);
+    }
+
+    void connection::append_xfer(std::string_view doc, size_t offset, size_t len)
+    {
+        if (offset > doc.size()) {
+            throw gdb_error(unknown, fmt::format("offset 0x{:x} is past the end (0x{:x})", offset, doc.size()));
+        }
+        // The document is served as is, escaping (if needed at all) happens while sending.
+        len = std::min(len, this->resp_buf.write_size() - 1);
+        auto chunk = doc.substr(offset, len);
+        this->append_str(offset + chunk.size() < doc.size() ? "m" : "l");
+        this->append_str(chunk);
+    }
+
+    void connection::handle_file_reply(int64_t retcode, std::optional<size_t> errorno, std::optional<std::string_view> ctrlc, std::optional<std::string_view> attachement)
     {
         if (!this->io_resp.empty()) {
             auto resume = std::move(this->io_resp.front());
@@ -105,7 +480,11 @@ namespace tasarch::gdb {
             if (ctrlc.has_value() && ctrlc.value() == "C") {
                 did_break = true;
             }
-            resume(remote_io_reply{retcode, errorno, did_break, std::move(attachement)});
+            std::optional<std::string> attachement_str = std::nullopt;
+            if (attachement.has_value()) {
+                attachement_str = std::string(attachement.value());
+            }
+            resume(remote_io_reply{retcode, errorno, did_break, std::move(attachement_str)});
             this->wakeup_request();
         } else {
             throw std::runtime_error("Got file reply, but no one waiting on it! What??");
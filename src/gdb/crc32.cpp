@@ -0,0 +1,135 @@
+#include <array>
+#include "crc32.h"
+
+#if TASARCH_X86
+#include <immintrin.h>
+#endif
+
+namespace tasarch::gdb::crc {
+    namespace {
+        constexpr u32 polynomial = 0x04c11db7;
+
+        /**
+         * @brief `tables[k][b]` is the CRC of byte `b` followed by `k` zero bytes, so 8 bytes can be processed with one lookup each.
+         */
+        constexpr auto tables = []{
+            std::array<std::array<u32, 256>, 8> ret {};
+            for (u32 b = 0; b < 256; b++) {
+                u32 crc = b << 24;
+                for (int bit = 0; bit < 8; bit++) {
+                    crc = (crc & 0x80000000) != 0 ? (crc << 1) ^ polynomial : crc << 1;
+                }
+                ret[0][b] = crc;
+            }
+            for (size_t k = 1; k < ret.size(); k++) {
+                for (size_t b = 0; b < 256; b++) {
+                    u32 prev = ret[k - 1][b];
+                    ret[k][b] = (prev << 8) ^ ret[0][prev >> 24];
+                }
+            }
+            return ret;
+        }();
+
+        auto crc32_slicing(const u8* src, size_t len, u32 crc) -> u32
+        {
+            size_t i = 0;
+            for (; i + 8 <= len; i += 8) {
+                crc ^= (static_cast<u32>(src[i]) << 24) | (static_cast<u32>(src[i + 1]) << 16) | (static_cast<u32>(src[i + 2]) << 8) | src[i + 3];
+                crc = tables[7][crc >> 24] ^ tables[6][(crc >> 16) & 0xff] ^ tables[5][(crc >> 8) & 0xff] ^ tables[4][crc & 0xff]
+                    ^ tables[3][src[i + 4]] ^ tables[2][src[i + 5]] ^ tables[1][src[i + 6]] ^ tables[0][src[i + 7]];
+            }
+            for (; i < len; i++) {
+                crc = (crc << 8) ^ tables[0][(crc >> 24) ^ src[i]];
+            }
+            return crc;
+        }
+
+#if TASARCH_X86
+        /**
+         * @brief `x^n mod P`, the constants for folding.
+         */
+        constexpr auto xpow_mod(size_t n) -> u64
+        {
+            u64 ret = 1;
+            for (size_t i = 0; i < n; i++) {
+                ret <<= 1;
+                if ((ret & (u64{1} << 32)) != 0) {
+                    ret ^= (u64{1} << 32) | polynomial;
+                }
+            }
+            return ret;
+        }
+
+        /*
+         * The data is seen as one big polynomial (first byte = highest coefficients), which only matters modulo P.
+         * The accumulator holds 128 bits of it, byte swapped so bit i is the coefficient of x^i.
+         * Appending the next 16 bytes means multiplying the accumulator by x^128, which (modulo P) is the same as
+         * multiplying its high half by x^192 mod P and its low half by x^128 mod P, each fitting in 96 bits again.
+         * Whatever remains in the end is then reduced by the table based code, which also handles the tail.
+         */
+        TARGET_SIMD("ssse3,pclmul")
+        auto crc32_clmul(const u8* src, size_t len, u32 crc) -> u32
+        {
+            constexpr size_t width = 16;
+            if (len < 2 * width) {
+                return crc32_slicing(src, len, crc);
+            }
+            const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+            const __m128i fold = _mm_set_epi64x(static_cast<long long>(xpow_mod(192)), static_cast<long long>(xpow_mod(128)));
+
+            // The current crc is xored into the first 32 bits of the data, same as with the tables.
+            __m128i acc = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), bswap);
+            acc = _mm_xor_si128(acc, _mm_set_epi32(static_cast<int>(crc), 0, 0, 0));
+
+            size_t i = width;
+            for (; i + width <= len; i += width) {
+                __m128i hi = _mm_clmulepi64_si128(acc, fold, 0x11);
+                __m128i lo = _mm_clmulepi64_si128(acc, fold, 0x00);
+                __m128i next = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), bswap);
+                acc = _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+            }
+
+            std::array<u8, width> rest {};
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rest.data()), _mm_shuffle_epi8(acc, bswap));
+            crc = crc32_slicing(rest.data(), rest.size(), 0);
+            return crc32_slicing(src + i, len - i, crc);
+        }
+
+        auto clmul_supported() -> bool
+        {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+        }
+#endif
+
+        using crc_fn = u32 (*)(const u8*, size_t, u32);
+
+        auto crc_kernel(simd_level level) -> crc_fn
+        {
+            cpu::require_supported(level);
+            switch (level) {
+#if TASARCH_X86
+            case simd_level::avx2:
+            case simd_level::ssse3:
+                if (clmul_supported()) {
+                    return &crc32_clmul;
+                }
+                return &crc32_slicing;
+#endif
+            default:
+                return &crc32_slicing;
+            }
+        }
+    } // namespace
+
+    auto crc32(std::span<const u8> data, u32 crc) -> u32
+    {
+        static const crc_fn kernel = crc_kernel(cpu::best_simd_level());
+        return kernel(data.data(), data.size(), crc);
+    }
+
+    auto crc32(std::span<const u8> data, u32 crc, simd_level level) -> u32
+    {
+        return crc_kernel(level)(data.data(), data.size(), crc);
+    }
+} // namespace tasarch::gdb::crc
@@ -0,0 +1,40 @@
+/**
+ * @file crc32.h
+ * @brief The CRC-32 gdb uses to verify memory (`qCRC`, e.g. for `compare-sections`).
+ *
+ * That is the CRC with polynomial `0x04c11db7`, processed msb first, starting from `0xffffffff` and without a final xor (also known as CRC-32/MPEG-2).
+ * Checksumming a whole memory image has to be fast, so the scalar version uses slicing-by-8 and, where available, carry-less multiplication (`pclmulqdq`) folds 16 bytes at a time.
+ */
+#ifndef __GDB_CRC32_H
+#define __GDB_CRC32_H
+
+#include <span>
+#include "util/cpu_features.h"
+#include "util/defines.h"
+
+namespace tasarch::gdb::crc {
+    using cpu::simd_level;
+
+    /**
+     * @brief What gdb starts the CRC with.
+     */
+    static constexpr u32 initial = 0xffffffff;
+
+    /**
+     * @brief Continue the CRC `crc` with `data`, i.e. `crc32(a + b) == crc32(b, crc32(a))`.
+     *
+     * @param data
+     * @param crc
+     * @return u32
+     */
+    auto crc32(std::span<const u8> data, u32 crc = initial) -> u32;
+
+    /**
+     * @brief Same as `crc32()`, but forces a specific kernel. Mostly useful for testing and benchmarking.
+     * From `ssse3` on, the carry-less multiplication kernel is used if the cpu supports it.
+     * @throws std::invalid_argument if the given level is not supported by the current cpu.
+     */
+    auto crc32(std::span<const u8> data, u32 crc, simd_level level) -> u32;
+} // namespace tasarch::gdb::crc
+
+#endif /* __GDB_CRC32_H */
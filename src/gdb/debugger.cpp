@@ -1,5 +1,76 @@
-#include "debugger.h"  
-	
+#include <algorithm>
+#include <array>
+#include <fmt/core.h>
+#include "debugger.h"
+#include "easter_eggs.h"
+
 namespace tasarch::gdb {
+	namespace {
+		auto region_type(memory_region::kind type) -> std::string_view
+		{
+			switch (type) {
+			case memory_region::kind::rom:
+				return "rom";
+			case memory_region::kind::flash:
+				return "flash";
+			case memory_region::kind::ram:
+			default:
+				return "ram";
+			}
+		}
+	} // namespace
+
+	auto Debugger::register_value(size_t idx) -> std::optional<u64>
+	{
+		auto regs = this->registers();
+		std::array<u8, 64> bytes {};
+		if (idx >= regs.size() || regs[idx].size() > bytes.size()) {
+			return std::nullopt;
+		}
+		size_t size = regs[idx].size();
+		this->read_register(idx, std::span<u8>(bytes).first(size));
+		u64 value = 0;
+		size_t used = std::min<size_t>(size, sizeof(value));
+		for (size_t i = 0; i < used; i++) {
+			// the low bytes come first in little endian, last in big endian.
+			value |= static_cast<u64>(bytes[this->big_endian() ? size - 1 - i : i]) << (8 * i);
+		}
+		return value;
+	}
+
+	auto Debugger::target_xml() -> std::string_view
+	{
+		std::call_once(this->target_xml_once, [this] {
+			auto& doc = this->target_xml_doc;
+			doc = "<?xml version=\"1.0\"?>\n<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n<target version=\"1.0\">\n";
+			if (!this->architecture().empty()) {
+				doc += fmt::format("<architecture>{}</architecture>\n", this->architecture());
+			}
+			doc += fmt::format("<feature name=\"{}\">\n", this->feature_name());
+			for (const auto& reg : this->registers()) {
+				doc += fmt::format("<reg name=\"{}\" bitsize=\"{}\" type=\"{}\" group=\"{}\"/>\n", reg.name, reg.bitsize, reg.type, reg.group);
+			}
+			doc += "</feature>\n</target>\n";
+		});
+		return this->target_xml_doc;
+	}
 
-} // namespace tasarch::gdb
\ No newline at end of file
+	auto Debugger::memory_map_xml() -> std::string_view
+	{
+		std::call_once(this->memory_map_once, [this] {
+			auto& doc = this->memory_map_doc;
+			doc = "<?xml version=\"1.0\"?>\n<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" \"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n<memory-map>\n";
+			for (const auto& region : this->memory_map()) {
+				if (region.type == memory_region::kind::flash) {
+					doc += fmt::format("<memory type=\"flash\" start=\"0x{:x}\" length=\"0x{:x}\"><property name=\"blocksize\">0x{:x}</property></memory>\n", region.start, region.length, region.block_size);
+				} else {
+					doc += fmt::format("<memory type=\"{}\" start=\"0x{:x}\" length=\"0x{:x}\"/>\n", region_type(region.type), region.start, region.length);
+				}
+			}
+			// gdb refuses accesses outside the map, but remote io hands it pointers into our scratch space.
+			doc += fmt::format("<memory type=\"ram\" start=\"0x{:x}\" length=\"0x{:x}\"/>\n", internal_mem::start(), internal_mem::region_length);
+			doc += "</memory-map>\n";
+		});
+		return this->memory_map_doc;
+	}
+} // namespace tasarch::gdb
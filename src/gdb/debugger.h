@@ -1,14 +1,303 @@
 #ifndef __DEBUGGER_H
 #define __DEBUGGER_H
 
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include "agent_expr.h"
+#include "breakpoints.h"
+#include "util/defines.h"
+
 namespace tasarch::gdb {
-	class Debugger  
+	/**
+	 * @brief Why the target stopped, as reported by `?` and after resuming.
+	 */
+	struct stop_reason
+	{
+		enum class kind : u8
+		{
+			/**
+			 * @brief Stopped with `signal`, e.g. `SIGTRAP` (5) after a step or `SIGINT` (2) after a break request.
+			 */
+			signal,
+			/**
+			 * @brief The target exited with status `signal`.
+			 */
+			exited,
+			/**
+			 * @brief The target was terminated by `signal`.
+			 */
+			terminated,
+		};
+
+		kind type = kind::signal;
+		u8 signal = sigtrap;
+
+		static constexpr u8 sigint = 2;
+		static constexpr u8 sigtrap = 5;
+	};
+
+	/**
+	 * @brief What the target should do when resumed.
+	 */
+	enum class resume_mode : u8
+	{
+		cont,
+		step,
+	};
+
+	/**
+	 * @brief Describes one register of the target, in the order gdb expects them in `g` / `G`.
+	 */
+	struct register_info
+	{
+		std::string_view name;
+		size_t bitsize;
+		/**
+		 * @brief gdb type of the register, e.g. `int`, `uint32`, `code_ptr` or `data_ptr`.
+		 * Must be one of gdb's predefined types, since the generated feature does not define any.
+		 */
+		std::string_view type = "int";
+		std::string_view group = "general";
+
+		[[nodiscard]] constexpr auto size() const -> size_t
+		{
+			return this->bitsize / 8;
+		}
+	};
+
+	/**
+	 * @brief A range of target memory, as reported to gdb by the memory map.
+	 */
+	struct memory_region
+	{
+		enum class kind : u8
+		{
+			ram,
+			rom,
+			/**
+			 * @brief Only writable with gdb's flash commands, erased in blocks of `block_size`.
+			 */
+			flash,
+		};
+
+		size_t start;
+		size_t length;
+		kind type = kind::ram;
+		size_t block_size = 0;
+	};
+
+	/**
+	 * @brief The target being debugged, i.e. what all packets are eventually served from.
+	 *
+	 * All accessors work on caller provided storage (usually a buffer of the connection), so serving a packet never has to allocate.
+	 * Memory and registers are always in target byte order, exactly as they are sent to gdb.
+	 * The target is only accessed from the connection's strand, except for `request_break()` (called as soon as the break arrives) and the stop handler (called by the target whenever it likes).
+	 * Breakpoint conditions are evaluated against the target itself, on whatever thread calls `breakpoints().hit()`.
+	 */
+	class Debugger : public ax::context
 	{
 	public:
+		/**
+		 * @brief Called exactly once, when the target stops after `resume()`.
+		 */
+		using stop_handler = std::function<void(stop_reason)>;
+
+		/**
+		 * @brief A single memory access of a batch, see `read_memory(std::span<memory_access>)`.
+		 */
+		struct memory_access
+		{
+			size_t address;
+			std::span<u8> data;
+			/**
+			 * @brief Set by the target: how many bytes (from the start) were actually accessible.
+			 */
+			size_t done = 0;
+		};
+
+		Debugger() = default;
+		Debugger(const Debugger&) = delete;
+		auto operator=(const Debugger&) -> Debugger& = delete;
+		Debugger(Debugger&&) = delete;
+		auto operator=(Debugger&&) -> Debugger& = delete;
+		~Debugger() override = default;
+
+	#pragma mark Memory
+
+		/**
+		 * @brief Read `dst.size()` bytes starting at `address`.
+		 *
+		 * @param address
+		 * @param dst
+		 * @return size_t How many bytes could be read, reading stops at the first inaccessible one.
+		 */
+		auto read_memory(size_t address, std::span<u8> dst) -> size_t override = 0;
+
+		/**
+		 * @brief Write `src` starting at `address`.
+		 *
+		 * @param address
+		 * @param src
+		 * @return size_t How many bytes could be written, writing stops at the first inaccessible one.
+		 */
+		virtual auto write_memory(size_t address, std::span<const u8> src) -> size_t = 0;
+
+		/**
+		 * @brief Several reads at once, e.g. for targets where every access has a fixed cost (locking the emulator, a syscall, ...).
+		 * By default, just does them one after another.
+		 */
+		virtual void read_memory(std::span<memory_access> accesses)
+		{
+			for (auto& access : accesses) {
+				access.done = this->read_memory(access.address, access.data);
+			}
+		}
+
+		/**
+		 * @brief Several writes at once, see `read_memory(std::span<memory_access>)`.
+		 */
+		virtual void write_memory(std::span<memory_access> accesses)
+		{
+			for (auto& access : accesses) {
+				access.done = this->write_memory(access.address, access.data);
+			}
+		}
+
+	#pragma mark Registers
+
+		/**
+		 * @brief All registers, in the order of the `g` packet (and the register numbers of `p` / `P`).
+		 */
+		[[nodiscard]] virtual auto registers() const -> std::span<const register_info> = 0;
+
+		/**
+		 * @brief Size of all registers together, i.e. what `read_registers()` needs.
+		 */
+		[[nodiscard]] auto register_block_size() const -> size_t
+		{
+			size_t total = 0;
+			for (const auto& reg : this->registers()) {
+				total += reg.size();
+			}
+			return total;
+		}
+
+		/**
+		 * @brief Read all registers into `dst`, one after another as described by `registers()`.
+		 * @warning `dst.size()` must be `register_block_size()`.
+		 */
+		virtual void read_registers(std::span<u8> dst) = 0;
+
+		/**
+		 * @brief Read register `idx` into `dst`, which is exactly as large as the register.
+		 */
+		virtual void read_register(size_t idx, std::span<u8> dst) = 0;
+
+		/**
+		 * @brief Set register `idx` to `src`, which is exactly as large as the register.
+		 */
+		virtual void write_register(size_t idx, std::span<const u8> src) = 0;
+
+		/**
+		 * @brief Set all registers, laid out like for `read_registers()`. By default, writes them one by one.
+		 */
+		virtual void write_registers(std::span<const u8> src)
+		{
+			size_t offset = 0;
+			auto regs = this->registers();
+			for (size_t i = 0; i < regs.size(); i++) {
+				this->write_register(i, src.subspan(offset, regs[i].size()));
+				offset += regs[i].size();
+			}
+		}
+
+		/**
+		 * @brief Register `idx` as a number (its low 64 bits), for agent expressions. By default, read with `read_register()`.
+		 */
+		auto register_value(size_t idx) -> std::optional<u64> override;
+
+	#pragma mark Breakpoints
+
+		/**
+		 * @brief Breakpoints set by gdb. The target has to check `breakpoints().contains(pc)` before executing every instruction and stop with `SIGTRAP` if it does.
+		 */
+		auto breakpoints() -> breakpoint_manager&
+		{
+			return this->bps;
+		}
+
+	#pragma mark Description
+
+		/**
+		 * @brief The BFD architecture name of the target, e.g. `i386:x86-64`. If empty, gdb has to guess.
+		 */
+		[[nodiscard]] virtual auto architecture() const -> std::string_view
+		{
+			return {};
+		}
+
+		/**
+		 * @brief Name of the target description feature holding `registers()`.
+		 * gdb knows some of them (e.g. `org.gnu.gdb.i386.core`), but only if the registers match its expectations exactly.
+		 */
+		[[nodiscard]] virtual auto feature_name() const -> std::string_view
+		{
+			return "org.gnu.gdb.tasarch.core";
+		}
+
+		/**
+		 * @brief All valid memory. If empty, no memory map is sent and gdb assumes everything might be accessible.
+		 */
+		[[nodiscard]] virtual auto memory_map() const -> std::span<const memory_region>
+		{
+			return {};
+		}
+
+		/**
+		 * @brief The target description (`qXfer:features:read:target.xml`), generated from the above on first use.
+		 */
+		auto target_xml() -> std::string_view;
+
+		/**
+		 * @brief The memory map (`qXfer:memory-map:read`), generated from `memory_map()` on first use.
+		 * Also contains the `internal_mem` scratch space used for remote io.
+		 */
+		auto memory_map_xml() -> std::string_view;
+
+	#pragma mark Execution
+
+		/**
+		 * @brief Why the target is currently stopped.
+		 */
+		[[nodiscard]] virtual auto last_stop() const -> stop_reason = 0;
+
+		/**
+		 * @brief Continue or single step the target. Once it stops again, `on_stop` is called (possibly on another thread, possibly before this returns).
+		 */
+		virtual void resume(resume_mode mode, stop_handler on_stop) = 0;
+
+		/**
+		 * @brief The remote wants the target to stop (e.g. Ctrl-C in gdb). Can be called from any thread, at any time.
+		 */
 		virtual void request_break()
 		{
-			
+
 		}
+
+	private:
+		breakpoint_manager bps;
+
+		/**
+		 * @brief The documents only depend on things fixed for the lifetime of the target, so they are generated once and shared by all connections.
+		 */
+		std::once_flag target_xml_once;
+		std::string target_xml_doc;
+		std::once_flag memory_map_once;
+		std::string memory_map_doc;
 	};
 } // namespace tasarch::gdb
 
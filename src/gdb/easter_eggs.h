@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <iterator>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -20,6 +21,11 @@ namespace tasarch::gdb {
     struct internal_mem
     {
         const static size_t address = 0x1337'1337'1337'0000;
+        /**
+         * @brief Size of the address window advertised to gdb in the memory map.
+         * The storage grows on demand, but the map is only sent once, so we claim a fixed window up front.
+         */
+        static constexpr size_t region_length = 0x1'0000'0000;
 
         static constexpr auto start() -> size_t
         {
@@ -58,6 +64,23 @@ namespace tasarch::gdb {
             return std::vector<u8>(storage.begin() + idx, storage.begin() + end_idx);
         }
 
+        /**
+         * @brief Like `read_data()`, but without copying. Only valid until the next `add_data()` / `add_str()`.
+         */
+        static auto view_data(size_t addr, size_t len) -> std::span<const u8>
+        {
+            size_t idx = get_idx(addr);
+            len = std::min(len, storage.size() - idx);
+            return std::span<const u8>(storage.data() + idx, len);
+        }
+
+        static auto write_data(size_t addr, std::span<const u8> data) -> void
+        {
+            size_t idx = get_idx(addr);
+            size_t max_len = std::min(data.size(), storage.size() - idx);
+            std::copy(data.begin(), data.begin() + max_len, storage.begin() + idx);
+        }
+
         static auto write_data(size_t addr, size_t len, std::vector<u8>& data) -> void
         {
             size_t idx = get_idx(addr);
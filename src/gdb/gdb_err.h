@@ -17,6 +17,10 @@ namespace tasarch::gdb {
         unknown = 1,
         // internal buffers used by gdbstub ran out of space!
         buf_too_small = 2,
+        // received hex data that was malformed (invalid digit or odd length)
+        invalid_hex = 3,
+        // packet did not match the format of its arguments
+        malformed_packet = 4,
 	};
 
     class gdb_error : public std::runtime_error
@@ -0,0 +1,265 @@
+#include <array>
+#include "hex_codec.h"
+
+#if TASARCH_X86
+#include <immintrin.h>
+#endif
+
+namespace tasarch::gdb::codec {
+    namespace {
+        constexpr const char* hex_digits = "0123456789abcdef";
+
+        /**
+         * @brief Value of every possible hex digit, `0xff` for anything that is not one.
+         */
+        constexpr std::array<u8, 256> hex_values = []{
+            std::array<u8, 256> ret {};
+            for (size_t c = 0; c < ret.size(); c++) {
+                if ('0' <= c && c <= '9') {
+                    ret[c] = static_cast<u8>(c - '0');
+                } else if ('a' <= c && c <= 'f') {
+                    ret[c] = static_cast<u8>(10 + c - 'a');
+                } else if ('A' <= c && c <= 'F') {
+                    ret[c] = static_cast<u8>(10 + c - 'A');
+                } else {
+                    ret[c] = 0xff;
+                }
+            }
+            return ret;
+        }();
+
+        void hex_encode_scalar(const u8* src, size_t len, u8* dst)
+        {
+            for (size_t i = 0; i < len; i++) {
+                dst[2*i] = hex_digits[src[i] >> 4];
+                dst[2*i + 1] = hex_digits[src[i] & 0xf];
+            }
+        }
+
+        auto hex_decode_scalar(const u8* src, size_t len, u8* dst) -> size_t
+        {
+            for (size_t i = 0; i + 1 < len; i += 2) {
+                u8 hi = hex_values[src[i]];
+                u8 lo = hex_values[src[i + 1]];
+                if (((hi | lo) & 0xf0) != 0) {
+                    return hi == 0xff ? i : i + 1;
+                }
+                dst[i / 2] = static_cast<u8>((hi << 4) | lo);
+            }
+            return len;
+        }
+
+#if TASARCH_X86
+        /*
+         * Encoding splits every byte of a block into its two nibbles, turns them into digits and interleaves them again (high nibble first).
+         * SSE2 has to do the digit conversion with a compare (`n + '0'`, plus `'a' - '0' - 10` if `n > 9`), from SSSE3 on it is a single pshufb into `hex_digits`.
+         *
+         * Decoding checks every character of a block for being a digit or (case insensitive) letter and calculates its value in the same go.
+         * If any of them is invalid, the scalar code takes over for the rest, finding the exact offset.
+         * Otherwise, pairs of nibbles are combined (`16 * hi + lo`) and packed to bytes.
+         */
+
+        TARGET_SIMD("sse2")
+        ALWAYS_INLINE auto hex_values_sse2(__m128i v, __m128i& valid) -> __m128i
+        {
+            __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+            __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+            __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+            __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+            __m128i alpha = _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10));
+            valid = _mm_or_si128(is_digit, is_alpha);
+            return _mm_or_si128(_mm_and_si128(is_digit, digit), _mm_and_si128(is_alpha, alpha));
+        }
+
+        TARGET_SIMD("sse2")
+        void hex_encode_sse2(const u8* src, size_t len, u8* dst)
+        {
+            constexpr size_t width = 16;
+            const __m128i nibble = _mm_set1_epi8(0x0f);
+            const __m128i nine = _mm_set1_epi8(9);
+            const __m128i zero_char = _mm_set1_epi8('0');
+            const __m128i alpha_off = _mm_set1_epi8('a' - '0' - 10);
+
+            size_t i = 0;
+            for (; i + width <= len; i += width) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+                __m128i lo = _mm_and_si128(v, nibble);
+                hi = _mm_add_epi8(_mm_add_epi8(hi, zero_char), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), alpha_off));
+                lo = _mm_add_epi8(_mm_add_epi8(lo, zero_char), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), alpha_off));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2*i), _mm_unpacklo_epi8(hi, lo));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2*i + width), _mm_unpackhi_epi8(hi, lo));
+            }
+            hex_encode_scalar(src + i, len - i, dst + 2*i);
+        }
+
+        TARGET_SIMD("sse2")
+        auto hex_decode_sse2(const u8* src, size_t len, u8* dst) -> size_t
+        {
+            constexpr size_t width = 16;
+            const __m128i low_byte = _mm_set1_epi16(0x00ff);
+
+            size_t i = 0;
+            for (; i + width <= len; i += width) {
+                __m128i valid;
+                __m128i vals = hex_values_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), valid);
+                if (_mm_movemask_epi8(valid) != 0xffff) {
+                    break;
+                }
+                // little endian, so the high nibble (first character) ends up in the low byte of every word.
+                __m128i hi = _mm_slli_epi16(_mm_and_si128(vals, low_byte), 4);
+                __m128i lo = _mm_srli_epi16(vals, 8);
+                __m128i bytes = _mm_packus_epi16(_mm_or_si128(hi, lo), _mm_setzero_si128());
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i / 2), bytes);
+            }
+            return i + hex_decode_scalar(src + i, len - i, dst + i / 2);
+        }
+
+        TARGET_SIMD("ssse3")
+        void hex_encode_ssse3(const u8* src, size_t len, u8* dst)
+        {
+            constexpr size_t width = 16;
+            const __m128i nibble = _mm_set1_epi8(0x0f);
+            const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hex_digits));
+
+            size_t i = 0;
+            for (; i + width <= len; i += width) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+                __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(v, nibble));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2*i), _mm_unpacklo_epi8(hi, lo));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2*i + width), _mm_unpackhi_epi8(hi, lo));
+            }
+            hex_encode_scalar(src + i, len - i, dst + 2*i);
+        }
+
+        TARGET_SIMD("ssse3")
+        auto hex_decode_ssse3(const u8* src, size_t len, u8* dst) -> size_t
+        {
+            constexpr size_t width = 16;
+            // 16 * first + 1 * second character of every pair.
+            const __m128i weights = _mm_set1_epi16(0x0110);
+
+            size_t i = 0;
+            for (; i + width <= len; i += width) {
+                __m128i valid;
+                __m128i vals = hex_values_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), valid);
+                if (_mm_movemask_epi8(valid) != 0xffff) {
+                    break;
+                }
+                __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(vals, weights), _mm_setzero_si128());
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i / 2), bytes);
+            }
+            return i + hex_decode_scalar(src + i, len - i, dst + i / 2);
+        }
+
+        TARGET_SIMD("avx2")
+        void hex_encode_avx2(const u8* src, size_t len, u8* dst)
+        {
+            constexpr size_t width = 32;
+            const __m256i nibble = _mm256_set1_epi8(0x0f);
+            // pshufb works per 128 bit lane, so both need the table.
+            const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex_digits)));
+
+            size_t i = 0;
+            for (; i + width <= len; i += width) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+                __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+                __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(v, nibble));
+                // unpack works per lane as well, i.e. `first` holds bytes 0-7 and 16-23, `second` 8-15 and 24-31.
+                __m256i first = _mm256_unpacklo_epi8(hi, lo);
+                __m256i second = _mm256_unpackhi_epi8(hi, lo);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2*i), _mm256_permute2x128_si256(first, second, 0x20));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2*i + width), _mm256_permute2x128_si256(first, second, 0x31));
+            }
+            hex_encode_scalar(src + i, len - i, dst + 2*i);
+        }
+
+        TARGET_SIMD("avx2")
+        auto hex_decode_avx2(const u8* src, size_t len, u8* dst) -> size_t
+        {
+            constexpr size_t width = 32;
+            const __m256i weights = _mm256_set1_epi16(0x0110);
+            const __m256i lower = _mm256_set1_epi8(0x20);
+
+            size_t i = 0;
+            for (; i + width <= len; i += width) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+                __m256i low = _mm256_or_si256(v, lower);
+                __m256i is_digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+                __m256i is_alpha = _mm256_and_si256(_mm256_cmpgt_epi8(low, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), low));
+                if (static_cast<u32>(_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_alpha))) != 0xffffffff) {
+                    break;
+                }
+                __m256i vals = _mm256_or_si256(_mm256_and_si256(is_digit, _mm256_sub_epi8(v, _mm256_set1_epi8('0'))),
+                                               _mm256_and_si256(is_alpha, _mm256_sub_epi8(low, _mm256_set1_epi8('a' - 10))));
+                // packus works per lane, so the results are in the first and third quadword.
+                __m256i bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(vals, weights), _mm256_setzero_si256());
+                bytes = _mm256_permute4x64_epi64(bytes, 0b1000);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i / 2), _mm256_castsi256_si128(bytes));
+            }
+            return i + hex_decode_scalar(src + i, len - i, dst + i / 2);
+        }
+#endif
+
+        using encode_fn = void (*)(const u8*, size_t, u8*);
+
+        auto encode_kernel(simd_level level) -> encode_fn
+        {
+            cpu::require_supported(level);
+            switch (level) {
+#if TASARCH_X86
+            case simd_level::avx2:
+                return &hex_encode_avx2;
+            case simd_level::ssse3:
+                return &hex_encode_ssse3;
+            case simd_level::sse2:
+                return &hex_encode_sse2;
+#endif
+            default:
+                return &hex_encode_scalar;
+            }
+        }
+
+        using decode_fn = size_t (*)(const u8*, size_t, u8*);
+
+        auto decode_kernel(simd_level level) -> decode_fn
+        {
+            cpu::require_supported(level);
+            switch (level) {
+#if TASARCH_X86
+            case simd_level::avx2:
+                return &hex_decode_avx2;
+            case simd_level::ssse3:
+                return &hex_decode_ssse3;
+            case simd_level::sse2:
+                return &hex_decode_sse2;
+#endif
+            default:
+                return &hex_decode_scalar;
+            }
+        }
+    } // namespace
+
+    void hex_encode(const u8* src, size_t len, u8* dst)
+    {
+        static const encode_fn kernel = encode_kernel(cpu::best_simd_level());
+        kernel(src, len, dst);
+    }
+
+    void hex_encode(const u8* src, size_t len, u8* dst, simd_level level)
+    {
+        encode_kernel(level)(src, len, dst);
+    }
+
+    auto hex_decode(const u8* src, size_t len, u8* dst) -> size_t
+    {
+        static const decode_fn kernel = decode_kernel(cpu::best_simd_level());
+        return kernel(src, len, dst);
+    }
+
+    auto hex_decode(const u8* src, size_t len, u8* dst, simd_level level) -> size_t
+    {
+        return decode_kernel(level)(src, len, dst);
+    }
+} // namespace tasarch::gdb::codec
@@ -0,0 +1,57 @@
+/**
+ * @file hex_codec.h
+ * @brief Bulk kernels for hex encoding / decoding data, as used by the memory packets (`m`, `M`) and friends.
+ *
+ * `BytesCoder` and `connection::append_hex()` used to go through `encode_hex()` / `decode_hex()` one nibble at a time, with a bounds check for every character.
+ * For large memory reads and writes that dominated the profile, so the functions here work on whole spans instead, writing directly into the destination.
+ * Like the ones in `packet_codec.h`, every kernel is available as a scalar fallback and in SIMD flavours, the best one supported by the cpu is picked at runtime.
+ */
+#ifndef __GDB_HEX_CODEC_H
+#define __GDB_HEX_CODEC_H
+
+#include <cstddef>
+#include "util/cpu_features.h"
+#include "util/defines.h"
+
+namespace tasarch::gdb::codec {
+    using cpu::simd_level;
+
+    /**
+     * @brief Hex encode `len` bytes from `src` into `dst`, using lower case digits.
+     *
+     * @warning `dst` must have room for exactly `2*len` bytes.
+     *
+     * @param src
+     * @param len
+     * @param dst
+     */
+    void hex_encode(const u8* src, size_t len, u8* dst);
+
+    /**
+     * @brief Same as `hex_encode()`, but forces a specific kernel. Mostly useful for testing and benchmarking.
+     * @throws std::invalid_argument if the given level is not supported by the current cpu.
+     */
+    void hex_encode(const u8* src, size_t len, u8* dst, simd_level level);
+
+    /**
+     * @brief Decode `len` hex digits (upper or lower case) from `src` into `len / 2` bytes at `dst`, validating them in the same pass.
+     *
+     * Decoding stops at the first invalid digit, whatever was decoded before it is already written to `dst`.
+     *
+     * @warning `len` must be even and `dst` must have room for `len / 2` bytes.
+     *
+     * @param src
+     * @param len
+     * @param dst
+     * @return size_t The offset of the first invalid digit, or `len` if all of them are valid.
+     */
+    auto hex_decode(const u8* src, size_t len, u8* dst) -> size_t;
+
+    /**
+     * @brief Same as `hex_decode()`, but forces a specific kernel. Mostly useful for testing and benchmarking.
+     * @throws std::invalid_argument if the given level is not supported by the current cpu.
+     */
+    auto hex_decode(const u8* src, size_t len, u8* dst, simd_level level) -> size_t;
+} // namespace tasarch::gdb::codec
+
+#endif /* __GDB_HEX_CODEC_H */
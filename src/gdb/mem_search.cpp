@@ -0,0 +1,152 @@
+#include <bit>
+#include <cstring>
+#include "mem_search.h"
+
+#if TASARCH_X86
+#include <immintrin.h>
+#endif
+
+namespace tasarch::gdb::search {
+    namespace {
+        constexpr size_t not_found = static_cast<size_t>(-1);
+
+        /**
+         * @brief Whether `pattern` (at least two bytes) is at `pos`, the first byte is already known to match.
+         */
+        ALWAYS_INLINE auto matches_at(const u8* pos, const u8* pattern, size_t len) -> bool
+        {
+            return pos[len - 1] == pattern[len - 1] && std::memcmp(pos + 1, pattern + 1, len - 2) == 0;
+        }
+
+        /**
+         * @brief Scans with `memchr` for the first byte of the pattern and verifies every candidate.
+         * `len >= 2` and `len <= size`.
+         */
+        auto find_scalar(const u8* hay, size_t size, const u8* pattern, size_t len) -> size_t
+        {
+            const u8* last = hay + size - len;
+            const u8* pos = hay;
+            while (pos <= last) {
+                pos = static_cast<const u8*>(std::memchr(pos, pattern[0], static_cast<size_t>(last - pos) + 1));
+                if (pos == nullptr) {
+                    return not_found;
+                }
+                if (matches_at(pos, pattern, len)) {
+                    return static_cast<size_t>(pos - hay);
+                }
+                pos++;
+            }
+            return not_found;
+        }
+
+#if TASARCH_X86
+        /*
+         * For every block of positions, the bytes at those positions are compared with the first byte of the pattern
+         * and the bytes `len - 1` after them with the last byte of the pattern.
+         * Only positions where both match are verified, for most data and patterns that is (almost) never the case.
+         * The last positions that do not fill a whole block are left to the scalar code.
+         */
+
+        TARGET_SIMD("sse2")
+        auto find_sse2(const u8* hay, size_t size, const u8* pattern, size_t len) -> size_t
+        {
+            constexpr size_t width = 16;
+            const __m128i first = _mm_set1_epi8(static_cast<char>(pattern[0]));
+            const __m128i last = _mm_set1_epi8(static_cast<char>(pattern[len - 1]));
+
+            size_t i = 0;
+            for (; i + width + len - 1 <= size; i += width) {
+                __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i));
+                __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i + len - 1));
+                auto mask = static_cast<u32>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last))));
+                while (mask != 0) {
+                    size_t pos = i + static_cast<size_t>(std::countr_zero(mask));
+                    if (std::memcmp(hay + pos + 1, pattern + 1, len - 2) == 0) {
+                        return pos;
+                    }
+                    mask &= mask - 1;
+                }
+            }
+            size_t rest = find_scalar(hay + i, size - i, pattern, len);
+            return rest == not_found ? not_found : i + rest;
+        }
+
+        TARGET_SIMD("avx2")
+        auto find_avx2(const u8* hay, size_t size, const u8* pattern, size_t len) -> size_t
+        {
+            constexpr size_t width = 32;
+            const __m256i first = _mm256_set1_epi8(static_cast<char>(pattern[0]));
+            const __m256i last = _mm256_set1_epi8(static_cast<char>(pattern[len - 1]));
+
+            size_t i = 0;
+            for (; i + width + len - 1 <= size; i += width) {
+                __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i));
+                __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i + len - 1));
+                auto mask = static_cast<u32>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last))));
+                while (mask != 0) {
+                    size_t pos = i + static_cast<size_t>(std::countr_zero(mask));
+                    if (std::memcmp(hay + pos + 1, pattern + 1, len - 2) == 0) {
+                        return pos;
+                    }
+                    mask &= mask - 1;
+                }
+            }
+            size_t rest = find_scalar(hay + i, size - i, pattern, len);
+            return rest == not_found ? not_found : i + rest;
+        }
+#endif
+
+        using find_fn = size_t (*)(const u8*, size_t, const u8*, size_t);
+
+        auto find_kernel(simd_level level) -> find_fn
+        {
+            cpu::require_supported(level);
+            switch (level) {
+#if TASARCH_X86
+            case simd_level::avx2:
+                return &find_avx2;
+            // nothing in SSSE3 helps here.
+            case simd_level::ssse3:
+            case simd_level::sse2:
+                return &find_sse2;
+#endif
+            default:
+                return &find_scalar;
+            }
+        }
+
+        auto find_with(find_fn kernel, std::span<const u8> haystack, std::span<const u8> pattern) -> std::optional<size_t>
+        {
+            if (pattern.empty()) {
+                return 0;
+            }
+            if (pattern.size() > haystack.size()) {
+                return std::nullopt;
+            }
+            if (pattern.size() == 1) {
+                // memchr is already vectorized by libc.
+                const void* pos = std::memchr(haystack.data(), pattern[0], haystack.size());
+                if (pos == nullptr) {
+                    return std::nullopt;
+                }
+                return static_cast<size_t>(static_cast<const u8*>(pos) - haystack.data());
+            }
+            size_t pos = kernel(haystack.data(), haystack.size(), pattern.data(), pattern.size());
+            if (pos == not_found) {
+                return std::nullopt;
+            }
+            return pos;
+        }
+    } // namespace
+
+    auto find(std::span<const u8> haystack, std::span<const u8> pattern) -> std::optional<size_t>
+    {
+        static const find_fn kernel = find_kernel(cpu::best_simd_level());
+        return find_with(kernel, haystack, pattern);
+    }
+
+    auto find(std::span<const u8> haystack, std::span<const u8> pattern, simd_level level) -> std::optional<size_t>
+    {
+        return find_with(find_kernel(level), haystack, pattern);
+    }
+} // namespace tasarch::gdb::search
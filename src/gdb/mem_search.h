@@ -0,0 +1,37 @@
+/**
+ * @file mem_search.h
+ * @brief Searching memory for a byte pattern, as needed for `qSearch:memory`.
+ *
+ * Without `qSearch:memory`, gdb's `find` reads the whole range over the wire and searches it itself, one packet at a time.
+ * Searching locally is only worth it if it is fast though, so like `hex_codec.h`, there is a scalar version and SIMD ones picked at runtime.
+ * The SIMD kernels compare a whole block against the first and the last byte of the pattern at once and only verify the (rare) positions where both match.
+ */
+#ifndef __GDB_MEM_SEARCH_H
+#define __GDB_MEM_SEARCH_H
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include "util/cpu_features.h"
+#include "util/defines.h"
+
+namespace tasarch::gdb::search {
+    using cpu::simd_level;
+
+    /**
+     * @brief Find the first occurrence of `pattern` in `haystack`.
+     *
+     * @param haystack
+     * @param pattern An empty pattern matches at offset 0.
+     * @return std::optional<size_t> Offset of the match in `haystack`, if there is one.
+     */
+    auto find(std::span<const u8> haystack, std::span<const u8> pattern) -> std::optional<size_t>;
+
+    /**
+     * @brief Same as `find()`, but forces a specific kernel. Mostly useful for testing and benchmarking.
+     * @throws std::invalid_argument if the given level is not supported by the current cpu.
+     */
+    auto find(std::span<const u8> haystack, std::span<const u8> pattern, simd_level level) -> std::optional<size_t>;
+} // namespace tasarch::gdb::search
+
+#endif /* __GDB_MEM_SEARCH_H */
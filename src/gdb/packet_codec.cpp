@@ -0,0 +1,547 @@
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/core.h>
+#include "packet_codec.h"
+#include "packet_io.h"
+
+#if TASARCH_X86
+#include <immintrin.h>
+#endif
+
+namespace tasarch::gdb::codec {
+    namespace {
+        constexpr u8 escape_char = PacketIO::escape;
+        constexpr u8 rle_char = PacketIO::rle;
+
+        /**
+         * @brief Escapes a single byte, writing it to `dst[o]` and updating `o` and `sum`.
+         */
+        ALWAYS_INLINE void escape_one(u8 c, u8* dst, size_t& o, u64& sum)
+        {
+            if (PacketIO::must_escape_response(c)) {
+                u8 esc = PacketIO::code_escape_char(c);
+                dst[o++] = escape_char;
+                dst[o++] = esc;
+                sum += static_cast<u64>(escape_char) + esc;
+            } else {
+                dst[o++] = c;
+                sum += c;
+            }
+        }
+
+        /**
+         * @brief Emits `src[0]` and, if it is repeated often enough, the run length encoding of its repetitions.
+         *
+         * Follows what gdbserver does (`try_rle` in `remote-utils.c`):
+         * - The repeat count `n` is sent as the character `n + 29`, so it can be at most `126 - 29` (`~`).
+         * - Runs shorter than four characters are not worth it, `X*c` takes three bytes already.
+         * - The counts resulting in `#` or `$` must not be used, so they are shortened to the next lower valid count and the rest is emitted on its own.
+         *
+         * @note `src[0]` must not need escaping, since the client repeats the last byte it received, which would be the escaped one.
+         * @return size_t The number of bytes of `src` that were consumed.
+         */
+        ALWAYS_INLINE auto rle_one(const u8* src, size_t remaining, u8* dst, size_t& o, u64& sum) -> size_t
+        {
+            constexpr size_t min_repeat = 3;
+            constexpr size_t max_repeat = '~' - rle_count_offset;
+
+            u8 c = src[0];
+            dst[o++] = c;
+            sum += c;
+
+            size_t limit = std::min(remaining, max_repeat + 1);
+            size_t n = 1;
+            while (n < limit && src[n] == c) {
+                n++;
+            }
+            // src[0] was already emitted above.
+            n--;
+
+            if (n < min_repeat) {
+                return 1;
+            }
+
+            while (n + rle_count_offset == PacketIO::packet_begin || n + rle_count_offset == PacketIO::packet_end) {
+                n--;
+            }
+
+            auto count = static_cast<u8>(n + rle_count_offset);
+            dst[o++] = rle_char;
+            dst[o++] = count;
+            sum += static_cast<u64>(rle_char) + count;
+            return n + 1;
+        }
+
+        /**
+         * @brief Encode the byte at `src[i]`, either by escaping it or (if enabled) run length encoding it together with the following bytes.
+         * @return size_t The number of bytes consumed.
+         */
+        template<bool Rle>
+        ALWAYS_INLINE auto encode_one(const u8* src, size_t i, size_t len, u8* dst, size_t& o, u64& sum) -> size_t
+        {
+            if constexpr (Rle) {
+                if (!PacketIO::must_escape_response(src[i])) {
+                    return rle_one(src + i, len - i, dst, o, sum);
+                }
+            }
+            escape_one(src[i], dst, o, sum);
+            return 1;
+        }
+
+        template<bool Rle>
+        auto escape_response_scalar(const u8* src, size_t len, u8* dst) -> encode_result
+        {
+            size_t o = 0;
+            u64 sum = 0;
+            for (size_t i = 0; i < len;) {
+                i += encode_one<Rle>(src, i, len, dst, o, sum);
+            }
+            return encode_result { .size = o, .checksum = static_cast<u8>(sum) };
+        }
+
+        /**
+         * @brief Whether the byte at `src[i]` cannot be sent as is, see `scan_response()`.
+         */
+        template<bool Rle>
+        ALWAYS_INLINE auto needs_encoding(const u8* src, size_t i, size_t len) -> bool
+        {
+            u8 c = src[i];
+            if (PacketIO::must_escape_response(c)) {
+                return true;
+            }
+            if constexpr (Rle) {
+                return i + 3 < len && src[i + 1] == c && src[i + 2] == c && src[i + 3] == c;
+            }
+            return false;
+        }
+
+        template<bool Rle>
+        auto scan_response_scalar(const u8* src, size_t len) -> scan_result
+        {
+            u64 sum = 0;
+            size_t i = 0;
+            for (; i < len && !needs_encoding<Rle>(src, i, len); i++) {
+                sum += src[i];
+            }
+            return scan_result { .size = i, .checksum = static_cast<u8>(sum) };
+        }
+
+        ALWAYS_INLINE auto ends_clean_run(u8 c) -> bool
+        {
+            return c == PacketIO::packet_end || c == PacketIO::escape;
+        }
+
+        auto scan_request_scalar(const u8* src, size_t len) -> scan_result
+        {
+            u64 sum = 0;
+            size_t i = 0;
+            for (; i < len && !ends_clean_run(src[i]); i++) {
+                sum += src[i];
+            }
+            return scan_result { .size = i, .checksum = static_cast<u8>(sum) };
+        }
+
+#if TASARCH_X86
+        /**
+         * @brief 0xff for the first half, 0x00 for the second. Loading at `prefix_mask + 32 - n` gives a vector with the first `n` bytes set.
+         */
+        alignas(64) constexpr u8 prefix_mask[64] = {
+            0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+            0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        };
+
+        /*
+         * Both SIMD kernels work the same way:
+         * Load a block and find the positions that cannot just be copied, i.e. one of the four characters needing escaping or (with RLE) the start of a run of at least four equal bytes.
+         * If there are none, store the whole block and add it to the checksum (using psadbw for the horizontal sum).
+         * Otherwise, the clean prefix up to the first such position is stored and summed, the position is handled by the scalar code and we continue directly after it.
+         * Storing the full block even if only a prefix is valid is fine, since `dst` is guaranteed to be twice the size of `src`.
+         * With RLE, the run detection looks three bytes ahead, so the block loop stops three bytes earlier.
+         */
+
+        template<bool Rle>
+        TARGET_SIMD("sse2")
+        auto escape_response_sse2(const u8* src, size_t len, u8* dst) -> encode_result
+        {
+            constexpr size_t width = 16;
+            constexpr size_t lookahead = Rle ? 3 : 0;
+            const __m128i begin = _mm_set1_epi8(static_cast<char>(PacketIO::packet_begin));
+            const __m128i end = _mm_set1_epi8(static_cast<char>(PacketIO::packet_end));
+            const __m128i esc = _mm_set1_epi8(static_cast<char>(PacketIO::escape));
+            const __m128i rle = _mm_set1_epi8(static_cast<char>(PacketIO::rle));
+            const __m128i zero = _mm_setzero_si128();
+            __m128i acc = _mm_setzero_si128();
+
+            size_t i = 0;
+            size_t o = 0;
+            u64 sum = 0;
+            while (i + width + lookahead <= len) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, begin), _mm_cmpeq_epi8(v, end)),
+                                            _mm_or_si128(_mm_cmpeq_epi8(v, esc), _mm_cmpeq_epi8(v, rle)));
+                if constexpr (Rle) {
+                    __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 1));
+                    __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 2));
+                    __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 3));
+                    __m128i runs = _mm_and_si128(_mm_cmpeq_epi8(v, v1), _mm_and_si128(_mm_cmpeq_epi8(v, v2), _mm_cmpeq_epi8(v, v3)));
+                    hits = _mm_or_si128(hits, runs);
+                }
+                auto mask = static_cast<u32>(_mm_movemask_epi8(hits));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + o), v);
+                if (mask == 0) {
+                    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+                    i += width;
+                    o += width;
+                    continue;
+                }
+
+                auto n = static_cast<size_t>(__builtin_ctz(mask));
+                __m128i keep = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prefix_mask + 32 - n));
+                acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_and_si128(v, keep), zero));
+                o += n;
+                i += n;
+                i += encode_one<Rle>(src, i, len, dst, o, sum);
+            }
+
+            alignas(16) u64 lanes[2];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+            sum += lanes[0] + lanes[1];
+
+            while (i < len) {
+                i += encode_one<Rle>(src, i, len, dst, o, sum);
+            }
+            return encode_result { .size = o, .checksum = static_cast<u8>(sum) };
+        }
+
+        template<bool Rle>
+        TARGET_SIMD("avx2")
+        auto escape_response_avx2(const u8* src, size_t len, u8* dst) -> encode_result
+        {
+            constexpr size_t width = 32;
+            constexpr size_t lookahead = Rle ? 3 : 0;
+            const __m256i begin = _mm256_set1_epi8(static_cast<char>(PacketIO::packet_begin));
+            const __m256i end = _mm256_set1_epi8(static_cast<char>(PacketIO::packet_end));
+            const __m256i esc = _mm256_set1_epi8(static_cast<char>(PacketIO::escape));
+            const __m256i rle = _mm256_set1_epi8(static_cast<char>(PacketIO::rle));
+            const __m256i zero = _mm256_setzero_si256();
+            __m256i acc = _mm256_setzero_si256();
+
+            size_t i = 0;
+            size_t o = 0;
+            u64 sum = 0;
+            while (i + width + lookahead <= len) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+                __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, begin), _mm256_cmpeq_epi8(v, end)),
+                                               _mm256_or_si256(_mm256_cmpeq_epi8(v, esc), _mm256_cmpeq_epi8(v, rle)));
+                if constexpr (Rle) {
+                    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 1));
+                    __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 2));
+                    __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 3));
+                    __m256i runs = _mm256_and_si256(_mm256_cmpeq_epi8(v, v1), _mm256_and_si256(_mm256_cmpeq_epi8(v, v2), _mm256_cmpeq_epi8(v, v3)));
+                    hits = _mm256_or_si256(hits, runs);
+                }
+                auto mask = static_cast<u32>(_mm256_movemask_epi8(hits));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + o), v);
+                if (mask == 0) {
+                    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+                    i += width;
+                    o += width;
+                    continue;
+                }
+
+                auto n = static_cast<size_t>(__builtin_ctz(mask));
+                __m256i keep = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prefix_mask + 32 - n));
+                acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_and_si256(v, keep), zero));
+                o += n;
+                i += n;
+                i += encode_one<Rle>(src, i, len, dst, o, sum);
+            }
+
+            alignas(32) u64 lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+            sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+            while (i < len) {
+                i += encode_one<Rle>(src, i, len, dst, o, sum);
+            }
+            return encode_result { .size = o, .checksum = static_cast<u8>(sum) };
+        }
+
+        template<bool Rle>
+        TARGET_SIMD("sse2")
+        auto scan_response_sse2(const u8* src, size_t len) -> scan_result
+        {
+            constexpr size_t width = 16;
+            constexpr size_t lookahead = Rle ? 3 : 0;
+            const __m128i begin = _mm_set1_epi8(static_cast<char>(PacketIO::packet_begin));
+            const __m128i end = _mm_set1_epi8(static_cast<char>(PacketIO::packet_end));
+            const __m128i esc = _mm_set1_epi8(static_cast<char>(PacketIO::escape));
+            const __m128i rle = _mm_set1_epi8(static_cast<char>(PacketIO::rle));
+            const __m128i zero = _mm_setzero_si128();
+            __m128i acc = _mm_setzero_si128();
+
+            size_t i = 0;
+            u32 mask = 0;
+            for (; i + width + lookahead <= len; i += width) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, begin), _mm_cmpeq_epi8(v, end)),
+                                            _mm_or_si128(_mm_cmpeq_epi8(v, esc), _mm_cmpeq_epi8(v, rle)));
+                if constexpr (Rle) {
+                    __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 1));
+                    __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 2));
+                    __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 3));
+                    __m128i runs = _mm_and_si128(_mm_cmpeq_epi8(v, v1), _mm_and_si128(_mm_cmpeq_epi8(v, v2), _mm_cmpeq_epi8(v, v3)));
+                    hits = _mm_or_si128(hits, runs);
+                }
+                mask = static_cast<u32>(_mm_movemask_epi8(hits));
+                if (mask != 0) {
+                    auto n = static_cast<size_t>(__builtin_ctz(mask));
+                    __m128i keep = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prefix_mask + 32 - n));
+                    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_and_si128(v, keep), zero));
+                    i += n;
+                    break;
+                }
+                acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+            }
+
+            alignas(16) u64 lanes[2];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+            u64 sum = lanes[0] + lanes[1];
+
+            if (mask == 0) {
+                auto tail = scan_response_scalar<Rle>(src + i, len - i);
+                i += tail.size;
+                sum += tail.checksum;
+            }
+            return scan_result { .size = i, .checksum = static_cast<u8>(sum) };
+        }
+
+        template<bool Rle>
+        TARGET_SIMD("avx2")
+        auto scan_response_avx2(const u8* src, size_t len) -> scan_result
+        {
+            constexpr size_t width = 32;
+            constexpr size_t lookahead = Rle ? 3 : 0;
+            const __m256i begin = _mm256_set1_epi8(static_cast<char>(PacketIO::packet_begin));
+            const __m256i end = _mm256_set1_epi8(static_cast<char>(PacketIO::packet_end));
+            const __m256i esc = _mm256_set1_epi8(static_cast<char>(PacketIO::escape));
+            const __m256i rle = _mm256_set1_epi8(static_cast<char>(PacketIO::rle));
+            const __m256i zero = _mm256_setzero_si256();
+            __m256i acc = _mm256_setzero_si256();
+
+            size_t i = 0;
+            u32 mask = 0;
+            for (; i + width + lookahead <= len; i += width) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+                __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, begin), _mm256_cmpeq_epi8(v, end)),
+                                               _mm256_or_si256(_mm256_cmpeq_epi8(v, esc), _mm256_cmpeq_epi8(v, rle)));
+                if constexpr (Rle) {
+                    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 1));
+                    __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 2));
+                    __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 3));
+                    __m256i runs = _mm256_and_si256(_mm256_cmpeq_epi8(v, v1), _mm256_and_si256(_mm256_cmpeq_epi8(v, v2), _mm256_cmpeq_epi8(v, v3)));
+                    hits = _mm256_or_si256(hits, runs);
+                }
+                mask = static_cast<u32>(_mm256_movemask_epi8(hits));
+                if (mask != 0) {
+                    auto n = static_cast<size_t>(__builtin_ctz(mask));
+                    __m256i keep = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prefix_mask + 32 - n));
+                    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_and_si256(v, keep), zero));
+                    i += n;
+                    break;
+                }
+                acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+            }
+
+            alignas(32) u64 lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+            u64 sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+            if (mask == 0) {
+                auto tail = scan_response_scalar<Rle>(src + i, len - i);
+                i += tail.size;
+                sum += tail.checksum;
+            }
+            return scan_result { .size = i, .checksum = static_cast<u8>(sum) };
+        }
+
+        TARGET_SIMD("sse2")
+        auto scan_request_sse2(const u8* src, size_t len) -> scan_result
+        {
+            constexpr size_t width = 16;
+            const __m128i end = _mm_set1_epi8(static_cast<char>(PacketIO::packet_end));
+            const __m128i esc = _mm_set1_epi8(static_cast<char>(PacketIO::escape));
+            const __m128i zero = _mm_setzero_si128();
+            __m128i acc = _mm_setzero_si128();
+
+            size_t i = 0;
+            u32 mask = 0;
+            for (; i + width <= len; i += width) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                mask = static_cast<u32>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, end), _mm_cmpeq_epi8(v, esc))));
+                if (mask != 0) {
+                    auto n = static_cast<size_t>(__builtin_ctz(mask));
+                    __m128i keep = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prefix_mask + 32 - n));
+                    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_and_si128(v, keep), zero));
+                    i += n;
+                    break;
+                }
+                acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+            }
+
+            alignas(16) u64 lanes[2];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+            u64 sum = lanes[0] + lanes[1];
+
+            if (mask == 0) {
+                auto tail = scan_request_scalar(src + i, len - i);
+                i += tail.size;
+                sum += tail.checksum;
+            }
+            return scan_result { .size = i, .checksum = static_cast<u8>(sum) };
+        }
+
+        TARGET_SIMD("avx2")
+        auto scan_request_avx2(const u8* src, size_t len) -> scan_result
+        {
+            constexpr size_t width = 32;
+            const __m256i end = _mm256_set1_epi8(static_cast<char>(PacketIO::packet_end));
+            const __m256i esc = _mm256_set1_epi8(static_cast<char>(PacketIO::escape));
+            const __m256i zero = _mm256_setzero_si256();
+            __m256i acc = _mm256_setzero_si256();
+
+            size_t i = 0;
+            u32 mask = 0;
+            for (; i + width <= len; i += width) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+                mask = static_cast<u32>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, end), _mm256_cmpeq_epi8(v, esc))));
+                if (mask != 0) {
+                    auto n = static_cast<size_t>(__builtin_ctz(mask));
+                    __m256i keep = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prefix_mask + 32 - n));
+                    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_and_si256(v, keep), zero));
+                    i += n;
+                    break;
+                }
+                acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+            }
+
+            alignas(32) u64 lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+            u64 sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+            if (mask == 0) {
+                auto tail = scan_request_scalar(src + i, len - i);
+                i += tail.size;
+                sum += tail.checksum;
+            }
+            return scan_result { .size = i, .checksum = static_cast<u8>(sum) };
+        }
+#endif
+
+        void require_supported(simd_level level)
+        {
+            if (!cpu::simd_supported(level)) {
+                throw std::invalid_argument(fmt::format("SIMD level {} is not supported by this cpu", cpu::simd_name(level)));
+            }
+        }
+
+        using escape_fn = encode_result (*)(const u8*, size_t, u8*);
+
+        template<bool Rle>
+        auto escape_kernel(simd_level level) -> escape_fn
+        {
+            require_supported(level);
+            switch (level) {
+#if TASARCH_X86
+            case simd_level::avx2:
+                return &escape_response_avx2<Rle>;
+            case simd_level::ssse3:
+            case simd_level::sse2:
+                return &escape_response_sse2<Rle>;
+#endif
+            default:
+                return &escape_response_scalar<Rle>;
+            }
+        }
+
+        using scan_fn = scan_result (*)(const u8*, size_t);
+
+        template<bool Rle>
+        auto scan_response_kernel(simd_level level) -> scan_fn
+        {
+            require_supported(level);
+            switch (level) {
+#if TASARCH_X86
+            case simd_level::avx2:
+                return &scan_response_avx2<Rle>;
+            case simd_level::ssse3:
+            case simd_level::sse2:
+                return &scan_response_sse2<Rle>;
+#endif
+            default:
+                return &scan_response_scalar<Rle>;
+            }
+        }
+
+        auto scan_kernel(simd_level level) -> scan_fn
+        {
+            require_supported(level);
+            switch (level) {
+#if TASARCH_X86
+            case simd_level::avx2:
+                return &scan_request_avx2;
+            case simd_level::ssse3:
+            case simd_level::sse2:
+                return &scan_request_sse2;
+#endif
+            default:
+                return &scan_request_scalar;
+            }
+        }
+    } // namespace
+
+    auto escape_response(const u8* src, size_t len, u8* dst) -> encode_result
+    {
+        static const escape_fn kernel = escape_kernel<false>(cpu::best_simd_level());
+        return kernel(src, len, dst);
+    }
+
+    auto escape_response(const u8* src, size_t len, u8* dst, simd_level level) -> encode_result
+    {
+        return escape_kernel<false>(level)(src, len, dst);
+    }
+
+    auto escape_rle_response(const u8* src, size_t len, u8* dst) -> encode_result
+    {
+        static const escape_fn kernel = escape_kernel<true>(cpu::best_simd_level());
+        return kernel(src, len, dst);
+    }
+
+    auto escape_rle_response(const u8* src, size_t len, u8* dst, simd_level level) -> encode_result
+    {
+        return escape_kernel<true>(level)(src, len, dst);
+    }
+
+    auto scan_response(const u8* src, size_t len, bool rle) -> scan_result
+    {
+        static const scan_fn kernel = scan_response_kernel<false>(cpu::best_simd_level());
+        static const scan_fn rle_kernel = scan_response_kernel<true>(cpu::best_simd_level());
+        return rle ? rle_kernel(src, len) : kernel(src, len);
+    }
+
+    auto scan_response(const u8* src, size_t len, bool rle, simd_level level) -> scan_result
+    {
+        return rle ? scan_response_kernel<true>(level)(src, len) : scan_response_kernel<false>(level)(src, len);
+    }
+
+    auto scan_request(const u8* src, size_t len) -> scan_result
+    {
+        static const scan_fn kernel = scan_kernel(cpu::best_simd_level());
+        return kernel(src, len);
+    }
+
+    auto scan_request(const u8* src, size_t len, simd_level level) -> scan_result
+    {
+        return scan_kernel(level)(src, len);
+    }
+} // namespace tasarch::gdb::codec
@@ -0,0 +1,138 @@
+/**
+ * @file packet_codec.h
+ * @brief Bulk kernels for the byte level work of the gdb transport protocol (escaping and checksumming).
+ *
+ * `PacketIO` used to do this one byte at a time through `buffer::get_byte()` / `buffer::put_byte()`.
+ * For large packets (e.g. memory dumps) that was the top frame in any profile, so the functions here work on whole spans instead.
+ * Every kernel is available as a scalar fallback and in SIMD flavours, the best one supported by the cpu is picked at runtime.
+ */
+#ifndef __GDB_PACKET_CODEC_H
+#define __GDB_PACKET_CODEC_H
+
+#include <cstddef>
+#include "util/cpu_features.h"
+#include "util/defines.h"
+
+namespace tasarch::gdb::codec {
+    using cpu::simd_level;
+
+    /**
+     * @brief Result of encoding some data for the wire.
+     */
+    struct encode_result
+    {
+        /**
+         * @brief Number of bytes written to the destination.
+         */
+        size_t size = 0;
+
+        /**
+         * @brief Modulo 256 sum of all bytes written to the destination, i.e. the packet checksum.
+         */
+        u8 checksum = 0;
+    };
+
+    /**
+     * @brief Result of scanning data for special characters (see `scan_request()` and `scan_response()`).
+     */
+    struct scan_result
+    {
+        /**
+         * @brief Length of the clean prefix, i.e. the number of bytes before the first special character / byte needing encoding (or all of them, if there is none).
+         */
+        size_t size = 0;
+
+        /**
+         * @brief Modulo 256 sum of the clean prefix.
+         */
+        u8 checksum = 0;
+    };
+
+    /**
+     * @brief Escape `len` bytes of response data from `src` into `dst` and calculate the checksum of the escaped data.
+     *
+     * Any bytes for which `PacketIO::must_escape_response()` is true, are replaced by `}` followed by the byte xor `0x20`.
+     * Everything else is copied verbatim.
+     *
+     * @warning `dst` must have room for at least `2*len` bytes and must not overlap with `src`!
+     *
+     * @param src The raw response data.
+     * @param len
+     * @param dst Where the escaped data is written to.
+     * @return encode_result
+     */
+    auto escape_response(const u8* src, size_t len, u8* dst) -> encode_result;
+
+    /**
+     * @brief Same as `escape_response()`, but forces a specific kernel. Mostly useful for testing and benchmarking.
+     * @throws std::invalid_argument if the given level is not supported by the current cpu.
+     */
+    auto escape_response(const u8* src, size_t len, u8* dst, simd_level level) -> encode_result;
+
+    /**
+     * @brief Offset added to a run length, to get the character that is sent after the `*`.
+     */
+    constexpr size_t rle_count_offset = 29;
+
+    /**
+     * @brief Same as `escape_response()`, but additionally run length encodes repeated bytes.
+     *
+     * A byte `c` repeated `n` more times is sent as `c*` followed by the character `n + 29`, see https://sourceware.org/gdb/onlinedocs/gdb/Overview.html#Overview.
+     * Counts that would result in `#` or `$` are avoided by splitting the run.
+     * This is very effective for hex encoded memory dumps, which tend to contain large runs of `0`.
+     *
+     * @warning The same requirements as for `escape_response()` apply for `dst`, RLE never makes the output larger.
+     *
+     * @param src The raw response data.
+     * @param len
+     * @param dst Where the encoded data is written to.
+     * @return encode_result
+     */
+    auto escape_rle_response(const u8* src, size_t len, u8* dst) -> encode_result;
+
+    /**
+     * @brief Same as `escape_rle_response()`, but forces a specific kernel. Mostly useful for testing and benchmarking.
+     * @throws std::invalid_argument if the given level is not supported by the current cpu.
+     */
+    auto escape_rle_response(const u8* src, size_t len, u8* dst, simd_level level) -> encode_result;
+
+    /**
+     * @brief Scan response data for the first byte that cannot be sent as is.
+     *
+     * That is a byte needing escaping or, if `rle` is set, the start of a run that `escape_rle_response()` would encode.
+     * Everything before it is sent unmodified by `escape_response()` / `escape_rle_response()`, so it can go on the wire straight from the caller's buffer.
+     * Encoding the rest (starting at the returned size) gives the same result as encoding all of it.
+     *
+     * @param src The raw response data.
+     * @param len
+     * @param rle Whether the data will be run length encoded.
+     * @return scan_result
+     */
+    auto scan_response(const u8* src, size_t len, bool rle) -> scan_result;
+
+    /**
+     * @brief Same as `scan_response()`, but forces a specific kernel. Mostly useful for testing and benchmarking.
+     * @throws std::invalid_argument if the given level is not supported by the current cpu.
+     */
+    auto scan_response(const u8* src, size_t len, bool rle, simd_level level) -> scan_result;
+
+    /**
+     * @brief Scan received packet data for the first byte that ends a clean run, i.e. `#` (end of packet) or `}` (escape).
+     *
+     * This is what `PacketIO::receive_packet()` uses to move whole runs of packet data at once, instead of going through its state machine for every byte.
+     * The checksum of the clean run is calculated in the same pass.
+     *
+     * @param src The received data.
+     * @param len
+     * @return scan_result
+     */
+    auto scan_request(const u8* src, size_t len) -> scan_result;
+
+    /**
+     * @brief Same as `scan_request()`, but forces a specific kernel. Mostly useful for testing and benchmarking.
+     * @throws std::invalid_argument if the given level is not supported by the current cpu.
+     */
+    auto scan_request(const u8* src, size_t len, simd_level level) -> scan_result;
+} // namespace tasarch::gdb::codec
+
+#endif /* __GDB_PACKET_CODEC_H */
@@ -0,0 +1,457 @@
+/**
+ * @file packet_format.h
+ * @brief A small, compile time, printf like language for describing the arguments of a gdb packet, e.g. `"%x,%x:%b"` for `M`.
+ *
+ * Describing a packet with a stack of coders (`Str<Hex, ',', true>, Str<Hex, ':', true>, Bytes<>`) works, but is hard to read and every layer does its own pass over the data.
+ * Here, the format string is parsed once at compile time and turned into a single fused parser, that walks the packet exactly once.
+ * Numbers are parsed while scanning for the separator, strings and data are views into the packet where possible.
+ *
+ * The following conversions are supported:
+ * | Conversion | Argument type           | Description                                                                      |
+ * |------------|-------------------------|----------------------------------------------------------------------------------|
+ * | `%x`       | `size_t`                | Hex number, e.g. an address or length.                                           |
+ * | `%i`       | `int64_t`               | Signed hex number, e.g. `-1` as the return code of a file io reply.              |
+ * | `%s`       | `std::string_view`      | Everything up to the next literal character (or the end).                        |
+ * | `%b`       | `payload_bytes`         | Hex encoded data, up to the next literal character (or the end).                 |
+ * | `%r`       | `std::span<const u8>`   | Raw binary data, always the rest of the packet (e.g. `X`).                       |
+ * | `%%`       |                         | A literal `%`.                                                                   |
+ *
+ * Any other character has to appear literally.
+ * `[` marks the start of an optional part: if the packet ends there, all following arguments are `std::nullopt`.
+ * Arguments after a `[` are therefore `std::optional`.
+ * The matching `]` have to be at the very end, i.e. optional parts can only be nested, e.g. `"%i[,%x[,%s[;%s]]]"`.
+ *
+ * @warning Views (`%s`, `%r`) point into the packet buffer and are only valid during the callback.
+ */
+#ifndef __GDB_PACKET_FORMAT_H
+#define __GDB_PACKET_FORMAT_H
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <fmt/core.h>
+#include "buffer.h"
+#include "coding.h"
+#include "gdb_err.h"
+#include "hex_codec.h"
+#include "util/defines.h"
+
+namespace tasarch::gdb {
+    /**
+     * @brief A string literal that can be used as a template argument, e.g. `bind_handler<"%x,%x">(...)`.
+     *
+     * @tparam N Size including the null terminator.
+     */
+    template<size_t N>
+    struct fixed_string
+    {
+        // NOLINTNEXTLINE: has to be public, to be usable as a template argument.
+        char data[N] {};
+
+        // NOLINTNEXTLINE: implicit on purpose, so string literals can be used directly.
+        constexpr fixed_string(const char (&str)[N])
+        {
+            std::copy_n(str, N, data);
+        }
+
+        [[nodiscard]] constexpr auto size() const -> size_t
+        {
+            return N - 1;
+        }
+
+        constexpr auto operator[](size_t idx) const -> char
+        {
+            return data[idx];
+        }
+    };
+
+    /**
+     * @brief Thrown if a packet does not match its format.
+     */
+    class packet_parse_error : public gdb_error
+    {
+    public:
+        packet_parse_error(size_t offset, std::string_view reason) : gdb_error(malformed_packet, fmt::format("at offset {}: {}", offset, reason)), offset(offset) {}
+
+        /**
+         * @brief Where parsing failed, relative to the start of the arguments (i.e. not counting the packet type).
+         */
+        size_t offset;
+    };
+
+    namespace format {
+        enum class token_kind : u8
+        {
+            literal,
+            hex,
+            signed_hex,
+            str,
+            hex_bytes,
+            raw,
+            optional,
+        };
+
+        struct token
+        {
+            token_kind kind = token_kind::literal;
+            char ch = '\0';
+        };
+
+        constexpr auto is_conversion(token_kind kind) -> bool
+        {
+            return kind != token_kind::literal && kind != token_kind::optional;
+        }
+
+        /**
+         * @brief Not constexpr on purpose, calling it during constant evaluation results in a compile error pointing here (with the reason right next to it).
+         */
+        void invalid_packet_format(const char* reason);
+
+        /**
+         * @brief Tokenizes and validates the format, see the file description for the rules. Only ever called at compile time.
+         *
+         * @tparam Fmt
+         * @param out Where the tokens are written to, if not `nullptr`.
+         * @return size_t The number of tokens.
+         */
+        template<fixed_string Fmt>
+        constexpr auto tokenize(token* out) -> size_t
+        {
+            size_t count = 0;
+            size_t opened = 0;
+            size_t closed = 0;
+            token_kind prev = token_kind::literal;
+            bool prev_valid = false;
+            bool rest_only = false;
+            auto emit = [&](token tok) {
+                if (closed > 0) {
+                    invalid_packet_format("optional parts must only be closed at the very end");
+                }
+                if (rest_only) {
+                    invalid_packet_format("%r takes the rest of the packet, so it has to come last");
+                }
+                if (prev_valid && is_conversion(prev) && is_conversion(tok.kind)) {
+                    invalid_packet_format("two conversions need a literal between them");
+                }
+                if (out != nullptr) {
+                    out[count] = tok;
+                }
+                count++;
+                if (tok.kind != token_kind::optional) {
+                    prev = tok.kind;
+                    prev_valid = true;
+                }
+                rest_only = tok.kind == token_kind::raw;
+            };
+
+            for (size_t i = 0; i < Fmt.size(); i++) {
+                char c = Fmt[i];
+                if (c == '[') {
+                    opened++;
+                    emit(token { .kind = token_kind::optional });
+                } else if (c == ']') {
+                    closed++;
+                } else if (c != '%') {
+                    emit(token { .kind = token_kind::literal, .ch = c });
+                } else if (++i >= Fmt.size()) {
+                    invalid_packet_format("format must not end with a single %");
+                } else {
+                    switch (Fmt[i]) {
+                    case 'x':
+                        emit(token { .kind = token_kind::hex });
+                        break;
+                    case 'i':
+                        emit(token { .kind = token_kind::signed_hex });
+                        break;
+                    case 's':
+                        emit(token { .kind = token_kind::str });
+                        break;
+                    case 'b':
+                        emit(token { .kind = token_kind::hex_bytes });
+                        break;
+                    case 'r':
+                        emit(token { .kind = token_kind::raw });
+                        break;
+                    case '%':
+                        emit(token { .kind = token_kind::literal, .ch = '%' });
+                        break;
+                    default:
+                        invalid_packet_format("unknown conversion, expected one of %x, %i, %s, %b, %r or %%");
+                    }
+                }
+            }
+            if (opened != closed) {
+                invalid_packet_format("every [ needs a matching ]");
+            }
+            return count;
+        }
+
+        template<fixed_string Fmt>
+        constexpr auto parse_format()
+        {
+            std::array<token, tokenize<Fmt>(nullptr)> ret {};
+            tokenize<Fmt>(ret.data());
+            return ret;
+        }
+
+        /**
+         * @brief The tokens of the format, computed once at compile time.
+         */
+        template<fixed_string Fmt>
+        constexpr auto tokens = parse_format<Fmt>();
+
+        template<token_kind Kind>
+        struct conversion_value;
+
+        template<>
+        struct conversion_value<token_kind::hex> { using type = size_t; };
+
+        template<>
+        struct conversion_value<token_kind::signed_hex> { using type = int64_t; };
+
+        template<>
+        struct conversion_value<token_kind::str> { using type = std::string_view; };
+
+        template<>
+        struct conversion_value<token_kind::hex_bytes> { using type = payload_bytes; };
+
+        template<>
+        struct conversion_value<token_kind::raw> { using type = std::span<const u8>; };
+
+        /**
+         * @brief Whether the token at `idx` comes after a `[`.
+         */
+        template<fixed_string Fmt>
+        constexpr auto is_optional(size_t idx) -> bool
+        {
+            for (size_t i = 0; i < idx; i++) {
+                if (tokens<Fmt>[i].kind == token_kind::optional) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief The argument type of the conversion at `Idx`.
+         */
+        template<fixed_string Fmt, size_t Idx>
+        using arg_t = std::conditional_t<is_optional<Fmt>(Idx),
+                                         std::optional<typename conversion_value<tokens<Fmt>[Idx].kind>::type>,
+                                         typename conversion_value<tokens<Fmt>[Idx].kind>::type>;
+
+        template<fixed_string Fmt, size_t Idx, typename ...TArgs>
+        constexpr auto collect_args()
+        {
+            if constexpr (Idx == tokens<Fmt>.size()) {
+                return std::type_identity<std::tuple<TArgs...>>{};
+            } else if constexpr (is_conversion(tokens<Fmt>[Idx].kind)) {
+                return collect_args<Fmt, Idx + 1, TArgs..., arg_t<Fmt, Idx>>();
+            } else {
+                return collect_args<Fmt, Idx + 1, TArgs...>();
+            }
+        }
+
+        /**
+         * @brief `std::tuple` of all argument types, in order.
+         */
+        template<fixed_string Fmt>
+        using args_t = typename decltype(collect_args<Fmt, 0>())::type;
+
+        template<typename TCallback, typename TArgs, typename ...TPrefix>
+        struct callable_with;
+
+        template<typename TCallback, typename ...TArgs, typename ...TPrefix>
+        struct callable_with<TCallback, std::tuple<TArgs...>, TPrefix...> : std::bool_constant<Callback<TCallback, TPrefix..., TArgs...>> {};
+
+        struct cursor
+        {
+            const u8* begin;
+            const u8* pos;
+            const u8* end;
+
+            [[nodiscard]] auto offset() const -> size_t
+            {
+                return static_cast<size_t>(this->pos - this->begin);
+            }
+        };
+
+        /**
+         * @brief Where a `%s` / `%b` at `Idx` ends: the next literal (possibly after some `[`) or the end of the packet.
+         */
+        template<fixed_string Fmt, size_t Idx>
+        ALWAYS_INLINE auto field_end(const cursor& cur) -> const u8*
+        {
+            constexpr auto& toks = tokens<Fmt>;
+            constexpr size_t next = []{
+                size_t i = Idx + 1;
+                while (i < toks.size() && toks[i].kind == token_kind::optional) {
+                    i++;
+                }
+                return i;
+            }();
+            if constexpr (next == toks.size()) {
+                return cur.end;
+            } else {
+                constexpr bool may_end = next != Idx + 1;
+                const void* found = std::memchr(cur.pos, toks[next].ch, static_cast<size_t>(cur.end - cur.pos));
+                if (found != nullptr) {
+                    return static_cast<const u8*>(found);
+                }
+                if constexpr (!may_end) {
+                    throw packet_parse_error(static_cast<size_t>(cur.end - cur.begin), fmt::format("expected '{}'", toks[next].ch));
+                }
+                return cur.end;
+            }
+        }
+
+        ALWAYS_INLINE auto parse_hex(cursor& cur) -> u64
+        {
+            const u8* start = cur.pos;
+            u64 val = 0;
+            while (cur.pos != cur.end) {
+                int digit = decode_hex(*cur.pos);
+                if (digit < 0) {
+                    break;
+                }
+                if ((val >> 60) != 0) {
+                    throw packet_parse_error(static_cast<size_t>(start - cur.begin), "hex number too large");
+                }
+                val = (val << 4) | static_cast<u64>(digit);
+                cur.pos++;
+            }
+            if (cur.pos == start) {
+                throw packet_parse_error(cur.offset(), "expected hex number");
+            }
+            return val;
+        }
+
+        template<fixed_string Fmt, size_t Idx>
+        ALWAYS_INLINE auto parse_conversion(cursor& cur) -> typename conversion_value<tokens<Fmt>[Idx].kind>::type
+        {
+            constexpr token_kind kind = tokens<Fmt>[Idx].kind;
+            if constexpr (kind == token_kind::hex) {
+                return static_cast<size_t>(parse_hex(cur));
+            } else if constexpr (kind == token_kind::signed_hex) {
+                bool negative = cur.pos != cur.end && *cur.pos == '-';
+                if (negative) {
+                    cur.pos++;
+                }
+                auto mag = static_cast<int64_t>(parse_hex(cur));
+                return negative ? -mag : mag;
+            } else if constexpr (kind == token_kind::str) {
+                const u8* end = field_end<Fmt, Idx>(cur);
+                std::string_view ret(reinterpret_cast<const char*>(cur.pos), static_cast<size_t>(end - cur.pos));
+                cur.pos = end;
+                return ret;
+            } else if constexpr (kind == token_kind::hex_bytes) {
+                const u8* end = field_end<Fmt, Idx>(cur);
+                auto len = static_cast<size_t>(end - cur.pos);
+                if (len % 2 != 0) {
+                    throw packet_parse_error(cur.offset(), fmt::format("odd number of hex digits ({})", len));
+                }
+                payload_bytes ret(len / 2);
+                size_t valid = codec::hex_decode(cur.pos, len, ret.data());
+                if (valid != len) {
+                    throw packet_parse_error(cur.offset() + valid, "invalid hex digit");
+                }
+                cur.pos = end;
+                return ret;
+            } else {
+                static_assert(kind == token_kind::raw);
+                std::span<const u8> ret(cur.pos, static_cast<size_t>(cur.end - cur.pos));
+                cur.pos = cur.end;
+                return ret;
+            }
+        }
+
+        /**
+         * @brief The packet ended at an optional part, call the callback with `std::nullopt` for every remaining argument.
+         */
+        template<fixed_string Fmt, size_t Idx, typename TCallback, typename ...TVals>
+        ALWAYS_INLINE void finish_empty(TCallback& callback, TVals&&... vals)
+        {
+            if constexpr (Idx == tokens<Fmt>.size()) {
+                std::invoke(callback, std::forward<TVals>(vals)...);
+            } else if constexpr (is_conversion(tokens<Fmt>[Idx].kind)) {
+                finish_empty<Fmt, Idx + 1>(callback, std::forward<TVals>(vals)..., arg_t<Fmt, Idx>{});
+            } else {
+                finish_empty<Fmt, Idx + 1>(callback, std::forward<TVals>(vals)...);
+            }
+        }
+
+        /**
+         * @brief The fused parser: handles the token at `Idx`, then recurses (inlined) with the decoded value appended to `vals`.
+         * This way, the values never have to be stored anywhere but on the stack and are passed to the callback in order.
+         */
+        template<fixed_string Fmt, size_t Idx, typename TCallback, typename ...TVals>
+        ALWAYS_INLINE void parse_from(cursor& cur, TCallback& callback, TVals&&... vals)
+        {
+            constexpr auto& toks = tokens<Fmt>;
+            if constexpr (Idx == toks.size()) {
+                if (cur.pos != cur.end) {
+                    throw packet_parse_error(cur.offset(), "unexpected trailing characters");
+                }
+                std::invoke(callback, std::forward<TVals>(vals)...);
+            } else if constexpr (toks[Idx].kind == token_kind::literal) {
+                if (cur.pos == cur.end || *cur.pos != toks[Idx].ch) {
+                    throw packet_parse_error(cur.offset(), fmt::format("expected '{}'", toks[Idx].ch));
+                }
+                cur.pos++;
+                parse_from<Fmt, Idx + 1>(cur, callback, std::forward<TVals>(vals)...);
+            } else if constexpr (toks[Idx].kind == token_kind::optional) {
+                if (cur.pos == cur.end) {
+                    finish_empty<Fmt, Idx + 1>(callback, std::forward<TVals>(vals)...);
+                } else {
+                    parse_from<Fmt, Idx + 1>(cur, callback, std::forward<TVals>(vals)...);
+                }
+            } else {
+                parse_from<Fmt, Idx + 1>(cur, callback, std::forward<TVals>(vals)..., arg_t<Fmt, Idx>(parse_conversion<Fmt, Idx>(cur)));
+            }
+        }
+    } // namespace format
+
+    /**
+     * @brief A callback that can be called with the arguments described by `Fmt`, preceded by `TPrefix`.
+     *
+     * @tparam TCallback
+     * @tparam Fmt
+     * @tparam TPrefix
+     */
+    template<typename TCallback, fixed_string Fmt, typename ...TPrefix>
+    concept FormatCallback = format::callable_with<TCallback, format::args_t<Fmt>, TPrefix...>::value;
+
+    /**
+     * @brief Like `decode_buffer()`, but the arguments are described by a format string instead of coders.
+     *
+     * @m_class{m-block m-success}
+     * @par Example
+     * @code {.cpp}
+     parse_packet<"%x,%x:%b">(some_buf, [](size_t addr, size_t len, payload_bytes data){
+         // Callback stuff here
+     });
+     * @endcode
+     *
+     * @tparam Fmt
+     * @tparam TCallback
+     * @param buf Consumed completely, if parsing succeeds.
+     * @param callback
+     * @throws packet_parse_error if the packet does not match the format.
+     */
+    template<fixed_string Fmt, FormatCallback<Fmt> TCallback>
+    void parse_packet(buffer& buf, TCallback callback)
+    {
+        format::cursor cur { .begin = buf.read_data(), .pos = buf.read_data(), .end = buf.read_data() + buf.read_size() };
+        format::parse_from<Fmt, 0>(cur, callback);
+        buf.get_count(buf.read_size());
+    }
+} // namespace tasarch::gdb
+
+#endif /* __GDB_PACKET_FORMAT_H */
@@ -1,13 +1,19 @@
-#include <mutex>
+#include <array>
+#include <cstring>
+#include <memory>
+#include <span>
 #include <stdexcept>
+#include <utility>
 #include "gdb/common.h"
 #include "packet_io.h"  
 #include <asio/awaitable.hpp>
 #include <asio/bind_cancellation_slot.hpp>
 #include <asio/buffer.hpp>
 #include <asio/use_awaitable.hpp>
+#include <asio/write.hpp>
 #include "buffer.h"
 #include "coding.h"
+#include "packet_codec.h"
 
 namespace tasarch::gdb {
     auto PacketIO::has_buffered_data() -> bool
@@ -34,8 +40,9 @@ namespace tasarch::gdb {
         this->read_buf.reset();
 
         this->logger->trace("Receiving up to {} bytes from socket", this->read_buf.write_size());
-        size_t num = 0;
-            num = co_await awaitable_with_timeout(this->socket.async_receive(this->read_buf.write_buf<asio::mutable_buffer>(), asio::use_awaitable), this->timeout);
+        size_t num = co_await this->read_deadline.run([this](auto token) {
+            return this->socket.async_receive(this->read_buf.write_buf<asio::mutable_buffer>(), token);
+        }, this->timeout);
         this->logger->trace("Received {} bytes from socket", num);
         if (num < 1) {
             this->logger->warn("Received {} from socket!", num);
@@ -61,6 +68,139 @@ namespace tasarch::gdb {
         co_return this->read_buf.get_byte();
     }
 
+    auto PacketIO::staging_buf(size_t size) -> buffer&
+    {
+        if (this->write_buf) {
+            this->write_buf->reset();
+        }
+        if (!this->write_buf || this->write_buf->write_size() < size) {
+            this->logger->debug("Growing staging buffer to 0x{:x} bytes", size);
+            this->write_buf = std::make_unique<buffer>(size);
+        }
+        return *this->write_buf;
+    }
+
+    auto PacketIO::encode_payload(const u8* payload, size_t len, u8& checksum) -> std::array<asio::const_buffer, 2>
+    {
+        // Everything up to the first byte needing escaping (or starting a run) goes on the wire straight from the callers buffer.
+        auto clean = codec::scan_response(payload, len, this->use_rle);
+        checksum += clean.checksum;
+
+        // Only the rest, if any, has to be encoded into the staging buffer.
+        asio::const_buffer staged;
+        if (clean.size < len) {
+            size_t rest = len - clean.size;
+            buffer& staging = this->staging_buf(2 * rest);
+            auto encoded = this->use_rle ? codec::escape_rle_response(payload + clean.size, rest, staging.write_data())
+                                     : codec::escape_response(payload + clean.size, rest, staging.write_data());
+            staging.put_count(encoded.size);
+            checksum += encoded.checksum;
+            staged = asio::const_buffer(staging.read_data(), staging.read_size());
+            this->logger->trace("Staged 0x{:x} bytes for encoding, 0x{:x} bytes sent as is", rest, clean.size);
+        }
+
+        return { asio::const_buffer(payload, clean.size), staged };
+    }
+
+    auto PacketIO::write_frame(std::span<const asio::const_buffer> frame) -> asio::awaitable<void>
+    {
+        const size_t frame_size = asio::buffer_size(frame);
+        size_t num = co_await this->write_deadline.run([&](auto token) {
+            return asio::async_write(this->socket, frame, token);
+        }, this->timeout);
+        if (num != frame_size) {
+            this->logger->error("Could not send everything, wanted to send {}, only sent {}", frame_size, num);
+            // TODO: throw exception here?
+        }
+    }
+
+    auto PacketIO::lock_writes() -> asio::awaitable<void>
+    {
+        // The holder only ever writes a single packet (or a few acks), each write having its own timeout.
+        while (this->write_locked) {
+            co_await this->write_unlocked.async_receive(asio::use_awaitable);
+        }
+        this->write_locked = true;
+    }
+
+    auto PacketIO::unlock_writes() -> asio::awaitable<void>
+    {
+        try {
+            while (!this->pending_control.empty()) {
+                // More can be queued while these are on their way.
+                std::swap(this->sending_control, this->pending_control);
+                const std::array<asio::const_buffer, 1> frame = { asio::const_buffer(this->sending_control.data(), this->sending_control.size()) };
+                co_await this->write_frame(frame);
+                this->sending_control.clear();
+            }
+        } catch (...) {
+            this->sending_control.clear();
+            this->release_writes();
+            throw;
+        }
+        this->release_writes();
+    }
+
+    void PacketIO::release_writes()
+    {
+        this->write_locked = false;
+        // If the last wakeup was not picked up yet, that one is enough.
+        this->write_unlocked.try_send(asio::error_code{});
+    }
+
+    auto PacketIO::send_control(u8 c) -> asio::awaitable<void>
+    {
+        this->pending_control.push_back(static_cast<char>(c));
+        if (this->write_locked) {
+            this->logger->trace("Socket busy, queueing '{:c}'", c);
+            co_return;
+        }
+        this->write_locked = true;
+        co_await this->unlock_writes();
+    }
+
+    auto PacketIO::await_ack(bool& did_interrupt) -> asio::awaitable<bool>
+    {
+        this->logger->trace("Sent data, checking for ack now");
+
+        if (this->dedicated_reader) {
+            u8 c = 0;
+            try {
+                c = co_await this->ack_deadline.run([this](auto token) {
+                    return this->acks.async_receive(token);
+                }, this->timeout);
+            } catch (timed_out& e) {
+                this->awaiting_ack = false;
+                throw;
+            }
+            if (c == ack) {
+                this->logger->trace("got ack from reader!");
+                this->awaiting_ack = false;
+                co_return true;
+            }
+            this->logger->warn("Received ack error, retransmitting...");
+            co_return false;
+        }
+
+        while (true) {
+            u8 c = co_await this->get_byte();
+            switch (c) {
+            case break_character:
+                did_interrupt = true;
+                break;
+            case ack:
+                this->logger->trace("got ack!");
+                this->awaiting_ack = false;
+                co_return true;
+            case ack_err:
+                this->logger->warn("Received ack error, retransmitting...");
+                co_return false;
+            default:
+            break;
+            }
+        }
+    }
+
     auto PacketIO::send_packet(buffer &send_buf) -> asio::awaitable<bool>
     {
         /**
@@ -69,76 +209,125 @@ namespace tasarch::gdb {
         bool did_interrupt = false;
         this->logger->trace("sending data sized 0x{:x}", send_buf.read_size());
 
-        /**
-            * @todo make it so that we dont have to create send buffer here!
-            */
-
-        std::lock_guard lk(this->mutex);
+        size_t len = send_buf.read_size();
+        u8 checksum = 0;
+        auto [clean, staged] = this->encode_payload(send_buf.read_data(), len, checksum);
+        send_buf.get_count(len);
+
+        const std::array<char, 3> trailer = { static_cast<char>(packet_end), encode_hex(checksum >> 4), encode_hex(checksum >> 0) };
+        // send_buf is not touched by the caller until we return, so this stays valid for retransmits as well.
+        const std::array<asio::const_buffer, 4> frame = {
+            asio::const_buffer(&packet_begin_storage, 1),
+            clean,
+            staged,
+            asio::buffer(trailer),
+        };
 
-        this->logger->trace("Got lock, writing send buffer to write buffer storage...");
+        while (true) {
+            // Set before writing, the ack can be parsed before our write completes.
+            this->awaiting_ack = !no_ack;
+
+            co_await this->lock_writes();
+            try {
+                co_await this->write_frame(frame);
+            } catch (...) {
+                this->release_writes();
+                throw;
+            }
+            co_await this->unlock_writes();
 
-        this->write_buf.reset();
-        if (max_packet_expansion(send_buf.read_size()) > this->write_buf.write_size()) {
-            this->logger->error("To be sent packet is too large for our write buffer: 1 + 2*{} + 4 = {} > {}", send_buf.read_size(), max_packet_expansion(send_buf.read_size()), this->write_buf.write_size());
-            throw std::runtime_error(fmt::format("To be sent packet is too large for our write buffer: 1 + 2*{} + 4 = {} > {}", send_buf.read_size(), max_packet_expansion(send_buf.read_size()), this->write_buf.write_size()));
-        }
+            if (no_ack) {
+                co_return false;
+            }
 
-        size_t len = send_buf.read_size();
-        int checksum = 0;
-        
-        this->write_buf.put_byte(packet_begin);
-
-        // TODO: lets hope compiler optimizes this a bit lul
-        for (size_t i = 0; i < len; i++) {
-            u8 c = send_buf.get_byte();
-            if (must_escape_response(c)) {
-                this->write_buf.put_byte(escape);
-                checksum += static_cast<u8>(escape);
-                c = code_escape_char(c);
+            if (co_await this->await_ack(did_interrupt)) {
+                co_return did_interrupt;
             }
-            checksum += static_cast<u8>(c);
-            // for long packets we could otherwise overflow!
-            checksum %= 256;
-            this->write_buf.put_byte(c);
         }
-        this->write_buf.put_byte(packet_end);
-        this->write_buf.put_byte(encode_hex(checksum >> 4));
-        this->write_buf.put_byte(encode_hex(checksum >> 0));
+    }
 
-        while (true) {
+    auto PacketIO::send_streamed(packet_source& source, buffer& chunk) -> asio::awaitable<bool>
+    {
+        bool did_interrupt = false;
 
-            this->logger->trace("Done writing to write_buf_storage, sending for real...");
+        while (true) {
+            this->awaiting_ack = !no_ack;
+            source.rewind();
 
-            size_t num = co_await awaitable_with_timeout(this->socket.async_send(this->write_buf.read_buf<asio::mutable_buffer>(), asio::use_awaitable), this->timeout);
-            if (num != this->write_buf.read_size()) {
-                this->logger->error("Could not send everything, wanted to send {}, only sent {}", this->write_buf.read_size(), num);
-                // TODO: throw exception here?
+            u8 checksum = 0;
+            size_t total = 0;
+            bool first = true;
+            bool more = true;
+            // Held for all pieces, anything written in between would end up inside the packet.
+            co_await this->lock_writes();
+            try {
+                while (more) {
+                    chunk.reset();
+                    more = source.next(chunk);
+
+                    size_t len = chunk.read_size();
+                    total += len;
+                    auto [clean, staged] = this->encode_payload(chunk.read_data(), len, checksum);
+                    chunk.get_count(len);
+
+                    const std::array<char, 3> trailer = { static_cast<char>(packet_end), encode_hex(checksum >> 4), encode_hex(checksum >> 0) };
+                    const std::array<asio::const_buffer, 4> frame = {
+                        first ? asio::const_buffer(&packet_begin_storage, 1) : asio::const_buffer(),
+                        clean,
+                        staged,
+                        more ? asio::const_buffer() : asio::buffer(trailer),
+                    };
+                    first = false;
+
+                    co_await this->write_frame(frame);
+                }
+            } catch (...) {
+                this->release_writes();
+                throw;
             }
-
-            this->logger->trace("Sent data, checking for ack now: {}", this->no_ack);
+            co_await this->unlock_writes();
+            this->logger->trace("Streamed packet with 0x{:x} bytes of data", total);
 
             if (no_ack) {
                 co_return false;
             }
 
-            bool retransmit = false;
-            do {
-                u8 c = co_await this->get_byte();
-                switch (c) {
-                case break_character:
-                    did_interrupt = true;
-                    break;
-                case ack:
-                    this->logger->trace("got ack!");
-                    co_return did_interrupt;
-                case ack_err:
-                    this->logger->warn("Received ack error, retransmitting...");
-                    retransmit = true;
-                    break;
-                default:
-                break;
-                }
-            } while (!retransmit);
+            if (co_await this->await_ack(did_interrupt)) {
+                co_return did_interrupt;
+            }
+        }
+    }
+
+    void PacketIO::handle_control(u8 c)
+    {
+        if (this->dedicated_reader && (c == ack || c == ack_err)) {
+            if (!this->awaiting_ack) {
+                logger->trace("Dropping '{:c}', no response waiting for an ack", c);
+            } else if (!this->acks.try_send(asio::error_code{}, c)) {
+                logger->warn("Ack queue full, dropping '{:c}'", c);
+            }
+        } else {
+            logger->warn("Received char '{:c}' in initial state", c);
+        }
+    }
+
+    auto PacketIO::receive_control() -> asio::awaitable<bool>
+    {
+        while (true) {
+            if (!this->has_buffered_data()) {
+                co_await this->recv_data();
+                continue;
+            }
+            // The packet itself is left for `receive_packet()`.
+            u8 c = *this->read_buf.read_data();
+            if (c == packet_begin) {
+                co_return false;
+            }
+            this->read_buf.get_byte();
+            if (c == break_character) {
+                co_return true;
+            }
+            this->handle_control(c);
         }
     }
 
@@ -150,8 +339,6 @@ namespace tasarch::gdb {
                 co_await this->recv_data();
             }
 
-            std::lock_guard lk(this->mutex);
-
             if (!this->has_buffered_data() && !this->has_remote_data()) {
                 continue;
             }
@@ -171,8 +358,29 @@ namespace tasarch::gdb {
             recv_buf.reset();
 
             while (true) {
-                // this seems kinda slow, lets hope it's not actually lul
-                u8 c = co_await this->get_byte();
+                // Only suspend if we really consumed everything that was buffered.
+                if (!this->has_buffered_data()) {
+                    co_await this->recv_data();
+                    if (!this->has_buffered_data()) {
+                        this->logger->error("Failed to receive data from remote somehow!");
+                        throw std::runtime_error("failed to receive data from remote somehow");
+                    }
+                }
+
+                if (state == State::packet_data) {
+                    // Fast path: move the whole clean run up to the next `#` or `}` at once.
+                    auto run = codec::scan_request(this->read_buf.read_data(), this->read_buf.read_size());
+                    if (run.size > 0) {
+                        recv_buf.write_require(run.size);
+                        std::memcpy(recv_buf.write_data(), this->read_buf.read_data(), run.size);
+                        recv_buf.put_count(run.size);
+                        this->read_buf.get_count(run.size);
+                        checksum += run.checksum;
+                        continue;
+                    }
+                }
+
+                u8 c = this->read_buf.get_byte();
                 switch (state) {
                 case State::initial:
                 {
@@ -182,22 +390,19 @@ namespace tasarch::gdb {
                         recv_buf.reset();
                         co_return true;
                     } else {
-                        logger->warn("Received char '{:c}' in initial state", c);
+                        this->handle_control(c);
                     }
                 }
                 break;
 
                 case State::packet_data:
                 {
+                    // scan_request only stops at these two, so c is one of them.
+                    checksum += c;
                     if (c == packet_end) {
                         state = State::check_hi;
                     } else {
-                        checksum += c;
-                        if (c == escape) {
-                            state = State::escaped;
-                        } else {
-                            recv_buf.put_byte(c);
-                        }
+                        state = State::escaped;
                     }
                 }
                 break;
@@ -216,23 +421,25 @@ namespace tasarch::gdb {
 
                 case State::check_hi:
                 {
-                    csum_high = decode_hex(c);
+                    // In no-ack mode the checksum is never looked at, so dont bother decoding it.
+                    if (!no_ack) {
+                        csum_high = decode_hex(c);
+                    }
                     state = State::check_lo;
                 }
                 break;
 
                 case State::check_lo:
                 {
-                    csum_low = decode_hex(c);
                     /**
                     * @todo Looking at gdbserver source, we should check for potential interrupt after current pkt buffer. Sometimes, interrupt is apparently sent / available with a previous packet.
                     * We dont need to do this, since our gdbstub runs on a separate thread and should be looking at the new command immediately!
                     */
 
                     if (no_ack) {
-                        // TODO: count - 1 here?
                         co_return false;
                     } else {
+                        csum_low = decode_hex(c);
                         const u8 expectsum = (static_cast<u8>(csum_high) << 4) | (static_cast<u8>(csum_low) << 0);
 
                         if (csum_high < 0 || csum_low < 0 || checksum != expectsum) {
@@ -242,10 +449,10 @@ namespace tasarch::gdb {
                             csum_high = -1;
                             csum_low = -1;
                             recv_buf.reset();
-                            co_await this->socket.async_send(this->ack_err_buf, asio::use_awaitable);
+                            co_await this->send_control(ack_err);
                         } else {
                             logger->trace("Checksum matched successfully, transmitting ack");
-                            co_await this->socket.async_send(this->ack_buf, asio::use_awaitable);
+                            co_await this->send_control(ack);
                             co_return false;
                         }
                     }
@@ -5,40 +5,53 @@
 #include <chrono>
 #include <cstddef>
 #include <exception>
+#include <memory>
+#include <span>
 #include <stdexcept>
+#include <string>
 #include "util/literals.h"
 #include "asio.h"
 #include <asio.hpp>
 #include <asio/awaitable.hpp>
 #include <asio/buffer.hpp>
+#include <asio/experimental/channel.hpp>
 #include <fmt/core.h>
 #include "log/logging.h"
 #include "util/defines.h"
 #include "buffer.h"
 #include "common.h"
+#include "transport.h"
 
 using namespace std::chrono_literals;
 
 namespace tasarch::gdb {
 	/**
-	 * @brief Size of the buffer for actual command packets.
+	 * @brief Default size of the buffer for actual command packets, this is also the `PacketSize` we advertise.
 	 *
-	 * Size copied from atmosphere code, maybe we should look into what is best for our purposes?
+	 * Size copied from atmosphere code, can be changed with `gdb.packet_size` in the config.
 	 * 
 	 */
 	static constexpr size_t gdb_packet_buffer_size = 32_KB;
 
 	/**
-	 * @brief Size of the buffer for receiving on the socket (so raw data).
+	 * @brief Default size of the buffer for receiving on the socket (so raw data).
 	 *
-	 * Also copied from atmosphere code.
+	 * Also copied from atmosphere code, can be changed with `gdb.transport_buffer_size` in the config.
 	 * 
 	 */
 	static constexpr size_t gdb_transport_buffer_size = 4_KB;
 
+	/**
+	 * @brief How many acks a dedicated reader can hand over to `PacketIO::send_packet()` before it has picked them up.
+	 *
+	 * There is at most one response waiting for an ack, so this only has to absorb the odd duplicate.
+	 */
+	static constexpr size_t gdb_ack_queue_depth = 4;
+
 	/**
 	 * @brief Returns the maximum number of bytes a packet of size packet_size can blow up due to escaping and checksum, etc.
-	 * 
+	 *
+	 * `PacketIO` no longer stages whole packets, but this is still useful when you need to encode one in a single go.
 	 * It is calculated as `1 + 2*packet_size + 4` (packet_begin + escaping + checksum)
 	 * @param packet_size 
 	 * @return size_t 
@@ -61,15 +74,43 @@ namespace tasarch::gdb {
 	 */
 	constexpr u8 break_character = '\x03'; /* ctrl-c */
 
+	/**
+	 * @brief Produces the payload of a single packet piece by piece, see `PacketIO::send_streamed()`.
+	 *
+	 * Used for responses that do not fit into a packet buffer, e.g. large memory reads.
+	 */
+	class packet_source
+	{
+	public:
+		virtual ~packet_source() = default;
+
+		/**
+		 * @brief Start over from the beginning, called before every (re)transmission.
+		 */
+		virtual void rewind() = 0;
+
+		/**
+		 * @brief Put the next piece of (raw, i.e. not yet escaped) payload into `chunk`, which was reset before.
+		 *
+		 * @param chunk
+		 * @return Whether there is more to come after this piece.
+		 */
+		virtual auto next(buffer& chunk) -> bool = 0;
+	};
+
 	/**
 	 * @brief Implements the low-level transport protocol as specified by GDB.
 	 * For details see https://sourceware.org/gdb/onlinedocs/gdb/Overview.html#Overview
 	 * 
 	 * Basically, you give it a socket and you can then send and receive packets, going through the encoding mentioned in the link above.
+	 * The socket can be anything satisfying `Transport`, i.e. TCP, a unix domain socket or one end of an in-process pipe (see `make_pipe()`).
 	 *
 	 * @note Whenever we speak of request below, this means a communcation from gdb -> gdbserver, a response goes from gdbserver -> gdb (makes sense, right?).
+	 * @note One `receive_packet()` and one `send_packet()` may be in flight at the same time, as long as both run on the same strand.
+	 * See `set_dedicated_reader()` for how acks are shared between them in that case.
+	 * Only one of them writes to the socket at a time, acks sent by `receive_packet()` while a response is going out are queued until it is done.
 	 *
-	 * @todo For extra swag, make it more generic, i.e. accept stuff like a serial port as well :)
+	 * @todo For extra swag, accept stuff like a serial port as well :)
 	 */
 	class PacketIO : log::WithLogger
 	{
@@ -107,7 +148,7 @@ namespace tasarch::gdb {
 
 			/**
 			 * @brief Marks RLE bytes.
-			 * @todo Do we want to implement RLE for sending stuff?
+			 * We only send those (see `set_rle()`), gdb never uses RLE for requests.
 			 */
 			rle = '*'
 		};
@@ -149,8 +190,22 @@ namespace tasarch::gdb {
 			return c ^ 0x20;
 		}
 
-		explicit PacketIO(tcp::socket& socket) : log::WithLogger("gdb.io"),
-			socket(std::move(socket))
+		/**
+		 * @brief Takes over the given socket, which is moved from!
+		 *
+		 * @tparam TSocket
+		 * @param socket
+		 * @param transport_buffer_size How much we try to read from the socket at once.
+		 */
+		template<Transport TSocket>
+		explicit PacketIO(TSocket& socket, size_t transport_buffer_size = gdb_transport_buffer_size) : log::WithLogger("gdb.io"),
+			socket(std::move(socket)),
+			acks(this->socket.get_executor(), gdb_ack_queue_depth),
+			write_unlocked(this->socket.get_executor(), 1),
+			read_deadline(this->socket.get_executor()),
+			write_deadline(this->socket.get_executor()),
+			ack_deadline(this->socket.get_executor()),
+			read_buf(transport_buffer_size)
 		{
 			// this->read_buf_storage.fill(0);
 			// this->read_buf = asio::mutable_buffer(read_buf_storage.data(), gdb_transport_buffer_size);
@@ -158,43 +213,49 @@ namespace tasarch::gdb {
 			// this->write_buf = asio::mutable_buffer(write_buf_storage.data(), write_buf_storage.size());
 			// // current needs to be empty ya dingus!
 			// this->curr_read_buf = asio::mutable_buffer(this->read_buf.data(), 0);
-			this->ack_buf = asio::const_buffer(&ack_storage, 1);
-			this->ack_err_buf = asio::const_buffer(&ack_err_storage, 1);
 		}
 
-		/**
-		 * @brief one byte buffer containing the `ack` character.
-		 * 
-		 * Used for easy sending of acks.
-		 * 
-		 */
-		asio::const_buffer ack_buf;
-
-		/**
-		 * @brief one byte buffer containing the `nack` character.
-		 * 
-		 * Used for easy sending of nacks.
-		 * 
-		 */
-		asio::const_buffer ack_err_buf;
-
 		/**
 		 * @brief The timeout after which `receive_packet()` or `send_packet()` should throw a `timed_out` exception.
+		 * Applies to every single socket operation, not the whole packet.
 		 * While no implementation (I know of) actually does this, it makes here imo.
 		 * If one end dies, we dont want to hang forever.
 		 * Furthermore, this should always be local communication anyways, so 5 seconds is plenty of time.
 		 */
 		std::chrono::milliseconds timeout = 5000ms;
 
-		tcp::socket socket;
+		transport socket;
 
 		/**
 		 * @brief Disable sending of acks. Also disables checksum checking!
-		 * 
+		 *
+		 * `send_packet()` no longer waits for an ack either, so a response costs no extra round-trip.
+		 * There is no way back, the protocol does not allow leaving no-ack mode once entered.
 		 * See https://sourceware.org/gdb/onlinedocs/gdb/Packet-Acknowledgment.html#Packet-Acknowledgment for more.
 		 */
 		void set_no_ack() { no_ack = true; }
 
+		/**
+		 * @brief Whether `set_no_ack()` was called.
+		 */
+		[[nodiscard]] auto is_no_ack() const -> bool { return no_ack; }
+
+		/**
+		 * @brief Enable or disable run length encoding of sent packets. Disabled by default.
+		 *
+		 * See `codec::escape_rle_response()` for details.
+		 */
+		void set_rle(bool enabled) { use_rle = enabled; }
+
+		/**
+		 * @brief Tell us that someone keeps calling `receive_packet()` in a loop, concurrently to `send_packet()`.
+		 *
+		 * Only one of them can read from the socket, so `send_packet()` then stops doing so itself.
+		 * Instead, `receive_packet()` hands over any ack it sees between packets while a response is waiting for one.
+		 * Interrupts arriving during a send are reported by `receive_packet()` as well, so `send_packet()` always returns false.
+		 */
+		void set_dedicated_reader(bool enabled) { dedicated_reader = enabled; }
+
 		/**
 		 * @brief Receive the latest packet into `recv_buf` and check whether an interrupt was encountered (see `break_character`).
 		 * @throws timed_out When the timeout given by `timeout` is reached.
@@ -214,8 +275,72 @@ namespace tasarch::gdb {
 		 */
 		auto receive_packet(buffer &recv_buf) -> asio::awaitable<bool>;
 
+		/**
+		 * @brief Receive everything up to the start of the next packet, i.e. acks (see `set_dedicated_reader()`) and interrupts.
+		 *
+		 * This needs no buffer, so a dedicated reader can keep going even while it has no room for another packet.
+		 * @throws timed_out When the timeout given by `timeout` is reached.
+		 * @return asio::awaitable<bool> True if a `break_character` was encountered, false if a packet starts next.
+		 */
+		auto receive_control() -> asio::awaitable<bool>;
+
+		/**
+		 * @brief Send a single packet, whose payload is produced by `source`, without ever holding all of it in memory.
+		 *
+		 * Every piece is encoded and written as soon as `source` produced it, with the checksum carried along.
+		 * On a retransmit, `source` is rewound and everything is produced again.
+		 * @throws timed_out When the timeout given by `timeout` is reached.
+		 * @param source
+		 * @param chunk Scratch buffer `source` writes the pieces to, its size determines how much is sent at once.
+		 * @return asio::awaitable<bool> Whether a `break_character` was encountered or not.
+		 */
+		auto send_streamed(packet_source& source, buffer& chunk) -> asio::awaitable<bool>;
+
 	private:
 		bool no_ack = false;
+		bool use_rle = false;
+		bool dedicated_reader = false;
+
+		/**
+		 * @brief Set by `send_packet()` while it waits for an ack, so a dedicated reader knows to forward them.
+		 * Everything else (e.g. the `+` gdb sends upon connecting) is dropped.
+		 */
+		bool awaiting_ack = false;
+
+		/**
+		 * @brief Acks forwarded from `receive_packet()` to `send_packet()`, see `set_dedicated_reader()`.
+		 */
+		asio::experimental::channel<void(asio::error_code, u8)> acks;
+
+		/**
+		 * @brief Held by whoever writes to the socket, for a whole packet (all pieces of a streamed one) or a batch of acks.
+		 * asio does not allow starting a write while another one is in flight, and an ack in the middle of a packet would corrupt it anyways.
+		 */
+		bool write_locked = false;
+
+		/**
+		 * @brief Wakes up `lock_writes()` once the lock is released.
+		 */
+		asio::experimental::channel<void(asio::error_code)> write_unlocked;
+
+		/**
+		 * @brief Acks and nacks that still have to be sent, see `send_control()`.
+		 * Whoever holds the write lock sends them right before releasing it, i.e. always in between two packets.
+		 */
+		std::string pending_control;
+
+		/**
+		 * @brief What is currently being sent out of `pending_control`, so more can be queued in the meantime.
+		 */
+		std::string sending_control;
+
+		/**
+		 * @brief Timeouts for reading and writing, separate since a dedicated reader may be receiving while we send.
+		 * Waiting for an ack from the reader has its own, since the reader may be writing (acks of its own) at the same time.
+		 */
+		deadline read_deadline;
+		deadline write_deadline;
+		deadline ack_deadline;
 
 		/**
 		 * @brief Buffer contents received from transport layer here.
@@ -225,21 +350,67 @@ namespace tasarch::gdb {
 		// std::array<u8, gdb_transport_buffer_size> read_buf_storage{};
 		// asio::mutable_buffer curr_read_buf;
 
-		buffer read_buf = buffer(gdb_transport_buffer_size);
-		buffer write_buf = buffer(max_packet_expansion(gdb_packet_buffer_size));
+		buffer read_buf;
+
+		/**
+		 * @brief Staging area for the part of a response that needs escaping / run length encoding.
+		 * Clean payloads are sent straight from the callers buffer, so this is only allocated (and grown) once we actually need it.
+		 */
+		std::unique_ptr<buffer> write_buf;
 
 		// asio::mutable_buffer write_buf;
 		// std::array<u8, 1 + 2*gdb_packet_buffer_size + 4> write_buf_storage{};
 
-		std::mutex mutex;
-		const char ack_storage = ack;
-		const char ack_err_storage = ack_err;
+		const char packet_begin_storage = packet_begin;
 
 		auto has_buffered_data() -> bool;
 		auto has_remote_data() -> bool;
 		auto has_data() -> bool;
 		auto recv_data() -> asio::awaitable<void>;
+
+		/**
+		 * @brief Returns the (reset) staging buffer, making sure it has room for at least `size` bytes.
+		 */
+		auto staging_buf(size_t size) -> buffer&;
+
+		/**
+		 * @brief Escapes (and maybe run length encodes) `payload`, adding it to `checksum`.
+		 * @return The clean prefix, which points into `payload`, and the encoded rest, which lives in the staging buffer.
+		 */
+		auto encode_payload(const u8* payload, size_t len, u8& checksum) -> std::array<asio::const_buffer, 2>;
+		auto write_frame(std::span<const asio::const_buffer> frame) -> asio::awaitable<void>;
+
+		/**
+		 * @brief Wait until nobody else is writing to the socket, then take the write lock.
+		 */
+		auto lock_writes() -> asio::awaitable<void>;
+
+		/**
+		 * @brief Send the acks queued up in the meantime, then release the write lock.
+		 */
+		auto unlock_writes() -> asio::awaitable<void>;
+
+		/**
+		 * @brief Release the write lock without sending anything, after a write failed.
+		 */
+		void release_writes();
+
+		/**
+		 * @brief Send an ack or nack for a received packet.
+		 * If a packet is being sent right now, this only queues it and returns, so the reader never waits for a (large) response to go out.
+		 */
+		auto send_control(u8 c) -> asio::awaitable<void>;
+
+		/**
+		 * @brief Wait for the ack of the packet we just sent.
+		 * @return Whether it was acked, false means it has to be retransmitted.
+		 */
+		auto await_ack(bool& did_interrupt) -> asio::awaitable<bool>;
 		auto get_byte() -> asio::awaitable<u8>;
+		/**
+		 * @brief A byte received outside of a packet, other than an interrupt: forwards acks, warns about anything else.
+		 */
+		void handle_control(u8 c);
 	};
 } // namespace tasarch::gdb
 
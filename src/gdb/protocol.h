@@ -20,6 +20,7 @@ namespace tasarch::gdb {
 		kill = 'k',
 		read_mem = 'm',
 		write_mem = 'M',
+		read_mem_bin = 'x',
 		read_reg = 'p',
 		write_reg = 'P',
 		get = 'q',
@@ -32,8 +33,8 @@ namespace tasarch::gdb {
 		query_thd = 'T',
 		vcont = 'v',
 		write_mem_bin = 'X',
-		add_break = 'z',
-		del_break = 'Z'
+		add_break = 'Z',
+		del_break = 'z'
 	};
 
     enum query_type
@@ -1,24 +1,43 @@
 #ifndef __QUERY_HANDLER_H
 #define __QUERY_HANDLER_H
 
+#include <array>
+#include <cstring>
 #include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <fmt/core.h>
 #include "protocol.h"
 #include "coding.h"
+#include "util/function_ref.h"
 
 namespace tasarch::gdb {
+    /**
+     * @brief Describes a single query (e.g. `qSupported`), i.e. its name, what separates the name from the arguments and what to call for `q` / `Q`.
+     * Everything is `constexpr`, so the queries of a connection form a table that is built at compile time, see `query_table`.
+     *
+     * @tparam TContext Passed to the handlers, usually the connection.
+     */
+    template<typename TContext>
     struct query_handler
     {
-        std::string name;
+        std::string_view name;
+        /**
+         * @brief What follows the name, if there are arguments. `\0` means there are none, so the name has to end the packet.
+         */
         char separator = ':';
-        std::optional<std::function<void()>> get_handler = std::nullopt;
-        std::optional<std::function<void()>> set_handler = std::nullopt;
-        bool advertise = true;
+        std::optional<function_ref<void(TContext*)>> get_handler = std::nullopt;
+        std::optional<function_ref<void(TContext*)>> set_handler = std::nullopt;
+        bool advertise = false;
+        /**
+         * @brief If set, the query is only advertised in `qSupported` if this returns true, e.g. because it depends on what the target supports.
+         */
+        std::optional<function_ref<bool(TContext*)>> available = std::nullopt;
 
-        auto type() -> query_type
+        [[nodiscard]] constexpr auto type() const -> query_type
         {
             query_type typ = none;
             if (get_handler.has_value()) {
@@ -31,6 +50,150 @@ namespace tasarch::gdb {
         }
     };
 
+    /**
+     * @brief Node of the trie over all query names. Children are a singly linked list (`child`, then `sibling`), the fan out is tiny anyway.
+     */
+    struct query_trie_node
+    {
+        static constexpr u16 none = 0xffff;
+
+        char ch = '\0';
+        u16 child = none;
+        u16 sibling = none;
+        /**
+         * @brief Index of the query whose name ends here, if any.
+         */
+        u16 entry = none;
+    };
+
+    /**
+     * @brief Number of nodes needed for the trie over `entries`, i.e. the root plus every distinct prefix of a name.
+     */
+    template<typename TContext, size_t N>
+    constexpr auto query_trie_size(const std::array<query_handler<TContext>, N>& entries) -> size_t
+    {
+        size_t count = 1;
+        for (size_t i = 0; i < N; i++) {
+            for (size_t len = 1; len <= entries[i].name.size(); len++) {
+                bool seen = false;
+                for (size_t j = 0; j < i && !seen; j++) {
+                    seen = entries[j].name.size() >= len && entries[j].name.substr(0, len) == entries[i].name.substr(0, len);
+                }
+                count += seen ? 0 : 1;
+            }
+        }
+        return count;
+    }
+
+    template<size_t NumNodes, typename TContext, size_t N>
+    constexpr auto build_query_trie(const std::array<query_handler<TContext>, N>& entries) -> std::array<query_trie_node, NumNodes>
+    {
+        std::array<query_trie_node, NumNodes> nodes {};
+        size_t used = 1;
+        for (size_t i = 0; i < N; i++) {
+            u16 node = 0;
+            for (char c : entries[i].name) {
+                u16 next = nodes[node].child;
+                while (next != query_trie_node::none && nodes[next].ch != c) {
+                    next = nodes[next].sibling;
+                }
+                if (next == query_trie_node::none) {
+                    next = static_cast<u16>(used++);
+                    nodes[next].ch = c;
+                    nodes[next].sibling = nodes[node].child;
+                    nodes[node].child = next;
+                }
+                node = next;
+            }
+            if (nodes[node].entry != query_trie_node::none) {
+                throw std::invalid_argument("duplicate query name");
+            }
+            nodes[node].entry = static_cast<u16>(i);
+        }
+        return nodes;
+    }
+
+    /**
+     * @brief Looks up queries by walking the packet through a trie of all names, so every character is looked at once at most.
+     * The table itself only references the entries and nodes, which are meant to be `static constexpr` arrays (see `make_query_table()`).
+     *
+     * @tparam TContext
+     */
+    template<typename TContext>
+    class query_table
+    {
+    public:
+        struct match
+        {
+            const query_handler<TContext>* handler = nullptr;
+            /**
+             * @brief Length of the name and separator (if present), i.e. where the arguments start.
+             */
+            size_t consumed = 0;
+        };
+
+        constexpr query_table(std::span<const query_handler<TContext>> entries, std::span<const query_trie_node> nodes) : entries(entries), nodes(nodes) {}
+
+        /**
+         * @brief Find the query at the start of `packet` (without the `q` / `Q`).
+         * The name has to be followed by its separator, or end the packet if the separator is `\0`.
+         * If multiple names match (e.g. `Xfer` and `Xfer:features:read`), the longest one wins.
+         *
+         * @param packet
+         * @return match `handler` is `nullptr` if there is no such query.
+         */
+        [[nodiscard]] constexpr auto find(std::string_view packet) const -> match
+        {
+            match best;
+            u16 node = 0;
+            for (size_t i = 0;; i++) {
+                u16 entry = this->nodes[node].entry;
+                if (entry != query_trie_node::none) {
+                    const auto& handler = this->entries[entry];
+                    if (handler.separator == '\0' && i == packet.size()) {
+                        best = match { .handler = &handler, .consumed = i };
+                    } else if (handler.separator != '\0' && i < packet.size() && packet[i] == handler.separator) {
+                        best = match { .handler = &handler, .consumed = i + 1 };
+                    }
+                }
+                if (i == packet.size()) {
+                    break;
+                }
+                node = this->nodes[node].child;
+                while (node != query_trie_node::none && this->nodes[node].ch != packet[i]) {
+                    node = this->nodes[node].sibling;
+                }
+                if (node == query_trie_node::none) {
+                    break;
+                }
+            }
+            return best;
+        }
+
+        [[nodiscard]] constexpr auto all() const -> std::span<const query_handler<TContext>>
+        {
+            return this->entries;
+        }
+
+    private:
+        std::span<const query_handler<TContext>> entries;
+        std::span<const query_trie_node> nodes;
+    };
+
+    /**
+     * @brief Convenience for building a `query_table` from `static constexpr` storage, e.g.:
+     * @code {.cpp}
+     static constexpr auto entries = std::to_array<query_handler<connection>>({ ... });
+     static constexpr auto nodes = build_query_trie<query_trie_size(entries)>(entries);
+     static constexpr auto table = make_query_table(entries, nodes);
+     * @endcode
+     */
+    template<typename TContext, size_t N, size_t NumNodes>
+    constexpr auto make_query_table(const std::array<query_handler<TContext>, N>& entries, const std::array<query_trie_node, NumNodes>& nodes) -> query_table<TContext>
+    {
+        return query_table<TContext>(entries, nodes);
+    }
+
     struct feature
     {
         feature(std::string name, bool supported) : name(std::move(name)), supported(supported) {}
@@ -43,25 +206,28 @@ namespace tasarch::gdb {
     struct FeatureCoder
     {
         using value_type = feature;
-        using loc_type = std::string;
+        using loc_type = std::string_view;
 
-        static auto decode_from(loc_type& loc) -> value_type
+        static auto decode_from(loc_type loc) -> value_type
         {
+            if (loc.empty()) {
+                throw std::runtime_error("Unable to parse empty feature");
+            }
             if(loc.back() == '+' || loc.back() == '-') {
                 bool supported = loc.back() == '+';
-                return feature(loc.substr(0, loc.size()-1), supported);
+                return feature(std::string(loc.substr(0, loc.size()-1)), supported);
             }
 
             auto eq_pos = loc.find('=');
-            if (eq_pos == std::string::npos) {
+            if (eq_pos == std::string_view::npos) {
                 throw std::runtime_error(fmt::format("Unable to parse feature {}", loc));
             }
-            std::string name = loc.substr(0, eq_pos);
-            std::string value = loc.substr(eq_pos + 1);
+            std::string name(loc.substr(0, eq_pos));
+            std::string value(loc.substr(eq_pos + 1));
             return feature(name, value);
         }
 
-        static void encode_to(value_type& val, loc_type& loc)
+        static void encode_to(value_type& val, std::string& loc)
         {
             loc.append(val.name);
             if (val.value.has_value()) {
@@ -71,9 +237,29 @@ namespace tasarch::gdb {
                 loc.append(val.supported ? "+" : "-");
             }
         }
+
+        static auto encoded_size(const value_type& val) -> size_t
+        {
+            return val.name.size() + (val.value.has_value() ? 1 + val.value->size() : 1);
+        }
+
+        static auto write_to(const value_type& val, u8* dst) -> u8*
+        {
+            std::memcpy(dst, val.name.data(), val.name.size());
+            dst += val.name.size();
+            if (val.value.has_value()) {
+                *dst++ = '=';
+                std::memcpy(dst, val.value->data(), val.value->size());
+                dst += val.value->size();
+            } else {
+                *dst++ = val.supported ? '+' : '-';
+            }
+            return dst;
+        }
     };
 
     static_assert(Coding<FeatureCoder>, "Expected FeatureCoder to conform to coding!");
+    static_assert(SizedEncoding<FeatureCoder>, "Expected FeatureCoder to have a sized encoding!");
 } // namespace tasarch::gdb
 
 #endif /* __QUERY_HANDLER_H */
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <fmt/core.h>
+#include "register_cache.h"
+#include "hex_codec.h"
+
+namespace tasarch::gdb {
+    register_cache::register_cache(Debugger& target) : target(&target)
+    {
+        auto regs = target.registers();
+        this->offsets.reserve(regs.size() + 1);
+        size_t offset = 0;
+        for (const auto& reg : regs) {
+            this->offsets.push_back(offset);
+            offset += reg.size();
+        }
+        this->offsets.push_back(offset);
+        this->raw.resize(offset);
+        this->encoded.resize(2 * offset);
+        this->dirty.resize((regs.size() + 63) / 64);
+    }
+
+    auto register_cache::hex() -> std::string_view
+    {
+        this->fill();
+        return {this->encoded.data(), this->encoded.size()};
+    }
+
+    auto register_cache::hex(size_t idx) -> std::string_view
+    {
+        this->check_index(idx);
+        this->fill();
+        size_t offset = this->offsets[idx];
+        return {this->encoded.data() + 2 * offset, 2 * (this->offsets[idx + 1] - offset)};
+    }
+
+    void register_cache::write(std::span<const u8> data)
+    {
+        if (data.size() != this->raw.size()) {
+            throw std::invalid_argument(fmt::format("expected 0x{:x} bytes of registers, got 0x{:x}", this->raw.size(), data.size()));
+        }
+        std::copy(data.begin(), data.end(), this->raw.begin());
+        this->encode(0, this->raw.size());
+        // Nothing left to read, the whole snapshot is ours now.
+        this->is_valid = true;
+        for (size_t i = 0; i + 1 < this->offsets.size(); i++) {
+            this->mark_dirty(i);
+        }
+    }
+
+    void register_cache::write(size_t idx, std::span<const u8> data)
+    {
+        this->check_index(idx);
+        size_t offset = this->offsets[idx];
+        size_t len = this->offsets[idx + 1] - offset;
+        if (data.size() != len) {
+            throw std::invalid_argument(fmt::format("register {} has 0x{:x} bytes, got 0x{:x}", this->target->registers()[idx].name, len, data.size()));
+        }
+        // The rest of the snapshot has to be valid too, it is served as a whole.
+        this->fill();
+        std::copy(data.begin(), data.end(), this->raw.begin() + static_cast<ptrdiff_t>(offset));
+        this->encode(offset, len);
+        this->mark_dirty(idx);
+    }
+
+    auto register_cache::dirty_count() const -> size_t
+    {
+        size_t count = 0;
+        for (u64 word : this->dirty) {
+            count += static_cast<size_t>(std::popcount(word));
+        }
+        return count;
+    }
+
+    void register_cache::flush()
+    {
+        size_t count = this->dirty_count();
+        if (count == 0) {
+            return;
+        }
+        if (count == this->offsets.size() - 1) {
+            this->target->write_registers(this->raw);
+        } else {
+            for (size_t word = 0; word < this->dirty.size(); word++) {
+                for (u64 bits = this->dirty[word]; bits != 0; bits &= bits - 1) {
+                    size_t idx = 64 * word + static_cast<size_t>(std::countr_zero(bits));
+                    size_t offset = this->offsets[idx];
+                    this->target->write_register(idx, std::span<const u8>(this->raw).subspan(offset, this->offsets[idx + 1] - offset));
+                }
+            }
+        }
+        std::fill(this->dirty.begin(), this->dirty.end(), 0);
+    }
+
+    void register_cache::invalidate()
+    {
+        this->flush();
+        this->is_valid = false;
+    }
+
+    void register_cache::fill()
+    {
+        if (this->is_valid) {
+            return;
+        }
+        this->target->read_registers(this->raw);
+        this->encode(0, this->raw.size());
+        this->is_valid = true;
+        this->num_fills++;
+    }
+
+    void register_cache::check_index(size_t idx) const
+    {
+        if (idx + 1 >= this->offsets.size()) {
+            throw std::out_of_range(fmt::format("no register 0x{:x}, only have {}", idx, this->offsets.size() - 1));
+        }
+    }
+
+    void register_cache::encode(size_t offset, size_t len)
+    {
+        codec::hex_encode(this->raw.data() + offset, len, reinterpret_cast<u8*>(this->encoded.data() + 2 * offset));
+    }
+
+    void register_cache::mark_dirty(size_t idx)
+    {
+        this->dirty[idx / 64] |= u64{1} << (idx % 64);
+    }
+} // namespace tasarch::gdb
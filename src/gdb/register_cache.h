@@ -0,0 +1,101 @@
+/**
+ * @file register_cache.h
+ * @brief Snapshot of the target's registers while it is stopped, behind `g`, `G`, `p` and `P`.
+ *
+ * gdb reads the whole register file after every stop (and IDA reads them one by one with `p`), but registers can only change while the target runs.
+ * So they are read and hex encoded once per stop and every read afterwards is served straight from the encoded snapshot.
+ * Writes only update the snapshot and mark the registers as dirty, they are written back to the target in one go, right before it resumes.
+ */
+#ifndef __GDB_REGISTER_CACHE_H
+#define __GDB_REGISTER_CACHE_H
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "debugger.h"
+#include "util/defines.h"
+
+namespace tasarch::gdb {
+    class register_cache
+    {
+    public:
+        /**
+         * @brief Caches the registers of `target`, which has to outlive the cache.
+         * All storage is allocated here, filling and serving the cache never allocates.
+         */
+        explicit register_cache(Debugger& target);
+
+        /**
+         * @brief All registers hex encoded, as the reply to `g`. Reads them from the target if there is no snapshot yet.
+         * @warning Only valid until the next call that modifies the cache.
+         */
+        auto hex() -> std::string_view;
+
+        /**
+         * @brief Register `idx` hex encoded, as the reply to `p`.
+         * @throws std::out_of_range if there is no such register.
+         */
+        auto hex(size_t idx) -> std::string_view;
+
+        /**
+         * @brief Set all registers (`G`), laid out like for `Debugger::read_registers()`.
+         * @throws std::invalid_argument if `data` does not have the size of all registers together.
+         */
+        void write(std::span<const u8> data);
+
+        /**
+         * @brief Set register `idx` (`P`).
+         * @throws std::out_of_range if there is no such register.
+         * @throws std::invalid_argument if `data` does not have the size of the register.
+         */
+        void write(size_t idx, std::span<const u8> data);
+
+        /**
+         * @brief Write all dirty registers back to the target, all at once if every register is dirty.
+         */
+        void flush();
+
+        /**
+         * @brief The target is about to run: flushes and drops the snapshot, so the next read fetches the registers again.
+         */
+        void invalidate();
+
+        [[nodiscard]] auto valid() const -> bool
+        {
+            return this->is_valid;
+        }
+
+        [[nodiscard]] auto dirty_count() const -> size_t;
+
+        /**
+         * @brief How often the registers were actually read from the target, mostly for tests.
+         */
+        [[nodiscard]] auto fills() const -> size_t
+        {
+            return this->num_fills;
+        }
+
+    private:
+        void fill();
+        void check_index(size_t idx) const;
+        void encode(size_t offset, size_t len);
+        void mark_dirty(size_t idx);
+
+        Debugger* target;
+        /**
+         * @brief Offset of every register in `raw`, with the total size as the last entry.
+         */
+        std::vector<size_t> offsets;
+        std::vector<u8> raw;
+        std::vector<char> encoded;
+        /**
+         * @brief One bit per register.
+         */
+        std::vector<u64> dirty;
+        bool is_valid = false;
+        size_t num_fills = 0;
+    };
+} // namespace tasarch::gdb
+
+#endif /* __GDB_REGISTER_CACHE_H */
@@ -1,3 +1,4 @@
+#include <filesystem>
 #include <memory>
 #include <mutex>
 #include "server.h"  
@@ -5,21 +6,22 @@
 #include <asio/buffer.hpp>
 #include <asio/co_spawn.hpp>
 #include <asio/detached.hpp>
-#include <asio/ip/tcp.hpp>
 #include <asio/use_awaitable.hpp>
 #include "bg_executor.h"
+#include "buffer_pool.h"
 
 namespace tasarch::gdb {
-    void server::start()
+    void server::start(std::string_view address)
     {
         std::lock_guard lock(run_mutex);
         if (this->running) {
             logger->warn("Server already started!");
         }
+        this->address = listen_address::parse(address);
         this->running = true;
-        logger->info("Starting gdbstub on port {}", this->port);
+        logger->info("Starting gdbstub on {}", this->address.to_string());
         asio::co_spawn(bg_executor::instance().io_context,
-                this->accept_connection(asio::ip::tcp::acceptor(bg_executor::instance().io_context, {asio::ip::tcp::v4(), this->port})),
+                this->accept_connection(make_acceptor(bg_executor::instance().io_context, this->address)),
                 asio::detached);
     }
 
@@ -37,26 +39,40 @@ namespace tasarch::gdb {
             conn->stop();
         }
         this->connections.clear();
-        
+
+        if (this->address.type == listen_address::kind::unix_socket) {
+            std::error_code ec;
+            std::filesystem::remove(this->address.path, ec);
+        }
+
         this->running = false;
     }
 
-    auto server::accept_connection(asio::ip::tcp::acceptor acceptor) -> asio::awaitable<void>
+    auto server::accept_connection(transport_acceptor acceptor) -> asio::awaitable<void>
     {
         this->logger->info("Starting accepting of connections...");
         while (this->running) {
             /**
              * @todo Cancellation slot here!
              */
-            auto tcp_conn = co_await acceptor.async_accept(asio::use_awaitable);
-            this->logger->info("Accepted connection from {}", tcp_conn.remote_endpoint());
+            auto sock = co_await acceptor.async_accept(asio::use_awaitable);
+            this->logger->info("Accepted connection from {}", describe_endpoint(sock.remote_endpoint()));
 
             {
                 std::lock_guard lk(run_mutex);
-                auto conn = std::make_shared<connection>(std::move(tcp_conn), this->debugger);
+                auto conn = std::make_shared<connection>(std::move(sock), this->debugger);
                 this->connections.push_back(std::shared_ptr<connection>(conn));
                 conn->start();
             }
+
+            auto pool = buffer_pool::shared().stats();
+            size_t in_use = pool.oversized_in_use;
+            size_t idle = 0;
+            for (const auto& cls : pool.classes) {
+                in_use += cls.in_use;
+                idle += cls.idle;
+            }
+            this->logger->debug("Buffer pool: {} blocks in use, {} idle, 0x{:x} bytes total", in_use, idle, pool.total_bytes());
         }
     }
 } // namespace tasarch::gdb
@@ -3,6 +3,7 @@
 
 #include "connection.h"
 #include <mutex>
+#include <string_view>
 #include <utility>
 #include <vector>
 #include "log/logging.h"
@@ -12,23 +13,35 @@
 #include <asio/io_context.hpp>
 #include <asio/ip/basic_endpoint.hpp>
 #include "debugger.h"
+#include "transport.h"
 
 namespace tasarch::gdb {
 	class server : log::WithLogger
 	{
 	public:
 		explicit server(std::shared_ptr<Debugger> debugger) : log::WithLogger("gdb.server"), debugger(std::move(debugger)) {}
-		asio::ip::port_type port = 5555;
 
-		void start();
+		/**
+		 * @brief Listen address used if none is given, i.e. the same port as before.
+		 */
+		static constexpr std::string_view default_address = "tcp:5555";
+
+		/**
+		 * @brief Start listening for connections on the given address.
+		 * @throws std::invalid_argument If the address is malformed, see `listen_address::parse()` for what is accepted.
+		 *
+		 * @param address E.g. `tcp:127.0.0.1:5555` or `unix:/run/tasarch.sock`.
+		 */
+		void start(std::string_view address = default_address);
 		void stop();
 
-		auto accept_connection(asio::ip::tcp::acceptor acceptor) -> asio::awaitable<void>;
+		auto accept_connection(transport_acceptor acceptor) -> asio::awaitable<void>;
 
 	private:
 		std::vector<std::shared_ptr<connection>> connections;
 		std::mutex run_mutex;
 		bool running = false;
+		listen_address address;
 		std::shared_ptr<Debugger> debugger;
 	};
 } // namespace tasarch::gdb
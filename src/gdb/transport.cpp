@@ -0,0 +1,151 @@
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include "transport.h"
+#include <asio/local/connect_pair.hpp>
+#include <asio/local/stream_protocol.hpp>
+#include <fmt/core.h>
+
+namespace tasarch::gdb {
+    namespace {
+        constexpr std::string_view unix_prefix = "unix:";
+        constexpr std::string_view tcp_prefix = "tcp:";
+
+        auto parse_port(std::string_view port, std::string_view address) -> asio::ip::port_type
+        {
+            asio::ip::port_type res = 0;
+            auto [ptr, ec] = std::from_chars(port.data(), port.data() + port.size(), res);
+            if (port.empty() || ec != std::errc() || ptr != port.data() + port.size()) {
+                throw std::invalid_argument(fmt::format("invalid port '{}' in listen address '{}'", port, address));
+            }
+            return res;
+        }
+
+        auto parse_host(std::string_view host, std::string_view address) -> asio::ip::address
+        {
+            if (host.empty() || host == "*") {
+                return asio::ip::address_v4::any();
+            }
+            if (host == "localhost") {
+                return asio::ip::address_v4::loopback();
+            }
+            // [::1] style IPv6 addresses
+            if (host.front() == '[' && host.back() == ']') {
+                host = host.substr(1, host.size() - 2);
+            }
+            asio::error_code ec;
+            auto res = asio::ip::make_address(std::string(host), ec);
+            if (ec) {
+                throw std::invalid_argument(fmt::format("invalid host '{}' in listen address '{}': {}", host, address, ec.message()));
+            }
+            return res;
+        }
+    } // namespace
+
+    auto listen_address::parse(std::string_view address) -> listen_address
+    {
+        listen_address res;
+        if (address.starts_with(unix_prefix)) {
+            if constexpr (!has_local_transport) {
+                throw std::invalid_argument(fmt::format("unix sockets are not supported on this platform, cannot listen on '{}'", address));
+            }
+            res.type = kind::unix_socket;
+            res.path = address.substr(unix_prefix.size());
+            if (res.path.empty()) {
+                throw std::invalid_argument(fmt::format("missing path in listen address '{}'", address));
+            }
+            return res;
+        }
+
+        std::string_view rest = address.starts_with(tcp_prefix) ? address.substr(tcp_prefix.size()) : address;
+        // rfind, so that the colons of IPv6 addresses are part of the host.
+        size_t sep = rest.rfind(':');
+        if (sep == std::string_view::npos) {
+            res.tcp_endpoint = asio::ip::tcp::endpoint(asio::ip::address_v4::any(), parse_port(rest, address));
+        } else {
+            res.tcp_endpoint = asio::ip::tcp::endpoint(parse_host(rest.substr(0, sep), address), parse_port(rest.substr(sep + 1), address));
+        }
+        return res;
+    }
+
+    auto listen_address::endpoint() const -> asio::generic::stream_protocol::endpoint
+    {
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+        if (this->type == kind::unix_socket) {
+            return asio::local::stream_protocol::endpoint(this->path);
+        }
+#endif
+        return this->tcp_endpoint;
+    }
+
+    auto listen_address::to_string() const -> std::string
+    {
+        if (this->type == kind::unix_socket) {
+            return fmt::format("{}{}", unix_prefix, this->path);
+        }
+        auto addr = this->tcp_endpoint.address();
+        if (addr.is_v6()) {
+            return fmt::format("{}[{}]:{}", tcp_prefix, addr.to_string(), this->tcp_endpoint.port());
+        }
+        return fmt::format("{}{}:{}", tcp_prefix, addr.to_string(), this->tcp_endpoint.port());
+    }
+
+    auto make_acceptor(asio::io_context& ctx, const listen_address& address) -> transport_acceptor
+    {
+        auto endpoint = address.endpoint();
+        transport_acceptor acceptor(ctx);
+        acceptor.open(endpoint.protocol());
+        if (address.type == listen_address::kind::unix_socket) {
+            std::error_code ec;
+            if (std::filesystem::is_socket(address.path, ec)) {
+                std::filesystem::remove(address.path, ec);
+            }
+        } else {
+            // same as the tcp::acceptor constructor does
+            acceptor.set_option(transport_acceptor::reuse_address(true));
+        }
+        acceptor.bind(endpoint);
+        acceptor.listen();
+        return acceptor;
+    }
+
+    auto make_pipe(asio::io_context& ctx) -> std::pair<transport, transport>
+    {
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+        asio::local::stream_protocol::socket first(ctx);
+        asio::local::stream_protocol::socket second(ctx);
+        asio::local::connect_pair(first, second);
+        return std::make_pair(transport(std::move(first)), transport(std::move(second)));
+#else
+        throw std::runtime_error("in-process pipes need unix socket support, which this platform does not have");
+#endif
+    }
+
+    auto describe_endpoint(const asio::generic::stream_protocol::endpoint& endpoint) -> std::string
+    {
+        const auto* addr = endpoint.data();
+        switch (addr->sa_family) {
+        case AF_INET:
+        case AF_INET6:
+        {
+            asio::ip::tcp::endpoint tcp_endpoint;
+            std::memcpy(tcp_endpoint.data(), addr, endpoint.size());
+            return fmt::format("{}{}:{}", tcp_prefix, tcp_endpoint.address().to_string(), tcp_endpoint.port());
+        }
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+        case AF_UNIX:
+        {
+            asio::local::stream_protocol::endpoint local_endpoint;
+            local_endpoint.resize(endpoint.size());
+            std::memcpy(local_endpoint.data(), addr, endpoint.size());
+            // the client end of a unix socket (and both ends of a pipe) is unnamed.
+            std::string path = local_endpoint.path();
+            return fmt::format("{}{}", unix_prefix, path.empty() ? "<unnamed>" : path);
+        }
+#endif
+        default:
+            return fmt::format("<family {}>", addr->sa_family);
+        }
+    }
+} // namespace tasarch::gdb
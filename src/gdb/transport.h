@@ -0,0 +1,135 @@
+/**
+ * @file transport.h
+ * @brief The byte streams the gdb protocol can run over (TCP, unix domain sockets and in-process pipes).
+ *
+ * All of them end up as a `transport`, i.e. a generic stream socket, so `PacketIO` and `connection` do not care what is actually underneath.
+ * Local sessions (gdb / IDA on the same machine, or our tests) can then skip the TCP stack entirely.
+ */
+#ifndef __GDB_TRANSPORT_H
+#define __GDB_TRANSPORT_H
+
+#include <concepts>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "asio.h"
+#include <asio.hpp>
+#include <asio/generic/stream_protocol.hpp>
+#include <asio/ip/tcp.hpp>
+#include "util/defines.h"
+
+namespace tasarch::gdb {
+    /**
+     * @brief Socket type used for everything the gdb protocol runs over.
+     */
+    using transport = asio::generic::stream_protocol::socket;
+
+    /**
+     * @brief Acceptor handing out `transport`s, regardless of whether it listens on TCP or a unix domain socket.
+     */
+    using transport_acceptor = asio::basic_socket_acceptor<asio::generic::stream_protocol>;
+
+    /**
+     * @concept Transport
+     * @brief Any asio stream socket that can be turned into a `transport`, e.g. `tcp::socket` or `local::stream_protocol::socket`.
+     *
+     * @tparam TSocket
+     */
+    template<typename TSocket>
+    concept Transport = std::constructible_from<transport, TSocket&&> && requires(TSocket sock) {
+        {sock.available()} -> std::convertible_to<size_t>;
+    };
+
+    /**
+     * @brief Whether this build supports unix domain sockets (and hence in-process pipes).
+     */
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    constexpr bool has_local_transport = true;
+#else
+    constexpr bool has_local_transport = false;
+#endif
+
+    /**
+     * @brief Where a `server` should listen for connections.
+     *
+     * Parsed from strings like:
+     * - `unix:/run/tasarch.sock`: unix domain socket at the given path.
+     * - `tcp:127.0.0.1:5555`, `tcp:[::1]:5555`: TCP on the given address and port.
+     * - `tcp:5555` or just `5555`: TCP on all IPv4 interfaces.
+     */
+    struct listen_address
+    {
+        enum class kind : u8
+        {
+            tcp,
+            unix_socket,
+        };
+
+        kind type = kind::tcp;
+
+        /**
+         * @brief The TCP endpoint to listen on, only valid if `type == kind::tcp`.
+         */
+        asio::ip::tcp::endpoint tcp_endpoint{asio::ip::tcp::v4(), 5555};
+
+        /**
+         * @brief Path of the socket file, only valid if `type == kind::unix_socket`.
+         */
+        std::string path;
+
+        /**
+         * @brief Parse an address as described above.
+         * @throws std::invalid_argument If the address is malformed, or unix sockets are not supported.
+         *
+         * @param address
+         * @return listen_address
+         */
+        static auto parse(std::string_view address) -> listen_address;
+
+        /**
+         * @brief The generic endpoint, which can be used with a `transport_acceptor`.
+         *
+         * @return asio::generic::stream_protocol::endpoint
+         */
+        [[nodiscard]] auto endpoint() const -> asio::generic::stream_protocol::endpoint;
+
+        /**
+         * @brief Formats the address back into the form accepted by `parse()`.
+         *
+         * @return std::string
+         */
+        [[nodiscard]] auto to_string() const -> std::string;
+    };
+
+    /**
+     * @brief Open, bind and listen on the given address.
+     *
+     * For unix sockets, a stale socket file at the path (e.g. left over after a crash) is removed first.
+     *
+     * @param ctx
+     * @param address
+     * @return transport_acceptor
+     */
+    auto make_acceptor(asio::io_context& ctx, const listen_address& address) -> transport_acceptor;
+
+    /**
+     * @brief Creates an in-process duplex pipe, i.e. two connected `transport`s. Anything sent on one end, can be received on the other.
+     *
+     * Backed by `socketpair(2)`, so there is no port to bind and nothing touches the network stack.
+     * @throws std::runtime_error If unix sockets are not supported (see `has_local_transport`).
+     *
+     * @param ctx
+     * @return std::pair<transport, transport>
+     */
+    auto make_pipe(asio::io_context& ctx) -> std::pair<transport, transport>;
+
+    /**
+     * @brief Human readable description of an endpoint, e.g. `tcp:127.0.0.1:1234` or `unix:/run/tasarch.sock`.
+     *
+     * @param endpoint
+     * @return std::string
+     */
+    auto describe_endpoint(const asio::generic::stream_protocol::endpoint& endpoint) -> std::string;
+} // namespace tasarch::gdb
+
+#endif /* __GDB_TRANSPORT_H */
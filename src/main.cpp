@@ -37,7 +37,7 @@ auto main(int argc, char* argv[]) -> int
     tasarch::gdb::bg_executor::instance().start();
 
     auto server = std::make_shared<tasarch::gdb::server>(nullptr);
-    server->start();
+    server->start(tasarch::config::conf()->gdb.address);
     while (true) {
         std::this_thread::sleep_for(std::chrono::milliseconds(1000));
     }
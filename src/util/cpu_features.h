@@ -0,0 +1,126 @@
+/**
+ * @file cpu_features.h
+ * @brief Runtime detection of the SIMD instruction sets our hot loops can make use of.
+ *
+ * Kernels are compiled for several instruction sets at once (using `__attribute__((target(...)))`),
+ * the best one is then picked at runtime with the helpers below.
+ * This way, the binary still runs on older cpus (or non x86 ones), while being fast on newer ones.
+ */
+#ifndef __UTIL_CPU_FEATURES_H
+#define __UTIL_CPU_FEATURES_H
+
+#include <stdexcept>
+#include <string_view>
+#include <fmt/core.h>
+#include "defines.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TASARCH_X86 1
+#else
+#define TASARCH_X86 0
+#endif
+
+/**
+ * @brief Marks a function as being compiled for the given instruction set(s), e.g. `TARGET_SIMD("avx2")`.
+ * @note Only use this for functions that are called after checking `simd_supported()`!
+ */
+#define TARGET_SIMD(isa) __attribute__((target(isa)))
+
+namespace tasarch::cpu {
+    /**
+     * @brief The different levels of SIMD support we have kernels for.
+     * Ordered, so that a higher level usually implies the lower ones are available as well.
+     */
+    enum class simd_level : u8
+    {
+        scalar = 0,
+        sse2,
+        /**
+         * @brief Mostly interesting for `pshufb`, which makes for a nice 16 entry lookup table (e.g. hex encoding).
+         */
+        ssse3,
+        avx2,
+    };
+
+    /**
+     * @brief Whether the cpu we are running on supports the given level.
+     *
+     * @param level
+     * @return true
+     * @return false
+     */
+    inline auto simd_supported(simd_level level) -> bool
+    {
+#if TASARCH_X86
+        // might be called during static initialization, before libgcc had a chance to do this.
+        __builtin_cpu_init();
+        switch (level) {
+        case simd_level::scalar:
+            return true;
+        case simd_level::sse2:
+            return __builtin_cpu_supports("sse2");
+        case simd_level::ssse3:
+            return __builtin_cpu_supports("ssse3");
+        case simd_level::avx2:
+            return __builtin_cpu_supports("avx2");
+        }
+        return false;
+#else
+        return level == simd_level::scalar;
+#endif
+    }
+
+    /**
+     * @brief The best level supported by the current cpu. Detected once and then cached.
+     *
+     * @return simd_level
+     */
+    inline auto best_simd_level() -> simd_level
+    {
+        static const simd_level best = []{
+            for (auto level : {simd_level::avx2, simd_level::ssse3, simd_level::sse2}) {
+                if (simd_supported(level)) {
+                    return level;
+                }
+            }
+            return simd_level::scalar;
+        }();
+        return best;
+    }
+
+    /**
+     * @brief Human readable name of the level, mostly for logging and benchmarks.
+     *
+     * @param level
+     * @return std::string_view
+     */
+    constexpr auto simd_name(simd_level level) -> std::string_view
+    {
+        switch (level) {
+        case simd_level::scalar:
+            return "scalar";
+        case simd_level::sse2:
+            return "sse2";
+        case simd_level::ssse3:
+            return "ssse3";
+        case simd_level::avx2:
+            return "avx2";
+        }
+        return "unknown";
+    }
+
+    /**
+     * @brief For picking a kernel by hand (e.g. tests and benchmarks), which must not run one the cpu cannot execute.
+     * @throws std::invalid_argument If the current cpu does not support `level`.
+     *
+     * @param level
+     */
+    inline void require_supported(simd_level level)
+    {
+        if (!simd_supported(level)) {
+            throw std::invalid_argument(fmt::format("SIMD level {} is not supported by this cpu", simd_name(level)));
+        }
+    }
+} // namespace tasarch::cpu
+
+#endif /* __UTIL_CPU_FEATURES_H */
@@ -0,0 +1,75 @@
+/**
+ * @file function_ref.h
+ * @brief A non owning, non allocating reference to something callable, like the proposed `std::function_ref`.
+ */
+#ifndef __UTIL_FUNCTION_REF_H
+#define __UTIL_FUNCTION_REF_H
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace tasarch {
+    /**
+     * @brief Tag for binding a `function_ref` to a callable known at compile time, e.g. `function_ref<void(conn*)>(nontype<&conn::handle>)`.
+     *
+     * @tparam F
+     */
+    template<auto F>
+    struct nontype_t
+    {
+        explicit nontype_t() = default;
+    };
+
+    template<auto F>
+    inline constexpr nontype_t<F> nontype {};
+
+    template<typename TSignature>
+    class function_ref;
+
+    /**
+     * @brief Two pointers: the object (if any) and a thunk, that knows how to call it.
+     *
+     * In contrast to `std::function`, nothing is ever copied or allocated.
+     * When constructed from an object, the object must outlive the `function_ref`.
+     * When constructed from `nontype<F>`, there is no object at all and the `function_ref` can be `constexpr` (e.g. in dispatch tables).
+     *
+     * @tparam R
+     * @tparam TArgs
+     */
+    template<typename R, typename ...TArgs>
+    class function_ref<R(TArgs...)>
+    {
+    public:
+        template<typename F>
+            requires (!std::is_same_v<std::remove_cvref_t<F>, function_ref> && std::is_invocable_r_v<R, F&, TArgs...>)
+        // NOLINTNEXTLINE: implicit on purpose, just like std::function.
+        constexpr function_ref(F& func) noexcept :
+            obj(const_cast<void*>(static_cast<const void*>(std::addressof(func)))),
+            thunk([](void* obj, TArgs... args) -> R {
+                return std::invoke(*static_cast<std::add_pointer_t<F>>(obj), std::forward<TArgs>(args)...);
+            })
+        {}
+
+        template<auto F>
+            requires std::is_invocable_r_v<R, decltype(F), TArgs...>
+        // NOLINTNEXTLINE: implicit on purpose.
+        constexpr function_ref(nontype_t<F> /*tag*/) noexcept :
+            thunk([](void* /*obj*/, TArgs... args) -> R {
+                return std::invoke(F, std::forward<TArgs>(args)...);
+            })
+        {}
+
+        constexpr auto operator()(TArgs... args) const -> R
+        {
+            return this->thunk(this->obj, std::forward<TArgs>(args)...);
+        }
+
+    private:
+        void* obj = nullptr;
+        R (*thunk)(void*, TArgs...);
+    };
+} // namespace tasarch
+
+#endif /* __UTIL_FUNCTION_REF_H */
@@ -0,0 +1,243 @@
+/**
+ * @file small_vector.h
+ * @brief A vector with inline storage for the first few elements, so small payloads never touch the heap.
+ */
+#ifndef __UTIL_SMALL_VECTOR_H
+#define __UTIL_SMALL_VECTOR_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "concepts.h"
+#include "defines.h"
+
+namespace tasarch {
+    /**
+     * @brief Like `std::vector`, but the first `N` elements are stored inside the object itself.
+     *
+     * Only once more than `N` elements are needed, the data is moved to the heap.
+     * Moving a heap allocated `small_vector` just steals the allocation, moving an inline one copies at most `N` elements.
+     * Since this is meant for raw data (e.g. memory payloads), elements have to be trivially copyable and are copied with `memcpy`.
+     *
+     * @note Like `std::vector::resize()`, `resize()` value initializes new elements.
+     *
+     * @tparam T
+     * @tparam N Number of elements stored inline.
+     */
+    template<typename T, size_t N>
+        requires std::is_trivially_copyable_v<T>
+    class small_vector
+    {
+    public:
+        using value_type = T;
+        using size_type = size_t;
+        using difference_type = std::ptrdiff_t;
+        using reference = T&;
+        using const_reference = const T&;
+        using pointer = T*;
+        using const_pointer = const T*;
+        using iterator = T*;
+        using const_iterator = const T*;
+
+        static constexpr size_type inline_capacity = N;
+
+        small_vector() = default;
+
+        explicit small_vector(size_type count)
+        {
+            this->resize(count);
+        }
+
+        small_vector(const T* src, size_type count)
+        {
+            this->assign(src, count);
+        }
+
+        small_vector(std::initializer_list<T> init)
+        {
+            this->assign(init.begin(), init.size());
+        }
+
+        small_vector(const small_vector& other)
+        {
+            this->assign(other.data(), other.size());
+        }
+
+        small_vector(small_vector&& other) noexcept
+        {
+            this->take(std::move(other));
+        }
+
+        auto operator=(const small_vector& other) -> small_vector&
+        {
+            if (this != &other) {
+                this->assign(other.data(), other.size());
+            }
+            return *this;
+        }
+
+        auto operator=(small_vector&& other) noexcept -> small_vector&
+        {
+            if (this != &other) {
+                this->heap.reset();
+                this->take(std::move(other));
+            }
+            return *this;
+        }
+
+        ~small_vector() = default;
+
+        [[nodiscard]] auto size() const -> size_type
+        {
+            return this->count;
+        }
+
+        [[nodiscard]] auto max_size() const -> size_type
+        {
+            return std::numeric_limits<size_type>::max() / sizeof(T);
+        }
+
+        [[nodiscard]] auto capacity() const -> size_type
+        {
+            return this->heap ? this->heap_capacity : N;
+        }
+
+        [[nodiscard]] auto empty() const -> bool
+        {
+            return this->count == 0;
+        }
+
+        /**
+         * @brief Whether the elements are still stored inside the object, i.e. nothing was allocated.
+         */
+        [[nodiscard]] auto is_inline() const -> bool
+        {
+            return !this->heap;
+        }
+
+        auto data() -> T*
+        {
+            return this->heap ? this->heap.get() : this->storage.data();
+        }
+
+        auto data() const -> const T*
+        {
+            return this->heap ? this->heap.get() : this->storage.data();
+        }
+
+        auto begin() -> iterator { return this->data(); }
+        auto end() -> iterator { return this->data() + this->count; }
+        auto begin() const -> const_iterator { return this->data(); }
+        auto end() const -> const_iterator { return this->data() + this->count; }
+
+        auto operator[](size_type idx) -> T&
+        {
+            return this->data()[idx];
+        }
+
+        auto operator[](size_type idx) const -> const T&
+        {
+            return this->data()[idx];
+        }
+
+        /**
+         * @throws std::out_of_range if `idx >= size()`.
+         */
+        auto at(size_type idx) -> T&
+        {
+            if (idx >= this->count) {
+                throw std::out_of_range("small_vector index out of range");
+            }
+            return this->data()[idx];
+        }
+
+        auto at(size_type idx) const -> const T&
+        {
+            if (idx >= this->count) {
+                throw std::out_of_range("small_vector index out of range");
+            }
+            return this->data()[idx];
+        }
+
+        void reserve(size_type cap)
+        {
+            if (cap <= this->capacity()) {
+                return;
+            }
+            auto grown = std::make_unique_for_overwrite<T[]>(cap);
+            std::memcpy(grown.get(), this->data(), this->count * sizeof(T));
+            this->heap = std::move(grown);
+            this->heap_capacity = cap;
+        }
+
+        void resize(size_type num)
+        {
+            this->reserve(num);
+            if (num > this->count) {
+                std::uninitialized_value_construct(this->data() + this->count, this->data() + num);
+            }
+            this->count = num;
+        }
+
+        void push_back(const T& elem)
+        {
+            if (this->count == this->capacity()) {
+                // elem might live in our storage, which reserve() is about to free.
+                T copy = elem;
+                this->reserve(std::max<size_type>(2 * this->capacity(), 1));
+                this->data()[this->count++] = copy;
+                return;
+            }
+            this->data()[this->count++] = elem;
+        }
+
+        void clear()
+        {
+            this->count = 0;
+        }
+
+        void assign(const T* src, size_type num)
+        {
+            this->count = 0;
+            this->reserve(num);
+            std::memmove(this->data(), src, num * sizeof(T));
+            this->count = num;
+        }
+
+        friend auto operator==(const small_vector& lhs, const small_vector& rhs) -> bool
+        {
+            return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+        }
+
+    private:
+        /**
+         * @brief Move `other`'s contents into us, `heap` must already be empty.
+         */
+        void take(small_vector&& other)
+        {
+            if (other.heap) {
+                this->heap = std::move(other.heap);
+                this->heap_capacity = other.heap_capacity;
+            } else {
+                std::memcpy(this->storage.data(), other.storage.data(), other.count * sizeof(T));
+            }
+            this->count = std::exchange(other.count, 0);
+        }
+
+        size_type count = 0;
+        size_type heap_capacity = 0;
+        std::unique_ptr<T[]> heap;
+        std::array<T, N> storage;
+    };
+
+    static_assert(MyContainer<small_vector<u8, 16>>, "Expected small_vector to conform to MyContainer!");
+} // namespace tasarch
+
+#endif /* __UTIL_SMALL_VECTOR_H */
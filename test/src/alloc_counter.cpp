@@ -0,0 +1,41 @@
+#include "alloc_counter.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+    thread_local size_t num_allocations = 0;
+
+    auto counted_alloc(std::size_t size) -> void*
+    {
+        num_allocations++;
+        void* ptr = std::malloc(size == 0 ? 1 : size);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+} // namespace
+
+namespace tasarch::test {
+    auto allocation_count() -> size_t
+    {
+        return num_allocations;
+    }
+} // namespace tasarch::test
+
+// Only the plain variants are replaced, the nothrow and array ones end up here by default.
+// Aligned allocations are not counted, nothing in the packet path uses them.
+auto operator new(std::size_t size) -> void*
+{
+    return counted_alloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
@@ -0,0 +1,34 @@
+#ifndef __TEST_ALLOC_COUNTER_H
+#define __TEST_ALLOC_COUNTER_H
+
+#include <cstddef>
+
+namespace tasarch::test {
+    /**
+     * @brief Number of heap allocations (`operator new`) the current thread has done so far.
+     *
+     * The test binary replaces the global `operator new` (see `alloc_counter.cpp`), so this counts every allocation, including those done by the standard library.
+     */
+    auto allocation_count() -> size_t;
+
+    /**
+     * @brief Counts the heap allocations done by the current thread while running `fn`.
+     *
+     * @code {.cpp}
+     * expect(count_allocations([&]{ decode_buffer<Str<Hex, ',', true>, Str<Hex>>(buf, cb); }) == 0_ul);
+     * @endcode
+     *
+     * @tparam TFn
+     * @param fn
+     * @return size_t
+     */
+    template<typename TFn>
+    auto count_allocations(TFn&& fn) -> size_t
+    {
+        size_t before = allocation_count();
+        fn();
+        return allocation_count() - before;
+    }
+} // namespace tasarch::test
+
+#endif /* __TEST_ALLOC_COUNTER_H */
@@ -0,0 +1,57 @@
+#ifndef __TEST_BENCH_H
+#define __TEST_BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <string_view>
+#include "log/logging.h"
+
+namespace tasarch::test {
+    /**
+     * @brief Prevents the compiler from optimizing away a value we only compute for benchmarking.
+     *
+     * @tparam T
+     * @param val
+     */
+    template<typename T>
+    inline void do_not_optimize(T const& val)
+    {
+        asm volatile("" : : "r,m"(val) : "memory");
+    }
+
+    /**
+     * @brief Runs `fn` `iterations` times and logs the resulting throughput to the `test.bench` logger.
+     *
+     * These are not meant as rigorous benchmarks (the test binary is built with `-Og --coverage` after all),
+     * but rather to quickly compare different implementations against each other.
+     *
+     * @code {.cpp}
+     * measure_throughput("memcpy", buf.size(), 1000, [&]{ std::memcpy(dst, src, buf.size()); });
+     * @endcode
+     *
+     * @tparam TFn
+     * @param name Name used for logging.
+     * @param bytes_per_iter The number of bytes processed by a single call to `fn`.
+     * @param iterations
+     * @param fn
+     * @return double The throughput in MiB/s.
+     */
+    template<typename TFn>
+    auto measure_throughput(std::string_view name, size_t bytes_per_iter, size_t iterations, TFn fn) -> double
+    {
+        using clock = std::chrono::steady_clock;
+        // warmup, so we dont measure page faults and the like
+        fn();
+        auto start = clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            fn();
+        }
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        double mib = static_cast<double>(bytes_per_iter * iterations) / (1024.0 * 1024.0);
+        double throughput = mib / elapsed.count();
+        log::get("test.bench")->info("{:<40} {:>10.1f} MiB/s ({:.3f}s for {:.1f} MiB)", name, throughput, elapsed.count(), mib);
+        return throughput;
+    }
+} // namespace tasarch::test
+
+#endif /* __TEST_BENCH_H */
@@ -56,4 +56,27 @@ ut::suite base_config = [] {
         argument_val(conf);
         expect(config::instance()->testing == false);
     };
-};
\ No newline at end of file
+    "gdb config"_test = []{
+        config conf;
+        expect(conf.gdb.rle == true) << "rle should be enabled by default";
+        expect(conf.gdb.address == "tcp:5555");
+        expect(conf.gdb.packet_size == Gdb::default_packet_size);
+
+        conf.load_from(parse_toml("gdb.rle = false\ngdb.address = 'unix:/tmp/tasarch.sock'\ngdb.packet_size = 0x10000\ngdb.transport_buffer_size = 0x2000"));
+        expect(conf.gdb.rle == false);
+        expect(conf.gdb.address == "unix:/tmp/tasarch.sock");
+        expect(conf.gdb.packet_size == 0x10000UL);
+        expect(conf.gdb.transport_buffer_size == 0x2000UL);
+
+        // too small for a register dump
+        conf.load_from(parse_toml("gdb.packet_size = 16"));
+        expect(conf.gdb.packet_size == Gdb::min_packet_size);
+
+        // missing values go back to the default
+        conf.load_from(parse_toml("logging.level = 'info'"));
+        expect(conf.gdb.rle == true);
+        expect(conf.gdb.address == "tcp:5555");
+        expect(conf.gdb.packet_size == Gdb::default_packet_size);
+        expect(conf.gdb.transport_buffer_size == Gdb::default_transport_buffer_size);
+    };
+};
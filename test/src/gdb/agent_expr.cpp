@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+#include <fmt/core.h>
+#include <ut/ut.hpp>
+#include "gdb/agent_expr.h"
+#include "mock_target.h"
+
+namespace ut = boost::ut;
+
+namespace {
+    using tasarch::gdb::ax::opcode;
+
+    /**
+     * @brief 16 bytes of memory at 0x100 and four registers.
+     */
+    class test_context : public tasarch::gdb::ax::context
+    {
+    public:
+        static constexpr size_t base = 0x100;
+
+        std::array<u8, 16> memory = {0x78, 0x56, 0x34, 0x12, 0xff, 0xff, 0xff, 0xff, 0x3c, 0, 0, 0, 0, 0, 0, 0x80};
+        std::array<u64, 4> regs = {0, 1, 0x1234, static_cast<u64>(-5)};
+        bool big = false;
+
+        auto read_memory(size_t address, std::span<u8> dst) -> size_t override
+        {
+            if (address < base || address >= base + memory.size()) {
+                return 0;
+            }
+            size_t len = std::min(dst.size(), base + memory.size() - address);
+            std::copy_n(memory.begin() + static_cast<ptrdiff_t>(address - base), len, dst.begin());
+            return len;
+        }
+
+        auto register_value(size_t idx) -> std::optional<u64> override
+        {
+            if (idx >= regs.size()) {
+                return std::nullopt;
+            }
+            return regs[idx];
+        }
+
+        [[nodiscard]] auto big_endian() const -> bool override
+        {
+            return big;
+        }
+    };
+
+    /**
+     * @brief Bytecode from opcodes and operand bytes mixed.
+     */
+    auto code(std::initializer_list<int> bytes) -> std::vector<u8>
+    {
+        std::vector<u8> ret;
+        for (int byte : bytes) {
+            ret.push_back(static_cast<u8>(byte));
+        }
+        return ret;
+    }
+
+    constexpr auto op(opcode code) -> int
+    {
+        return static_cast<int>(code);
+    }
+
+    auto run(std::initializer_list<int> bytes) -> std::optional<u64>
+    {
+        test_context ctx;
+        return tasarch::gdb::ax::expression::compile(code(bytes)).evaluate(ctx);
+    }
+} // namespace
+
+ut::suite agent_expr_tests = []{
+    using namespace ut;
+    using namespace tasarch::gdb;
+    using tasarch::test::gdb::mock_target;
+    using ax::expression;
+
+    "agent expression compile errors test"_test = []{
+        auto invalid = [](std::initializer_list<int> bytes) {
+            return throws<std::invalid_argument>([&]{ expression::compile(code(bytes)); });
+        };
+        expect(invalid({}));
+        // unknown opcode and floating point are not supported.
+        expect(invalid({0xff}));
+        expect(invalid({0x01}));
+        // truncated operand
+        expect(invalid({op(opcode::const32), 0, 0}));
+        // underflow
+        expect(invalid({op(opcode::add), op(opcode::end)}));
+        expect(invalid({op(opcode::const8), 1, op(opcode::pick), 1, op(opcode::end)}));
+        // falls off the end
+        expect(invalid({op(opcode::const8), 1}));
+        // jump into the middle of an instruction or out of the expression
+        expect(invalid({op(opcode::const16), 0, 1, op(opcode::goto_), 0, 1}));
+        expect(invalid({op(opcode::goto_), 0, 100}));
+        // depth differs between paths: pushes on every iteration.
+        expect(invalid({op(opcode::const8), 1, op(opcode::goto_), 0, 0}));
+        expect(invalid({op(opcode::const8), 1, op(opcode::ext), 0, op(opcode::end)}));
+        expect(invalid({op(opcode::const8), 1, op(opcode::zero_ext), 65, op(opcode::end)}));
+
+        // Too deep.
+        std::vector<u8> deep;
+        for (size_t i = 0; i <= expression::max_stack; i++) {
+            deep.insert(deep.end(), {static_cast<u8>(opcode::const8), 1});
+        }
+        deep.push_back(static_cast<u8>(opcode::end));
+        expect(throws<std::invalid_argument>([&]{ expression::compile(deep); }));
+    };
+
+    "agent expression arithmetic test"_test = []{
+        expect(run({op(opcode::const8), 7, op(opcode::const8), 5, op(opcode::sub), op(opcode::end)}) == u64{2});
+        expect(run({op(opcode::const8), 5, op(opcode::const8), 7, op(opcode::sub), op(opcode::end)}) == static_cast<u64>(-2));
+        expect(run({op(opcode::const16), 0x12, 0x34, op(opcode::const8), 4, op(opcode::lsh), op(opcode::end)}) == u64{0x12340});
+        expect(run({op(opcode::const8), 1, op(opcode::const8), 64, op(opcode::lsh), op(opcode::end)}) == u64{0});
+        expect(run({op(opcode::const8), 6, op(opcode::const8), 3, op(opcode::mul), op(opcode::const8), 4, op(opcode::div_unsigned), op(opcode::end)}) == u64{4});
+        expect(run({op(opcode::const8), 17, op(opcode::const8), 5, op(opcode::rem_unsigned), op(opcode::end)}) == u64{2});
+        expect(run({op(opcode::const8), 3, op(opcode::log_not), op(opcode::end)}) == u64{0});
+        expect(run({op(opcode::const8), 0, op(opcode::bit_not), op(opcode::end)}) == ~u64{0});
+
+        // Signed operations, on values sign extended from 8 bits.
+        expect(run({op(opcode::const8), 0xf6, op(opcode::ext), 8, op(opcode::const8), 3, op(opcode::div_signed), op(opcode::end)}) == static_cast<u64>(-3));
+        expect(run({op(opcode::const8), 0xf6, op(opcode::ext), 8, op(opcode::const8), 3, op(opcode::rem_signed), op(opcode::end)}) == static_cast<u64>(-1));
+        expect(run({op(opcode::const8), 0xf6, op(opcode::ext), 8, op(opcode::const8), 1, op(opcode::rsh_signed), op(opcode::end)}) == static_cast<u64>(-5));
+        expect(run({op(opcode::const8), 0xf6, op(opcode::ext), 8, op(opcode::const8), 0, op(opcode::less_signed), op(opcode::end)}) == u64{1});
+        expect(run({op(opcode::const8), 0xf6, op(opcode::ext), 8, op(opcode::const8), 0, op(opcode::less_unsigned), op(opcode::end)}) == u64{0});
+        expect(run({op(opcode::const16), 0x12, 0xf6, op(opcode::zero_ext), 8, op(opcode::end)}) == u64{0xf6});
+        expect(run({op(opcode::const64), 0x80, 0, 0, 0, 0, 0, 0, 0, op(opcode::const8), 0xff, op(opcode::ext), 8, op(opcode::div_signed), op(opcode::end)}) == u64{0x8000'0000'0000'0000});
+
+        // Division by zero fails instead of crashing.
+        expect(!run({op(opcode::const8), 1, op(opcode::const8), 0, op(opcode::div_unsigned), op(opcode::end)}).has_value());
+        expect(!run({op(opcode::const8), 1, op(opcode::const8), 0, op(opcode::rem_signed), op(opcode::end)}).has_value());
+    };
+
+    "agent expression stack test"_test = []{
+        // 1 2 3 rot => 3 1 2, pick 2 => 3 1 2 3, swap => 3 1 3 2, sub => 3 1 1, equal => 3 1, pop => 3
+        expect(run({op(opcode::const8), 1, op(opcode::const8), 2, op(opcode::const8), 3, op(opcode::rot), op(opcode::pick), 2, op(opcode::swap),
+                    op(opcode::sub), op(opcode::equal), op(opcode::pop), op(opcode::end)}) == u64{3});
+        expect(run({op(opcode::const8), 21, op(opcode::dup), op(opcode::add), op(opcode::end)}) == u64{42});
+    };
+
+    "agent expression jump test"_test = []{
+        // if (reg1) 10 else 20
+        auto choose = [](u64 value) {
+            test_context ctx;
+            ctx.regs[1] = value;
+            auto expr = expression::compile(code({op(opcode::reg), 0, 1, op(opcode::if_goto), 0, 11,
+                                                  op(opcode::const8), 20, op(opcode::goto_), 0, 13,
+                                                  op(opcode::const8), 10, op(opcode::end)}));
+            return expr.evaluate(ctx);
+        };
+        expect(choose(1) == u64{10});
+        expect(choose(0) == u64{20});
+
+        // Count down from 5: 0 = counter, loop until zero.
+        expect(run({op(opcode::const8), 5,
+                    op(opcode::const8), 1, op(opcode::sub), op(opcode::dup), op(opcode::if_goto), 0, 2,
+                    op(opcode::end)}) == u64{0});
+
+        // Endless loops are cut off.
+        expect(!run({op(opcode::const8), 1, op(opcode::goto_), 0, 2, op(opcode::end)}).has_value());
+    };
+
+    "agent expression fusion test"_test = []{
+        // The constant and the add are fused...
+        auto fused = expression::compile(code({op(opcode::reg), 0, 2, op(opcode::const8), 1, op(opcode::add), op(opcode::end)}));
+        expect(fused.size() == 3_ul);
+        test_context ctx;
+        expect(fused.evaluate(ctx) == u64{0x1235});
+
+        // ... unless a jump goes to the add, which must then not apply the constant.
+        // 0: reg 2; 3: const8 5; 5: reg 1; 8: if_goto 14; 11: pop; 12: const8 1; 14: add; 15: end
+        auto target = expression::compile(code({op(opcode::reg), 0, 2, op(opcode::const8), 5, op(opcode::reg), 0, 1, op(opcode::if_goto), 0, 14,
+                                                op(opcode::pop), op(opcode::const8), 1, op(opcode::add), op(opcode::end)}));
+        expect(target.size() == 8_ul);
+        expect(target.evaluate(ctx) == u64{0x1239});
+        ctx.regs[1] = 0;
+        expect(target.evaluate(ctx) == u64{0x1235});
+    };
+
+    "agent expression memory and register test"_test = []{
+        test_context ctx;
+        auto load = [&](opcode ref, u8 offset) {
+            return expression::compile(code({op(opcode::const16), 0x01, offset, op(ref), op(opcode::end)})).evaluate(ctx);
+        };
+        expect(load(opcode::ref8, 0) == u64{0x78});
+        expect(load(opcode::ref16, 0) == u64{0x5678});
+        expect(load(opcode::ref32, 0) == u64{0x12345678});
+        expect(load(opcode::ref64, 0) == u64{0xffff'ffff'1234'5678});
+        // unreadable, completely or partially.
+        expect(!load(opcode::ref8, 0x10).has_value());
+        expect(!load(opcode::ref64, 0x0c).has_value());
+        ctx.big = true;
+        expect(load(opcode::ref32, 0) == u64{0x78563412});
+        ctx.big = false;
+
+        // The same, unfused: the address is computed.
+        expect(expression::compile(code({op(opcode::const8), 0x80, op(opcode::const8), 0x84, op(opcode::add), op(opcode::ref32), op(opcode::end)})).evaluate(ctx) == u64{0xffff'ffff});
+
+        // Registers, sign extended -5 is less than 0.
+        expect(expression::compile(code({op(opcode::reg), 0, 3, op(opcode::const8), 0, op(opcode::less_signed), op(opcode::end)})).evaluate(ctx) == u64{1});
+        expect(!expression::compile(code({op(opcode::reg), 0, 4, op(opcode::end)})).evaluate(ctx).has_value());
+    };
+
+    "conditional breakpoint test"_test = []{
+        auto path = std::filesystem::temp_directory_path() / fmt::format("tasarch_agent_expr_{}.bin", ::getpid());
+        {
+            mock_target target(path, 0x1000, 0x1000);
+            target.set_pc(0x1000);
+            std::array<u8, 1> flag = {0};
+            target.write_memory(0x1800, flag);
+
+            // *(u8*)0x1800 == 1
+            std::vector<expression> conditions;
+            conditions.push_back(expression::compile(code({op(opcode::const16), 0x18, 0x00, op(opcode::ref8), op(opcode::const8), 1, op(opcode::equal), op(opcode::end)})));
+            target.breakpoints().add(breakpoint_type::software, 0x1010, 1, std::move(conditions));
+
+            target.resume(resume_mode::cont, [](stop_reason /*reason*/) {});
+            expect(!target.run(0x100));
+            expect(target.pc() == 0x1100UL);
+            expect(target.breakpoints().find(breakpoint_type::software, 0x1010)->hits == 0_ul);
+
+            flag[0] = 1;
+            target.write_memory(0x1800, flag);
+            target.set_pc(0x1000);
+            expect(target.run(0x100));
+            expect(target.pc() == 0x1010UL);
+            expect(target.breakpoints().find(breakpoint_type::software, 0x1010)->hits == 1_ul);
+
+            // Registers are read from the target: pc == 0x1010 is true right at the breakpoint.
+            conditions.clear();
+            conditions.push_back(expression::compile(code({op(opcode::reg), 0, static_cast<int>(mock_target::pc_register), op(opcode::const16), 0x10, 0x10, op(opcode::equal), op(opcode::end)})));
+            target.breakpoints().add(breakpoint_type::software, 0x1010, 1, std::move(conditions));
+            target.set_pc(0x1000);
+            target.resume(resume_mode::cont, [](stop_reason /*reason*/) {});
+            expect(target.run(0x100));
+            expect(target.breakpoints().find(breakpoint_type::software, 0x1010)->hits == 2_ul);
+        }
+        std::filesystem::remove(path);
+    };
+};
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "bench.h"
+#include "config/config.h"
+#include "gdb/agent_expr.h"
+#include "gdb/breakpoints.h"
+#include "gdb/buffer.h"
+#include "gdb/coding.h"
+#include "gdb/crc32.h"
+#include "gdb/hex_codec.h"
+#include "gdb/mem_search.h"
+#include "gdb/register_cache.h"
+#include "gdb/packet_codec.h"
+#include "gdb/packet_format.h"
+#include "gdb/packet_io.h"
+#include "log/logging.h"
+#include "mock_target.h"
+#include "util/cpu_features.h"
+#include <ut/ut.hpp>
+
+namespace ut = boost::ut;
+
+ut::suite benchmark_tests = []{
+    using namespace ut;
+    using namespace tasarch::gdb;
+    using tasarch::test::gdb::mock_target;
+    using tasarch::cpu::simd_level;
+    using tasarch::test::measure_throughput;
+    using tasarch::test::do_not_optimize;
+
+    auto config_val = tasarch::config::parse_toml("logging.test.bench.level = 'info'");
+    tasarch::config::conf()->load_from(config_val);
+
+    constexpr size_t iterations = 256;
+
+    // What a typical `m` response looks like: hex characters, nothing to escape.
+    std::vector<u8> hex_payload(gdb_packet_buffer_size);
+    // What a binary response (e.g. vFile:pread) looks like: random bytes, roughly 1.5% need escaping.
+    std::vector<u8> bin_payload(gdb_packet_buffer_size);
+    std::mt19937 rng(1337);
+    for (size_t i = 0; i < hex_payload.size(); i++) {
+        hex_payload[i] = static_cast<u8>(encode_hex(static_cast<u8>(rng())));
+        bin_payload[i] = static_cast<u8>(rng());
+    }
+
+    "escape_response throughput"_test = [&]{
+        std::vector<u8> out(max_packet_expansion(gdb_packet_buffer_size));
+
+        for (const auto& sample : {std::pair{"hex", &hex_payload}, std::pair{"binary", &bin_payload}}) {
+            // not using structured bindings, since clang does not like capturing them.
+            const char* name = sample.first;
+            std::vector<u8>* payload = sample.second;
+            // the per byte implementation we used to have, as a baseline.
+            buffer src(gdb_packet_buffer_size);
+            buffer dst(out.size());
+            measure_throughput(fmt::format("escape {} (per byte buffer)", name), payload->size(), iterations, [&]{
+                src.reset();
+                dst.reset();
+                auto payload_buf = asio::buffer(*payload);
+                src.append_buf(payload_buf);
+                int checksum = 0;
+                while (src.read_size() > 0) {
+                    u8 c = src.get_byte();
+                    if (PacketIO::must_escape_response(c)) {
+                        dst.put_byte(PacketIO::escape);
+                        checksum += PacketIO::escape;
+                        c = PacketIO::code_escape_char(c);
+                    }
+                    checksum += c;
+                    checksum %= 256;
+                    dst.put_byte(c);
+                }
+                do_not_optimize(checksum);
+            });
+
+            for (auto level : {simd_level::scalar, simd_level::sse2, simd_level::avx2}) {
+                if (!tasarch::cpu::simd_supported(level)) {
+                    continue;
+                }
+                measure_throughput(fmt::format("escape {} ({})", name, tasarch::cpu::simd_name(level)), payload->size(), iterations, [&]{
+                    auto res = codec::escape_response(payload->data(), payload->size(), out.data(), level);
+                    do_not_optimize(res);
+                });
+            }
+        }
+    };
+
+    "scan throughput"_test = [&]{
+        for (auto level : {simd_level::scalar, simd_level::sse2, simd_level::avx2}) {
+            if (!tasarch::cpu::simd_supported(level)) {
+                continue;
+            }
+            // Typical `M` / `X` request data is hex and only rarely contains a `}`.
+            measure_throughput(fmt::format("scan hex ({})", tasarch::cpu::simd_name(level)), hex_payload.size(), iterations, [&]{
+                auto res = codec::scan_request(hex_payload.data(), hex_payload.size(), level);
+                do_not_optimize(res);
+            });
+            // What send_packet does before deciding whether anything needs staging.
+            measure_throughput(fmt::format("scan response hex ({})", tasarch::cpu::simd_name(level)), hex_payload.size(), iterations, [&]{
+                auto res = codec::scan_response(hex_payload.data(), hex_payload.size(), false, level);
+                do_not_optimize(res);
+            });
+        }
+    };
+    "hex throughput"_test = [&]{
+        // What `m` / `M` move around: raw memory one way, hex digits the other.
+        std::vector<u8> mem(gdb_packet_buffer_size / 2);
+        for (size_t i = 0; i < mem.size(); i++) {
+            mem[i] = bin_payload[i];
+        }
+        std::vector<u8> hex(2 * mem.size());
+        std::vector<u8> out(mem.size());
+
+        // the per nibble implementation we used to have, as a baseline.
+        buffer dst(gdb_packet_buffer_size);
+        measure_throughput("hex encode (per nibble buffer)", mem.size(), iterations, [&]{
+            dst.reset();
+            for (u8 b : mem) {
+                dst.put_byte(encode_hex(b >> 4));
+                dst.put_byte(encode_hex(b));
+            }
+            do_not_optimize(dst);
+        });
+        buffer src(gdb_packet_buffer_size);
+        src.append_buf(asio::buffer(hex_payload));
+        measure_throughput("hex decode (per nibble buffer)", hex_payload.size(), iterations, [&]{
+            // the data is still there, just make it readable again.
+            src.reset();
+            src.put_count(hex_payload.size());
+            for (size_t i = 0; src.read_size() > 0; i++) {
+                u8 hi = src.get_byte();
+                u8 lo = src.get_byte();
+                out[i] = static_cast<u8>((decode_hex(hi) << 4) | decode_hex(lo));
+            }
+            do_not_optimize(out);
+        });
+
+        for (auto level : {simd_level::scalar, simd_level::sse2, simd_level::ssse3, simd_level::avx2}) {
+            if (!tasarch::cpu::simd_supported(level)) {
+                continue;
+            }
+            measure_throughput(fmt::format("hex encode ({})", tasarch::cpu::simd_name(level)), mem.size(), iterations, [&]{
+                codec::hex_encode(mem.data(), mem.size(), hex.data(), level);
+                do_not_optimize(hex);
+            });
+            measure_throughput(fmt::format("hex decode ({})", tasarch::cpu::simd_name(level)), hex_payload.size(), iterations, [&]{
+                auto res = codec::hex_decode(hex_payload.data(), hex_payload.size(), out.data(), level);
+                do_not_optimize(res);
+            });
+        }
+    };
+
+    "memory search throughput"_test = [&]{
+        // What `find` in gdb searches: a few MB of RAM, with the value (here a pointer sized one) near the end.
+        using namespace tasarch::literals;
+        std::vector<u8> ram(4_MB);
+        std::mt19937 rng(42);
+        for (auto& b : ram) {
+            b = static_cast<u8>(rng());
+        }
+        std::vector<u8> pattern = {0x37, 0x13, 0x37, 0x13, 0x00, 0x00, 0x01, 0x00};
+        std::copy(pattern.begin(), pattern.end(), ram.end() - 100);
+
+        measure_throughput("search (std::search)", ram.size(), 16, [&]{
+            auto res = std::search(ram.begin(), ram.end(), pattern.begin(), pattern.end());
+            do_not_optimize(res);
+        });
+        for (auto level : {simd_level::scalar, simd_level::sse2, simd_level::ssse3, simd_level::avx2}) {
+            if (!tasarch::cpu::simd_supported(level)) {
+                continue;
+            }
+            measure_throughput(fmt::format("search ({})", tasarch::cpu::simd_name(level)), ram.size(), 16, [&]{
+                auto res = search::find(ram, pattern, level);
+                do_not_optimize(res);
+            });
+        }
+    };
+
+    "crc throughput"_test = [&]{
+        // compare-sections checksums whole sections at once.
+        using namespace tasarch::literals;
+        std::vector<u8> image(4_MB);
+        std::mt19937 rng(42);
+        for (auto& b : image) {
+            b = static_cast<u8>(rng());
+        }
+        for (auto level : {simd_level::scalar, simd_level::sse2, simd_level::ssse3, simd_level::avx2}) {
+            if (!tasarch::cpu::simd_supported(level)) {
+                continue;
+            }
+            measure_throughput(fmt::format("crc32 ({})", tasarch::cpu::simd_name(level)), image.size(), 16, [&]{
+                auto res = crc::crc32(image, crc::initial, level);
+                do_not_optimize(res);
+            });
+        }
+    };
+
+    "target memory read throughput"_test = [&]{
+        // What serving `m` does: read from the target into scratch space, then hex encode into the response.
+        using namespace tasarch::literals;
+        auto path = std::filesystem::temp_directory_path() / fmt::format("tasarch_bench_target_{}.bin", ::getpid());
+        {
+            mock_target target(path, 0x1000, 4_MB);
+            std::vector<u8> scratch(gdb_packet_buffer_size / 2);
+            buffer resp(gdb_packet_buffer_size);
+            measure_throughput("mock target m reads", 4_MB, 16, [&]{
+                for (size_t offset = 0; offset < 4_MB; offset += scratch.size()) {
+                    resp.reset();
+                    size_t done = target.read_memory(0x1000 + offset, scratch);
+                    codec::hex_encode(scratch.data(), done, resp.write_data());
+                    resp.put_count(2 * done);
+                }
+                do_not_optimize(resp.read_size());
+            });
+
+            // Many small accesses, e.g. gdb walking a linked list.
+            std::vector<std::array<u8, 8>> words(1024);
+            std::vector<Debugger::memory_access> accesses;
+            accesses.reserve(words.size());
+            for (size_t i = 0; i < words.size(); i++) {
+                accesses.push_back({.address = 0x1000 + i * 4096, .data = words[i]});
+            }
+            measure_throughput("mock target batched reads", words.size() * 8, iterations, [&]{
+                target.read_memory(std::span(accesses));
+                do_not_optimize(accesses.front().done);
+            });
+        }
+        std::filesystem::remove(path);
+    };
+
+    "single step register reads"_test = [&]{
+        // After every step gdb sends `g`, IDA additionally reads the registers one by one with `p`.
+        auto path = std::filesystem::temp_directory_path() / fmt::format("tasarch_bench_regs_{}.bin", ::getpid());
+        {
+            mock_target target(path, 0x1000, 0x1000);
+            size_t block = target.register_block_size();
+            size_t num_regs = target.registers().size();
+            size_t reply_bytes = 4 * block;
+            std::vector<u8> raw(block);
+            buffer resp(gdb_packet_buffer_size);
+
+            measure_throughput("step + g + p (uncached)", reply_bytes, iterations * 16, [&]{
+                target.resume(resume_mode::step, [](stop_reason) {});
+                resp.reset();
+                target.read_registers(raw);
+                codec::hex_encode(raw.data(), block, resp.write_data());
+                for (size_t i = 0; i < num_regs; i++) {
+                    resp.reset();
+                    auto reg = std::span<u8>(raw).first(target.registers()[i].size());
+                    target.read_register(i, reg);
+                    codec::hex_encode(reg.data(), reg.size(), resp.write_data());
+                }
+                do_not_optimize(resp.write_data());
+            });
+
+            register_cache cache(target);
+            measure_throughput("step + g + p (register_cache)", reply_bytes, iterations * 16, [&]{
+                cache.invalidate();
+                target.resume(resume_mode::step, [](stop_reason) {});
+                resp.reset();
+                resp.append_buf(cache.hex());
+                for (size_t i = 0; i < num_regs; i++) {
+                    resp.reset();
+                    resp.append_buf(cache.hex(i));
+                }
+                do_not_optimize(resp.read_size());
+            });
+        }
+        std::filesystem::remove(path);
+    };
+
+    "breakpoint check throughput"_test = [&]{
+        // The emulator checks every pc, with a couple of breakpoints in the code it runs through.
+        auto bps = std::make_unique<breakpoint_manager>();
+        for (size_t addr = 0x10'0000; addr < 0x20'0000; addr += 0x1'0003) {
+            bps->add(breakpoint_type::software, addr, 1);
+        }
+        constexpr size_t num_pcs = 1 << 20;
+        measure_throughput("breakpoint_manager::contains (1M pcs)", num_pcs, 64, [&]{
+            size_t hits = 0;
+            for (size_t pc = 0x10'0000; pc < 0x10'0000 + num_pcs; pc++) {
+                hits += bps->contains(pc) ? 1 : 0;
+            }
+            do_not_optimize(hits);
+        });
+    };
+
+    "conditional breakpoint throughput"_test = [&]{
+        // `break foo if counter == 60`: what makes the difference is not stopping, the condition is evaluated on every hit.
+        auto path = std::filesystem::temp_directory_path() / fmt::format("tasarch_bench_cond_{}.bin", ::getpid());
+        {
+            mock_target target(path, 0x1000, 0x1000);
+            std::array<u8, 4> counter = {59, 0, 0, 0};
+            target.write_memory(0x1800, counter);
+            std::vector<u8> bytecode = {
+                static_cast<u8>(ax::opcode::const16), 0x18, 0x00, static_cast<u8>(ax::opcode::ref32),
+                static_cast<u8>(ax::opcode::const8), 0x3c, static_cast<u8>(ax::opcode::equal), static_cast<u8>(ax::opcode::end),
+            };
+            auto expr = ax::expression::compile(bytecode);
+            constexpr size_t evals = 1 << 14;
+            measure_throughput("agent expression evaluate (16k)", evals, 64, [&]{
+                u64 stops = 0;
+                for (size_t i = 0; i < evals; i++) {
+                    stops += expr.evaluate(target).value_or(1);
+                }
+                do_not_optimize(stops);
+            });
+        }
+        std::filesystem::remove(path);
+    };
+
+    "argument parsing throughput"_test = [&]{
+        using namespace tasarch::gdb::coders;
+        // A typical M packet (without the type), the data is what dominates.
+        std::string packet = fmt::format("{:x},{:x}:", 0x80001000, hex_payload.size() / 2);
+        packet.append(hex_payload.begin(), hex_payload.end());
+        buffer buf(packet.size());
+        auto refill = [&]{
+            buf.reset();
+            buf.append_buf(packet);
+        };
+
+        measure_throughput("M args (coders)", packet.size(), iterations, [&]{
+            refill();
+            decode_buffer<Str<Hex, ',', true>, Str<Hex, ':', true>, Bytes<std::vector<u8>>>(buf, [](size_t addr, size_t len, std::vector<u8> data) {
+                do_not_optimize(addr + len + data.size());
+            });
+        });
+        measure_throughput("M args (format)", packet.size(), iterations, [&]{
+            refill();
+            parse_packet<"%x,%x:%b">(buf, [](size_t addr, size_t len, payload_bytes data) {
+                do_not_optimize(addr + len + data.size());
+            });
+        });
+
+        // And one where the data does not matter, to see the per packet overhead.
+        std::string short_packet = "80001000,40";
+        buffer short_buf(short_packet.size());
+        measure_throughput("m args (coders)", short_packet.size(), iterations * 64, [&]{
+            short_buf.reset();
+            short_buf.append_buf(short_packet);
+            decode_buffer<Str<Hex, ',', true>, Str<Hex>>(short_buf, [](size_t addr, size_t len) { do_not_optimize(addr + len); });
+        });
+        measure_throughput("m args (format)", short_packet.size(), iterations * 64, [&]{
+            short_buf.reset();
+            short_buf.append_buf(short_packet);
+            parse_packet<"%x,%x">(short_buf, [](size_t addr, size_t len) { do_not_optimize(addr + len); });
+        });
+    };
+
+    "rle bytes on wire"_test = [&]{
+        auto logger = tasarch::log::get("test.bench");
+        // Memory as `m` would return it, i.e. hex encoded.
+        auto hex_dump = [](const std::vector<u8>& mem) {
+            std::vector<u8> hex;
+            for (u8 b : mem) {
+                hex.push_back(static_cast<u8>(encode_hex(b >> 4)));
+                hex.push_back(static_cast<u8>(encode_hex(b)));
+            }
+            return hex;
+        };
+
+        constexpr size_t mem_size = gdb_packet_buffer_size / 2;
+        std::vector<u8> zeroed(mem_size, 0);
+        // emulated RAM: mostly zeroed with some structs / values sprinkled in.
+        std::vector<u8> ram(mem_size, 0);
+        // VRAM: tiles with long runs of the same palette index.
+        std::vector<u8> vram(mem_size, 0);
+        std::vector<u8> random(mem_size, 0);
+        std::mt19937 rng(42);
+        for (size_t i = 0; i < mem_size; i += 64) {
+            bool used = rng() % 4 == 0;
+            u8 color = static_cast<u8>(rng() % 4);
+            for (size_t j = i; j < i + 64; j++) {
+                ram[j] = used ? static_cast<u8>(rng()) : 0;
+                vram[j] = (rng() % 16 == 0) ? static_cast<u8>(rng() % 4) : color;
+            }
+        }
+        for (auto& b : random) {
+            b = static_cast<u8>(rng());
+        }
+
+        std::vector<u8> out(max_packet_expansion(gdb_packet_buffer_size));
+        for (const auto& sample : {std::pair{"zeroed", &zeroed}, std::pair{"ram", &ram}, std::pair{"vram", &vram}, std::pair{"random", &random}}) {
+            auto hex = hex_dump(*sample.second);
+            size_t plain = codec::escape_response(hex.data(), hex.size(), out.data()).size;
+            size_t rle = codec::escape_rle_response(hex.data(), hex.size(), out.data()).size;
+            double reduction = 100.0 * (1.0 - static_cast<double>(rle) / static_cast<double>(plain));
+            logger->info("rle {:<10} {:>8} -> {:>8} bytes on wire ({:.1f}% reduction)", sample.first, plain, rle, reduction);
+            expect(rle <= plain);
+
+            measure_throughput(fmt::format("escape+rle {}", sample.first), hex.size(), iterations, [&]{
+                auto res = codec::escape_rle_response(hex.data(), hex.size(), out.data());
+                do_not_optimize(res);
+            });
+        }
+    };
+};
@@ -0,0 +1,173 @@
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <fmt/core.h>
+#include <ut/ut.hpp>
+#include "gdb/breakpoints.h"
+#include "mock_target.h"
+
+namespace ut = boost::ut;
+
+namespace {
+    /**
+     * @brief For breakpoints without conditions, which never look at the target.
+     */
+    class no_context : public tasarch::gdb::ax::context
+    {
+    public:
+        auto read_memory(size_t /*address*/, std::span<u8> /*dst*/) -> size_t override
+        {
+            return 0;
+        }
+
+        auto register_value(size_t /*idx*/) -> std::optional<u64> override
+        {
+            return std::nullopt;
+        }
+    };
+} // namespace
+
+ut::suite breakpoint_tests = []{
+    using namespace ut;
+    using namespace tasarch::gdb;
+    using tasarch::test::gdb::mock_target;
+    using bpm = breakpoint_manager;
+
+    "breakpoint add remove test"_test = []{
+        auto bps = std::make_unique<bpm>();
+        expect(!bps->contains(0x1000));
+        expect(bps->add(breakpoint_type::software, 0x1000, 1));
+        expect(!bps->add(breakpoint_type::software, 0x1000, 2));
+        expect(bps->find(breakpoint_type::software, 0x1000)->kind == 2_ul);
+        expect(bps->contains(0x1000));
+        expect(!bps->contains(0x1001));
+        expect(!bps->contains(0x0fff));
+
+        // Same page number modulo the buckets, different page.
+        size_t alias = 0x1000 + bpm::num_buckets * bpm::page_size;
+        expect(!bps->contains(alias));
+        bps->add(breakpoint_type::hardware, alias + 3, 1);
+        expect(bps->contains(alias + 3));
+        expect(!bps->contains(0x1003));
+
+        // The whole 64 bit address space works.
+        bps->add(breakpoint_type::software, 0xffff'ffff'ffff'fff0, 1);
+        expect(bps->contains(0xffff'ffff'ffff'fff0));
+        expect(!bps->contains(0x0000'ffff'ffff'fff0));
+        expect(bps->size() == 3_ul);
+
+        expect(!bps->remove(breakpoint_type::hardware, 0x1000));
+        expect(bps->remove(breakpoint_type::software, 0x1000));
+        expect(!bps->contains(0x1000));
+        expect(bps->contains(alias + 3));
+
+        bps->clear();
+        expect(bps->size() == 0_ul);
+        expect(!bps->contains(alias + 3));
+
+        expect(throws<std::invalid_argument>([&]{ bps->add(breakpoint_type::write_watch, 0x1000, 4); }));
+    };
+
+    "breakpoint multiple types test"_test = []{
+        auto bps = std::make_unique<bpm>();
+        no_context ctx;
+        bps->add(breakpoint_type::software, 0x2000, 1);
+        bps->add(breakpoint_type::hardware, 0x2000, 1);
+        expect(bps->hit(0x2000, ctx));
+        expect(bps->find(breakpoint_type::software, 0x2000)->hits == 1_ul);
+        expect(bps->find(breakpoint_type::hardware, 0x2000)->hits == 1_ul);
+
+        // The address stays a breakpoint until the last one there is gone.
+        bps->remove(breakpoint_type::software, 0x2000);
+        expect(bps->contains(0x2000));
+        bps->remove(breakpoint_type::hardware, 0x2000);
+        expect(!bps->contains(0x2000));
+        expect(!bps->hit(0x2000, ctx));
+    };
+
+    "breakpoint concurrent modification test"_test = []{
+        auto bps = std::make_unique<bpm>();
+        std::atomic<bool> done = false;
+        size_t seen = 0;
+        std::thread checker([&]{
+            // Like the emulation thread, never blocked by the other one.
+            while (!done) {
+                for (size_t addr = 0; addr < 64 * bpm::page_size; addr += bpm::page_size) {
+                    seen += bps->contains(addr + 4) ? 1 : 0;
+                }
+            }
+        });
+        for (size_t round = 0; round < 100; round++) {
+            for (size_t addr = 0; addr < 64 * bpm::page_size; addr += bpm::page_size) {
+                bps->add(breakpoint_type::software, addr + 4, 1);
+            }
+            for (size_t addr = 0; addr < 64 * bpm::page_size; addr += bpm::page_size) {
+                bps->remove(breakpoint_type::software, addr + 4);
+            }
+        }
+        done = true;
+        checker.join();
+        expect(bps->size() == 0_ul);
+    };
+
+    "breakpoint hit while modifying test"_test = []{
+        auto bps = std::make_unique<bpm>();
+        bps->add(breakpoint_type::software, 0x4, 1);
+        std::atomic<bool> done = false;
+        std::atomic<u64> stops = 0;
+        std::thread emulator([&]{
+            no_context ctx;
+            // Works on whatever table was published last, hits counted on an old one still count.
+            while (!done) {
+                stops += bps->hit(0x4, ctx) ? 1U : 0U;
+            }
+        });
+        for (size_t round = 0; round < 1000; round++) {
+            bps->add(breakpoint_type::software, 0x8 + round, 1);
+            // gdb inserts it again whenever its conditions change.
+            bps->add(breakpoint_type::software, 0x4, 2);
+        }
+        // It is still there, so every call stops.
+        while (stops == 0) {
+            std::this_thread::yield();
+        }
+        bps->clear();
+        done = true;
+        emulator.join();
+        expect(bps->size() == 0_ul);
+
+        bps->add(breakpoint_type::software, 0x4, 1);
+        no_context ctx;
+        expect(bps->hit(0x4, ctx));
+        expect(!bps->add(breakpoint_type::software, 0x4, 2));
+        expect(bps->find(breakpoint_type::software, 0x4)->hits == 1_ul);
+    };
+
+    "mock target breakpoint test"_test = []{
+        auto path = std::filesystem::temp_directory_path() / fmt::format("tasarch_breakpoints_{}.bin", ::getpid());
+        {
+            mock_target target(path, 0x1000, 0x1000);
+            target.set_pc(0x1000);
+            target.breakpoints().add(breakpoint_type::software, 0x1010, 1);
+
+            std::optional<stop_reason> stopped;
+            target.resume(resume_mode::cont, [&](stop_reason reason) { stopped = reason; });
+            expect(!target.run(0x8));
+            expect(target.run(0x100));
+            expect(stopped.has_value() && stopped->signal == stop_reason::sigtrap);
+            expect(target.pc() == 0x1010UL);
+            expect(target.breakpoints().find(breakpoint_type::software, 0x1010)->hits == 1_ul);
+
+            // Continuing from a breakpoint does not hit it again right away.
+            target.resume(resume_mode::cont, [&](stop_reason reason) { stopped = reason; });
+            expect(!target.run(0x100));
+            expect(target.pc() == 0x1110UL);
+        }
+        std::filesystem::remove(path);
+    };
+};
@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <array>
+#include <cstdint>
 #include <stdexcept>
+#include <span>
 #include <string>
+#include <string_view>
 #include "gdb/common.h"
 #include "gdb/packet_io.h"
 #include "log/logging.h"
@@ -14,6 +18,7 @@
 #include "async_test.h"
 #include <asio/basic_waitable_timer.hpp>
 #include "gdb/buffer.h"
+#include "gdb/buffer_pool.h"
 
 namespace ut = boost::ut;
 namespace gdb = tasarch::test::gdb;
@@ -40,4 +45,86 @@ ut::suite buffer_tests = []{
         all = buf.read_buf<std::string>();
         expect(all == initial + initial);
     };
-};
\ No newline at end of file
+
+    "view tests"_test = [&]{
+        buffer buf(128);
+        std::string initial = "testing";
+        buf.append_buf(std::string_view(initial));
+
+        auto view = buf.read_view();
+        expect(view == initial);
+        expect(reinterpret_cast<const u8*>(view.data()) == buf.read_data()) << "read_view should not copy";
+        expect(buf.read_size() == initial.size()) << "read_view should not consume";
+
+        auto bytes = buf.get_view<std::span<const u8>>(4);
+        expect(bytes.size() == 4_ul && bytes[0] == 't');
+        expect(buf.get_sv() == "ing");
+        expect(buf.read_size() == 0_ul);
+        expect(throws<std::out_of_range>([&]{ buf.get_view(1); }));
+
+        // spans can be appended as well
+        buf.append_buf(bytes);
+        expect(buf.get_sv() == "test");
+    };
+    "pool tests"_test = [&]{
+        using tasarch::gdb::buffer_pool;
+        buffer_pool pool;
+
+        auto blk = pool.acquire(100);
+        expect(blk.capacity() == buffer_pool::min_block_size);
+        expect(reinterpret_cast<uintptr_t>(blk.data()) % tasarch::gdb::buffer_alignment == 0_ul);
+        expect(std::all_of(blk.data(), blk.data() + blk.capacity(), [](u8 c) { return c == 0; })) << "new blocks are zero filled";
+        u8* first = blk.data();
+
+        auto big = pool.acquire(3000);
+        expect(big.capacity() == 4096_ul);
+        auto stats = pool.stats();
+        expect(stats.classes[0].in_use == 1_ul && stats.classes[4].in_use == 1_ul);
+        expect(stats.classes[4].block_size == 4096_ul);
+        expect(stats.total_bytes() == 4096 + buffer_pool::min_block_size);
+
+        blk.reset();
+        expect(blk.data() == nullptr);
+        stats = pool.stats();
+        expect(stats.classes[0].in_use == 0_ul && stats.classes[0].idle == 1_ul);
+
+        auto again = pool.acquire(buffer_pool::min_block_size);
+        expect(again.data() == first) << "idle blocks are handed out again";
+        expect(pool.stats().classes[0].reuses == 1_ul);
+        expect(pool.stats().classes[0].allocations == 1_ul);
+
+        // Moving hands over ownership, the storage is only released once.
+        auto moved = std::move(again);
+        expect(moved.data() == first && again.data() == nullptr);
+        moved = pool.acquire(10);
+        expect(pool.stats().classes[0].in_use == 1_ul && pool.stats().classes[0].idle == 1_ul);
+
+        {
+            auto huge = pool.acquire(buffer_pool::max_block_size + 1);
+            expect(pool.stats().oversized_in_use == 1_ul);
+        }
+        expect(pool.stats().oversized_in_use == 0_ul && pool.stats().oversized_bytes == 0_ul);
+
+        big.reset();
+        pool.trim();
+        stats = pool.stats();
+        expect(stats.classes[4].idle == 0_ul && stats.classes[0].idle == 0_ul);
+        expect(stats.total_bytes() == buffer_pool::min_block_size);
+    };
+
+    "pooled buffer tests"_test = [&]{
+        using namespace tasarch::literals;
+        const u8* storage = nullptr;
+        {
+            buffer buf(32_KB);
+            storage = buf.write_data();
+            buf.append_buf(std::string_view("testing"));
+
+            buffer moved(std::move(buf));
+            expect(moved.get_sv() == "testing");
+        }
+        buffer reused(32_KB);
+        expect(reused.write_data() == storage) << "storage of a destroyed buffer should be reused";
+        expect(reused.write_size() == 32_KB) << "the size is still what was requested";
+    };
+};
@@ -1,7 +1,9 @@
 #include "gdb/coding.h"
 #include <array>
+#include <cctype>
 #include <functional>
 #include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
@@ -18,6 +20,11 @@
 #include "async_test.h"
 #include <asio/basic_waitable_timer.hpp>
 #include "gdb/buffer.h"
+#include "gdb/gdb_err.h"
+#include "gdb/hex_codec.h"
+#include "gdb/query_handler.h"
+#include "util/small_vector.h"
+#include "alloc_counter.h"
 
 namespace ut = boost::ut;
 namespace gdb = tasarch::test::gdb;
@@ -85,4 +92,207 @@ ut::suite coding_tests = []{
 
         decode_buffer<Str<Hex>, Str<Hex>>(buf, std::bind(callback, 1, _1, _2));
     };
+
+    "binary coder test"_test = [&]{
+        using namespace tasarch::gdb::coders;
+        // what an X packet looks like after PacketIO undid the escaping
+        auto buf = create_buf(std::string("1337,4:\x00$#}", 11));
+        const u8* payload = buf.read_data() + 7;
+        bool called = false;
+        decode_buffer<Str<Hex, ',', true>, Str<Hex, ':', true>, Binary>(buf, [&](size_t addr, size_t len, std::span<const u8> data) {
+            called = true;
+            expect(addr == 0x1337UL);
+            expect(len == 4_ul);
+            expect(data.size() == 4_ul);
+            expect(data.data() == payload) << "binary data should not be copied";
+            expect(data[1] == '$' && data[3] == '}');
+        });
+        expect(called);
+        expect(buf.read_size() == 0_ul);
+
+        // empty data, used by gdb to probe for X
+        auto probe = create_buf("1337,0:");
+        decode_buffer<Str<Hex, ',', true>, Str<Hex, ':', true>, Binary>(probe, [&](size_t /*addr*/, size_t len, std::span<const u8> data) {
+            expect(len == 0_ul && data.empty());
+        });
+    };
+
+    "zero allocation decoding test"_test = [&]{
+        using namespace tasarch::gdb::coders;
+        using tasarch::test::count_allocations;
+        size_t addr = 0;
+        size_t len = 0;
+        std::span<const u8> data;
+        auto reset = [&](buffer& buf, std::string_view payload) {
+            buf.reset();
+            buf.append_buf(payload);
+        };
+        // allocate up front, so only decoding is counted
+        buffer buf(0x1000);
+
+        // m addr,len
+        reset(buf, "1337,40");
+        expect(count_allocations([&]{
+            decode_buffer<Str<Hex, ',', true>, Str<Hex>>(buf, [&](size_t a, size_t l) { addr = a; len = l; });
+        }) == 0_ul) << "m should not allocate";
+        expect(addr == 0x1337UL && len == 0x40UL);
+
+        // x addr,len
+        reset(buf, "deadbeef,1000");
+        expect(count_allocations([&]{
+            decode_buffer<Str<Hex, ',', true>, Str<Hex>>(buf, [&](size_t a, size_t l) { addr = a; len = l; });
+        }) == 0_ul) << "x should not allocate";
+        expect(addr == 0xdeadbeefUL && len == 0x1000UL);
+
+        // X addr,len:data
+        reset(buf, "1337,3:abc");
+        expect(count_allocations([&]{
+            decode_buffer<Str<Hex, ',', true>, Str<Hex, ':', true>, Binary>(buf, [&](size_t a, size_t l, std::span<const u8> d) { addr = a; len = l; data = d; });
+        }) == 0_ul) << "X should not allocate";
+        expect(addr == 0x1337UL && len == 3UL && data.size() == 3UL);
+
+        // slices that do not need to outlive the packet, e.g. query arguments
+        std::string_view name;
+        reset(buf, "Supported:multiprocess+");
+        expect(count_allocations([&]{
+            decode_buffer<Str<Id<std::string_view>, ':', true>, Str<Id<std::string_view>>>(buf, [&](std::string_view n, std::string_view /*rest*/) { name = n; });
+        }) == 0_ul) << "string views should not allocate";
+        expect(name == "Supported");
+
+        // a missing, required separator is still an error
+        reset(buf, "1337");
+        expect(throws([&]{
+            decode_buffer<Str<Hex, ',', true>, Str<Hex>>(buf, [](size_t /*a*/, size_t /*l*/) {});
+        }));
+    };
+
+    "hex kernels test"_test = [&]{
+        using tasarch::cpu::simd_level;
+        // long enough to go through the SIMD loops and have a scalar tail.
+        std::vector<u8> data(77);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = static_cast<u8>(i * 37);
+        }
+        std::string expected;
+        for (u8 b : data) {
+            expected += encode_hex(b >> 4);
+            expected += encode_hex(b);
+        }
+
+        for (auto level : {simd_level::scalar, simd_level::sse2, simd_level::ssse3, simd_level::avx2}) {
+            if (!tasarch::cpu::simd_supported(level)) {
+                continue;
+            }
+            std::string hex(2 * data.size(), '\0');
+            codec::hex_encode(data.data(), data.size(), reinterpret_cast<u8*>(hex.data()), level);
+            expect(hex == expected) << "kernel" << tasarch::cpu::simd_name(level) << "encoded incorrectly";
+
+            // decoding has to accept upper case as well
+            std::string upper = hex;
+            for (size_t i = 0; i < upper.size(); i += 3) {
+                upper[i] = static_cast<char>(std::toupper(upper[i]));
+            }
+            std::vector<u8> decoded(data.size());
+            size_t valid = codec::hex_decode(reinterpret_cast<const u8*>(upper.data()), upper.size(), decoded.data(), level);
+            expect(valid == upper.size() && decoded == data) << "kernel" << tasarch::cpu::simd_name(level) << "decoded incorrectly";
+
+            // invalid digits have to be found, no matter where in a block they are.
+            for (size_t pos : {size_t{0}, size_t{17}, size_t{63}, upper.size() - 1}) {
+                std::string broken = upper;
+                broken[pos] = 'g';
+                valid = codec::hex_decode(reinterpret_cast<const u8*>(broken.data()), broken.size(), decoded.data(), level);
+                expect(valid == pos) << "kernel" << tasarch::cpu::simd_name(level) << "missed invalid digit at" << pos;
+            }
+        }
+    };
+
+    "bytes coder test"_test = [&]{
+        using namespace tasarch::gdb::coders;
+        auto buf = create_buf("1337,4:deadBEEF");
+        decode_buffer<Str<Hex, ',', true>, Str<Hex, ':', true>, Bytes<>>(buf, [&](size_t /*addr*/, size_t /*len*/, std::vector<u8> data) {
+            expect(data == std::vector<u8>{0xde, 0xad, 0xbe, 0xef});
+        });
+
+        buffer out(0x10);
+        std::vector<u8> data{0x01, 0x23, 0xab};
+        Bytes<>::encode_to(data, out);
+        expect(out.read_view() == "0123ab");
+        std::vector<u8> too_big(8);
+        expect(throws<buffer_too_small>([&]{ Bytes<>::encode_to(too_big, out); }));
+
+        auto invalid = create_buf("12x4");
+        expect(throws<gdb_error>([&]{ Bytes<>::decode_from(invalid); }));
+        auto odd = create_buf("123");
+        expect(throws<gdb_error>([&]{ Bytes<>::decode_from(odd); }));
+    };
+
+    "small vector test"_test = [&]{
+        using namespace tasarch::gdb::coders;
+        using tasarch::small_vector;
+        small_vector<u8, 4> vec;
+        expect(vec.empty() && vec.is_inline());
+        for (u8 i = 0; i < 4; i++) {
+            vec.push_back(i);
+        }
+        expect(vec.is_inline() && vec.size() == 4_ul);
+        vec.push_back(vec[0]);
+        expect(!vec.is_inline() && vec.size() == 5_ul && vec.at(4) == 0_i);
+        expect(throws<std::out_of_range>([&]{ vec.at(5); }));
+
+        // Heap storage is handed over, inline storage is copied.
+        const u8* heap = vec.data();
+        auto moved = std::move(vec);
+        expect(moved.data() == heap && vec.empty());
+        auto copy = moved;
+        expect(copy == moved && copy.data() != heap);
+        small_vector<u8, 4> small{1, 2};
+        auto moved_small = std::move(small);
+        expect(moved_small.is_inline() && moved_small == small_vector<u8, 4>{1, 2});
+
+        moved_small.resize(3);
+        expect(moved_small.at(2) == 0_i);
+
+        auto buf = create_buf("deadbeef");
+        auto data = Bytes<payload_bytes>::decode_from(buf);
+        expect(data.is_inline() && data == payload_bytes{0xde, 0xad, 0xbe, 0xef});
+    };
+
+    "encode buffer test"_test = [&]{
+        using namespace tasarch::gdb::coders;
+        using tasarch::test::count_allocations;
+        buffer buf(0x100);
+        std::string_view name = "read";
+        std::string_view args = "3,1000,40";
+        std::vector<u8> data{0xde, 0xad};
+        std::vector<feature> features{feature("PacketSize", std::string("8000")), feature("qXfer:features:read", true), feature("multiprocess", false)};
+
+        expect(count_allocations([&]{
+            encode_buffer<Id<std::string_view>, Str<Id<std::string_view>, ','>, Id<std::string_view>>(buf, "F", name, args);
+        }) == 0_ul);
+        expect(buf.get_sv() == "Fread,3,1000,40");
+
+        // error codes are always two digits
+        buf.reset();
+        expect(count_allocations([&]{
+            encode_buffer<Id<std::string_view>, HexNumCoder<u8, 2>>(buf, "E", 3);
+        }) == 0_ul);
+        expect(buf.get_sv() == "E03");
+
+        buf.reset();
+        expect(count_allocations([&]{
+            encode_buffer<Str<NumCoder<int64_t, 16>, ','>, Opt<Str<Hex, ','>>, Opt<Str<Hex>>, Bytes<>>(buf, -0x1f, 0x40, std::nullopt, data);
+        }) == 0_ul);
+        expect(buf.get_sv() == "-1f,40,dead");
+
+        buf.reset();
+        expect(count_allocations([&]{
+            encode_buffer<ArrayCoder<FeatureCoder>>(buf, features);
+        }) == 0_ul);
+        expect(buf.get_sv() == "PacketSize=8000;qXfer:features:read+;multiprocess-");
+
+        // nothing is written if it does not fit
+        buffer small(4);
+        expect(throws<buffer_too_small>([&]{ encode_buffer<Id<std::string_view>>(small, "hello"); }));
+        expect(small.read_size() == 0_ul);
+    };
 };
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fmt/core.h>
+#include "gdb/asio.h"
+#include <asio/awaitable.hpp>
+#include <ut/ut.hpp>
+#include "gdb/buffer.h"
+#include "gdb/connection.h"
+#include "gdb/packet_io.h"
+#include "mock_target.h"
+#include "tcp_server_client_test.h"
+
+namespace ut = boost::ut;
+namespace gdb = tasarch::test::gdb;
+
+ut::suite connection_tests = []{
+    using namespace ut;
+    using namespace tasarch::gdb;
+    using tasarch::test::gdb::mock_target;
+
+    constexpr size_t base = 0x1000;
+    constexpr size_t size = 0x1000;
+
+    // Like the server does, keep them around: their coroutines only hold on to `this`.
+    std::vector<std::shared_ptr<connection>> connections;
+
+    // What gdb does for every command: send it, wait for the ack, then receive (and ack) the reply.
+    auto request = [](PacketIO& io, const std::string& req) -> asio::awaitable<std::string> {
+        buffer buf(gdb_packet_buffer_size);
+        buf.append_buf(req);
+        co_await io.send_packet(buf);
+        buf.reset();
+        co_await io.receive_packet(buf);
+        co_return buf.get_str();
+    };
+
+    "memory write with short payload test"_test = gdb::create_socket_test([&](transport remote, transport local) -> asio::awaitable<void>{
+        auto path = std::filesystem::temp_directory_path() / fmt::format("tasarch_connection_{}.bin", ::getpid());
+        auto target = std::make_shared<mock_target>(path, base, size);
+        auto conn = std::make_shared<connection>(std::move(remote), target);
+        connections.push_back(conn);
+        conn->start();
+        PacketIO client(local);
+
+        // Claims 4 bytes, but only has 2: nothing may be written.
+        auto reply = co_await request(client, "M1000,4:aabb");
+        expect(reply.starts_with('E')) << "got" << reply;
+        expect(target->memory()[0] == 0 && target->memory()[1] == 0);
+
+        reply = co_await request(client, "M1000,2:aabb");
+        expect(reply == "OK") << "got" << reply;
+        expect(target->memory()[0] == 0xaa && target->memory()[1] == 0xbb);
+
+        reply = co_await request(client, "D");
+        expect(reply == "OK") << "got" << reply;
+        std::filesystem::remove(path);
+    });
+
+    "detach removes only own breakpoints test"_test = gdb::create_socket_test([&](transport remote, transport local) -> asio::awaitable<void>{
+        auto path = std::filesystem::temp_directory_path() / fmt::format("tasarch_connection_{}.bin", ::getpid());
+        auto target = std::make_shared<mock_target>(path, base, size);
+        // As if set by another connection to the same target.
+        target->breakpoints().add(breakpoint_type::software, 0x1020, 1);
+        auto conn = std::make_shared<connection>(std::move(remote), target);
+        connections.push_back(conn);
+        conn->start();
+        PacketIO client(local);
+
+        expect(co_await request(client, "Z0,1010,1") == "OK");
+        expect(co_await request(client, "Z0,1018,1") == "OK");
+        expect(co_await request(client, "z0,1018,1") == "OK");
+        expect(target->breakpoints().size() == 2_ul);
+
+        auto reply = co_await request(client, "D");
+        expect(reply == "OK") << "got" << reply;
+        expect(!target->breakpoints().contains(0x1010));
+        expect(target->breakpoints().contains(0x1020));
+        std::filesystem::remove(path);
+    });
+};
@@ -0,0 +1,64 @@
+#include <array>
+#include <random>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <ut/ut.hpp>
+#include "gdb/crc32.h"
+#include "util/cpu_features.h"
+
+namespace ut = boost::ut;
+
+namespace {
+    /**
+     * @brief Bit at a time, straight from gdb's `xcrc32`.
+     */
+    auto reference_crc(std::span<const u8> data, u32 crc) -> u32
+    {
+        for (u8 b : data) {
+            crc ^= static_cast<u32>(b) << 24;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x80000000) != 0 ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+            }
+        }
+        return crc;
+    }
+} // namespace
+
+ut::suite crc32_tests = []{
+    using namespace ut;
+    using namespace tasarch::gdb;
+    using tasarch::cpu::simd_level;
+
+    constexpr std::array levels = {simd_level::scalar, simd_level::sse2, simd_level::ssse3, simd_level::avx2};
+
+    "crc check value test"_test = [&]{
+        std::string_view check = "123456789";
+        std::span<const u8> data(reinterpret_cast<const u8*>(check.data()), check.size());
+        expect(crc::crc32(data) == 0x0376e6e7UL);
+        expect(crc::crc32({}) == crc::initial);
+    };
+
+    "crc kernels test"_test = [&]{
+        std::mt19937 rng(1337);
+        std::vector<u8> data(1000);
+        for (auto& b : data) {
+            b = static_cast<u8>(rng());
+        }
+
+        for (size_t len : {0, 1, 7, 8, 15, 16, 31, 32, 33, 64, 100, 999, 1000}) {
+            std::span<const u8> part(data.data(), len);
+            u32 expected = reference_crc(part, crc::initial);
+            for (auto level : levels) {
+                if (!tasarch::cpu::simd_supported(level)) {
+                    continue;
+                }
+                expect(crc::crc32(part, crc::initial, level) == expected) << "kernel" << tasarch::cpu::simd_name(level) << "len" << len;
+
+                // continuing a crc has to give the same as doing it in one go.
+                u32 first = crc::crc32(part.first(len / 3), crc::initial, level);
+                expect(crc::crc32(part.subspan(len / 3), first, level) == expected) << "kernel" << tasarch::cpu::simd_name(level) << "len" << len << "split";
+            }
+        }
+    };
+};
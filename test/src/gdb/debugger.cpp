@@ -0,0 +1,149 @@
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <vector>
+#include <unistd.h>
+#include <fmt/core.h>
+#include <ut/ut.hpp>
+#include "mock_target.h"
+
+namespace ut = boost::ut;
+
+namespace {
+    struct temp_file
+    {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / fmt::format("tasarch_mock_target_{}.bin", ::getpid());
+
+        temp_file() = default;
+        temp_file(const temp_file&) = delete;
+        auto operator=(const temp_file&) -> temp_file& = delete;
+        temp_file(temp_file&&) = delete;
+        auto operator=(temp_file&&) -> temp_file& = delete;
+        ~temp_file()
+        {
+            std::filesystem::remove(path);
+        }
+    };
+} // namespace
+
+ut::suite mock_target_tests = []{
+    using namespace ut;
+    using namespace tasarch::gdb;
+    using tasarch::test::gdb::mock_target;
+
+    constexpr size_t base = 0x1000;
+    constexpr size_t size = 0x4000;
+
+    "mock target memory test"_test = [&]{
+        temp_file file;
+        {
+            std::ofstream out(file.path, std::ios::binary);
+            out << "hello gdb";
+        }
+        mock_target target(file.path, base, size);
+        expect(target.memory().size() == size);
+
+        std::array<u8, 9> hello {};
+        expect(target.read_memory(base, hello) == hello.size());
+        expect(std::string_view(reinterpret_cast<const char*>(hello.data()), hello.size()) == "hello gdb");
+
+        // Accesses are cut off at the end of the mapping and fail completely outside of it.
+        std::array<u8, 16> data {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+        expect(target.write_memory(base + size - 4, data) == 4_ul);
+        expect(target.read_memory(base + size - 4, hello) == 4_ul);
+        expect(hello[3] == 4);
+        expect(target.read_memory(base - 1, hello) == 0_ul);
+        expect(target.write_memory(base + size, data) == 0_ul);
+
+        std::array<u8, 4> first {};
+        std::array<u8, 4> second {};
+        std::array<Debugger::memory_access, 2> accesses = {{
+            {.address = base + 2, .data = first},
+            {.address = base + size + 2, .data = second},
+        }};
+        target.read_memory(accesses);
+        expect(accesses[0].done == 4_ul);
+        expect(accesses[1].done == 0_ul);
+        expect(first[0] == 'l');
+    };
+
+    "mock target file backing test"_test = [&]{
+        temp_file file;
+        {
+            mock_target target(file.path, base, size);
+            std::array<u8, 3> data {0xde, 0xad, 0xbe};
+            target.write_memory(base + 0x10, data);
+        }
+        // Writes go straight to the file.
+        expect(std::filesystem::file_size(file.path) == size);
+        mock_target target(file.path, base, size);
+        expect(target.memory()[0x11] == 0xad);
+    };
+
+    "mock target registers test"_test = [&]{
+        temp_file file;
+        mock_target target(file.path, base, size);
+        expect(target.registers().size() == 24_ul);
+        expect(target.register_block_size() == 17 * 8 + 7 * 4);
+        expect(target.registers()[mock_target::pc_register].name == "rip");
+
+        std::array<u8, 8> rip {0x78, 0x56, 0x34, 0x12};
+        target.write_register(mock_target::pc_register, rip);
+        expect(target.pc() == 0x12345678UL);
+
+        std::vector<u8> all(target.register_block_size());
+        target.read_registers(all);
+        expect(all[16 * 8] == 0x78);
+        all[0] = 0x42;
+        target.write_registers(all);
+        std::array<u8, 8> rax {};
+        target.read_register(0, rax);
+        expect(rax[0] == 0x42);
+    };
+
+    "mock target description test"_test = [&]{
+        temp_file file;
+        mock_target target(file.path, base, size);
+
+        auto xml = target.target_xml();
+        expect(xml.starts_with("<?xml"));
+        expect(xml.find("<architecture>i386:x86-64</architecture>") != std::string_view::npos);
+        expect(xml.find("<reg name=\"rip\" bitsize=\"64\" type=\"code_ptr\" group=\"general\"/>") != std::string_view::npos);
+        expect(xml.find("<reg name=\"eflags\" bitsize=\"32\" type=\"uint32\" group=\"general\"/>") != std::string_view::npos);
+        expect(xml.ends_with("</target>\n"));
+        // Generated once, afterwards always the same storage.
+        expect(target.target_xml().data() == xml.data());
+
+        auto map = target.memory_map_xml();
+        expect(map.find("<memory type=\"ram\" start=\"0x1000\" length=\"0x4000\"/>") != std::string_view::npos);
+        expect(map.find("<memory type=\"ram\" start=\"0x1337133713370000\"") != std::string_view::npos);
+        expect(target.memory_map_xml().data() == map.data());
+    };
+
+    "mock target execution test"_test = [&]{
+        temp_file file;
+        mock_target target(file.path, base, size);
+        target.set_pc(base);
+
+        std::optional<stop_reason> stopped;
+        target.resume(resume_mode::step, [&](stop_reason reason) { stopped = reason; });
+        expect(stopped.has_value());
+        expect(stopped->signal == stop_reason::sigtrap);
+        expect(target.pc() == base + 1);
+
+        stopped.reset();
+        target.resume(resume_mode::cont, [&](stop_reason reason) { stopped = reason; });
+        expect(target.is_running());
+        expect(!stopped.has_value());
+        target.request_break();
+        expect(!target.is_running());
+        expect(stopped.has_value() && stopped->signal == stop_reason::sigint);
+        expect(target.last_stop().signal == stop_reason::sigint);
+
+        // Breaking a stopped target does nothing.
+        stopped.reset();
+        target.request_break();
+        expect(!stopped.has_value());
+    };
+};
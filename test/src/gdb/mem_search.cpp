@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+#include <ut/ut.hpp>
+#include "gdb/mem_search.h"
+#include "util/cpu_features.h"
+
+namespace ut = boost::ut;
+
+ut::suite mem_search_tests = []{
+    using namespace ut;
+    using namespace tasarch::gdb;
+    using tasarch::cpu::simd_level;
+
+    constexpr std::array levels = {simd_level::scalar, simd_level::sse2, simd_level::ssse3, simd_level::avx2};
+
+    "search edge cases test"_test = [&]{
+        std::vector<u8> hay = {1, 2, 3, 4, 5};
+        std::vector<u8> none;
+        for (auto level : levels) {
+            if (!tasarch::cpu::simd_supported(level)) {
+                continue;
+            }
+            expect(search::find(hay, none, level) == std::optional<size_t>(0));
+            expect(search::find(none, hay, level) == std::nullopt);
+            expect(search::find(hay, std::vector<u8>{3}, level) == std::optional<size_t>(2));
+            expect(search::find(hay, std::vector<u8>{4, 5}, level) == std::optional<size_t>(3));
+            expect(search::find(hay, hay, level) == std::optional<size_t>(0));
+            expect(search::find(hay, std::vector<u8>{1, 2, 3, 4, 5, 6}, level) == std::nullopt);
+            expect(search::find(hay, std::vector<u8>{2, 4}, level) == std::nullopt);
+        }
+    };
+
+    "search kernels test"_test = [&]{
+        // Few distinct values, so first and last byte match a lot and every candidate has to be verified properly.
+        std::mt19937 rng(1337);
+        std::vector<u8> hay(1000);
+        for (auto& b : hay) {
+            b = static_cast<u8>(rng() % 4);
+        }
+
+        for (size_t len : {2, 3, 7, 16, 33}) {
+            for (size_t trial = 0; trial < 20; trial++) {
+                size_t start = rng() % (hay.size() - len + 1);
+                std::vector<u8> pattern(hay.begin() + static_cast<ptrdiff_t>(start), hay.begin() + static_cast<ptrdiff_t>(start + len));
+                // search a window ending at every possible alignment, so the scalar tail is exercised as well.
+                std::span<const u8> window(hay.data(), std::min(hay.size(), start + len + trial));
+
+                std::optional<size_t> expected;
+                for (size_t i = 0; i + len <= window.size() && !expected; i++) {
+                    if (std::equal(pattern.begin(), pattern.end(), window.begin() + static_cast<ptrdiff_t>(i))) {
+                        expected = i;
+                    }
+                }
+
+                for (auto level : levels) {
+                    if (!tasarch::cpu::simd_supported(level)) {
+                        continue;
+                    }
+                    expect(search::find(window, pattern, level) == expected) << "kernel" << tasarch::cpu::simd_name(level) << "len" << len;
+                }
+            }
+        }
+
+        // And a pattern that is not there at all.
+        std::vector<u8> missing = {0, 1, 9, 2};
+        for (auto level : levels) {
+            if (tasarch::cpu::simd_supported(level)) {
+                expect(search::find(hay, missing, level) == std::nullopt) << "kernel" << tasarch::cpu::simd_name(level);
+            }
+        }
+    };
+};
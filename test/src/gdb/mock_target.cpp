@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fmt/core.h>
+#include "mock_target.h"
+
+namespace tasarch::test::gdb {
+    namespace {
+        auto last_error(const std::string& what) -> std::system_error
+        {
+            return {errno, std::generic_category(), what};
+        }
+    } // namespace
+
+    mock_target::mock_target(const std::filesystem::path& backing, size_t base, size_t size) : base(base), size(size), region{ .start = base, .length = size }
+    {
+        this->fd = ::open(backing.c_str(), O_RDWR | O_CREAT, 0644);
+        if (this->fd < 0) {
+            throw last_error(fmt::format("cannot open {}", backing.string()));
+        }
+        struct stat info {};
+        if (::fstat(this->fd, &info) != 0 || (static_cast<size_t>(info.st_size) < size && ::ftruncate(this->fd, static_cast<off_t>(size)) != 0)) {
+            auto err = last_error(fmt::format("cannot grow {} to 0x{:x} bytes", backing.string(), size));
+            ::close(this->fd);
+            throw err;
+        }
+        void* mapped = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+        if (mapped == MAP_FAILED) {
+            auto err = last_error(fmt::format("cannot map {}", backing.string()));
+            ::close(this->fd);
+            throw err;
+        }
+        this->mapping = static_cast<u8*>(mapped);
+    }
+
+    mock_target::~mock_target()
+    {
+        ::munmap(this->mapping, this->size);
+        ::close(this->fd);
+    }
+
+    auto mock_target::read_memory(size_t address, std::span<u8> dst) -> size_t
+    {
+        if (address < this->base || address - this->base >= this->size) {
+            return 0;
+        }
+        size_t offset = address - this->base;
+        size_t len = std::min(dst.size(), this->size - offset);
+        std::memcpy(dst.data(), this->mapping + offset, len);
+        return len;
+    }
+
+    auto mock_target::write_memory(size_t address, std::span<const u8> src) -> size_t
+    {
+        if (address < this->base || address - this->base >= this->size) {
+            return 0;
+        }
+        size_t offset = address - this->base;
+        size_t len = std::min(src.size(), this->size - offset);
+        std::memcpy(this->mapping + offset, src.data(), len);
+        return len;
+    }
+
+    auto mock_target::registers() const -> std::span<const register_info>
+    {
+        return x86_64_registers;
+    }
+
+    auto mock_target::register_offset(size_t idx) -> size_t
+    {
+        size_t offset = 0;
+        for (size_t i = 0; i < idx; i++) {
+            offset += x86_64_registers.at(i).size();
+        }
+        return offset;
+    }
+
+    void mock_target::read_registers(std::span<u8> dst)
+    {
+        std::lock_guard guard(this->lock);
+        std::copy_n(this->regs.begin(), std::min(dst.size(), this->regs.size()), dst.begin());
+    }
+
+    void mock_target::read_register(size_t idx, std::span<u8> dst)
+    {
+        std::lock_guard guard(this->lock);
+        size_t len = std::min(dst.size(), x86_64_registers.at(idx).size());
+        std::copy_n(this->regs.begin() + static_cast<ptrdiff_t>(register_offset(idx)), len, dst.begin());
+    }
+
+    void mock_target::write_register(size_t idx, std::span<const u8> src)
+    {
+        std::lock_guard guard(this->lock);
+        size_t len = std::min(src.size(), x86_64_registers.at(idx).size());
+        std::copy_n(src.begin(), len, this->regs.begin() + static_cast<ptrdiff_t>(register_offset(idx)));
+    }
+
+    void mock_target::write_registers(std::span<const u8> src)
+    {
+        std::lock_guard guard(this->lock);
+        std::copy_n(src.begin(), std::min(src.size(), this->regs.size()), this->regs.begin());
+    }
+
+    auto mock_target::pc() const -> u64
+    {
+        std::lock_guard guard(this->lock);
+        u64 value = 0;
+        // little endian, like the target.
+        std::memcpy(&value, this->regs.data() + register_offset(pc_register), sizeof(value));
+        return value;
+    }
+
+    void mock_target::set_pc(u64 value)
+    {
+        std::lock_guard guard(this->lock);
+        std::memcpy(this->regs.data() + register_offset(pc_register), &value, sizeof(value));
+    }
+
+    auto mock_target::last_stop() const -> stop_reason
+    {
+        std::lock_guard guard(this->lock);
+        return this->stopped;
+    }
+
+    auto mock_target::is_running() const -> bool
+    {
+        std::lock_guard guard(this->lock);
+        return static_cast<bool>(this->pending);
+    }
+
+    void mock_target::resume(resume_mode mode, stop_handler on_stop)
+    {
+        if (mode == resume_mode::step) {
+            this->set_pc(this->pc() + 1);
+            {
+                std::lock_guard guard(this->lock);
+                this->stopped = stop_reason{ .type = stop_reason::kind::signal, .signal = stop_reason::sigtrap };
+            }
+            on_stop(this->last_stop());
+            return;
+        }
+        std::lock_guard guard(this->lock);
+        this->pending = std::move(on_stop);
+    }
+
+    void mock_target::request_break()
+    {
+        this->halt(stop_reason{ .type = stop_reason::kind::signal, .signal = stop_reason::sigint });
+    }
+
+    auto mock_target::run(size_t steps) -> bool
+    {
+        if (!this->is_running()) {
+            return false;
+        }
+        // Executing the instruction at the current pc is what got us off a breakpoint, so it is never checked.
+        u64 pc = this->pc();
+        auto& bps = this->breakpoints();
+        for (size_t i = 0; i < steps; i++) {
+            pc++;
+            if (bps.contains(pc)) [[unlikely]] {
+                this->set_pc(pc);
+                if (!bps.hit(pc, *this)) {
+                    // Condition was false, keep going.
+                    continue;
+                }
+                this->halt(stop_reason{ .type = stop_reason::kind::signal, .signal = stop_reason::sigtrap });
+                return true;
+            }
+        }
+        this->set_pc(pc);
+        return false;
+    }
+
+    void mock_target::halt(stop_reason reason)
+    {
+        stop_handler handler;
+        {
+            std::lock_guard guard(this->lock);
+            if (!this->pending) {
+                return;
+            }
+            this->stopped = reason;
+            handler = std::exchange(this->pending, nullptr);
+        }
+        // Outside the lock, the handler might well look at the target.
+        handler(reason);
+    }
+} // namespace tasarch::test::gdb
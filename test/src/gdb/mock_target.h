@@ -0,0 +1,123 @@
+/**
+ * @file mock_target.h
+ * @brief An in-process `Debugger` target, for tests and benchmarks.
+ *
+ * Its memory is a file mapped into our address space (so e.g. a RAM dump can be debugged directly) and its registers are those of x86-64 (without the floating point ones).
+ * Nothing is actually executed: stepping just moves the program counter forward by one byte and continuing runs until a break is requested.
+ */
+#ifndef __TEST_MOCK_TARGET_H
+#define __TEST_MOCK_TARGET_H
+
+#include <array>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include "gdb/debugger.h"
+#include "util/defines.h"
+
+namespace tasarch::test::gdb {
+    using tasarch::gdb::Debugger;
+    using tasarch::gdb::memory_region;
+    using tasarch::gdb::register_info;
+    using tasarch::gdb::resume_mode;
+    using tasarch::gdb::stop_reason;
+
+    class mock_target : public Debugger
+    {
+    public:
+        /**
+         * @brief Registers in `g` packet order, like gdb's `64bit-core.xml` without the floating point ones.
+         */
+        static constexpr std::array<register_info, 24> x86_64_registers = {{
+            {"rax", 64}, {"rbx", 64}, {"rcx", 64}, {"rdx", 64},
+            {"rsi", 64}, {"rdi", 64}, {"rbp", 64, "data_ptr"}, {"rsp", 64, "data_ptr"},
+            {"r8", 64}, {"r9", 64}, {"r10", 64}, {"r11", 64},
+            {"r12", 64}, {"r13", 64}, {"r14", 64}, {"r15", 64},
+            {"rip", 64, "code_ptr"}, {"eflags", 32, "uint32"},
+            {"cs", 32}, {"ss", 32}, {"ds", 32}, {"es", 32}, {"fs", 32}, {"gs", 32},
+        }};
+        static constexpr size_t pc_register = 16;
+
+        /**
+         * @brief Map `size` bytes of `backing` (created or grown if needed) to the target addresses `[base, base + size)`.
+         * @throws std::system_error if the file cannot be opened or mapped.
+         */
+        mock_target(const std::filesystem::path& backing, size_t base, size_t size);
+        mock_target(const mock_target&) = delete;
+        auto operator=(const mock_target&) -> mock_target& = delete;
+        mock_target(mock_target&&) = delete;
+        auto operator=(mock_target&&) -> mock_target& = delete;
+        ~mock_target() override;
+
+        auto read_memory(size_t address, std::span<u8> dst) -> size_t override;
+        auto write_memory(size_t address, std::span<const u8> src) -> size_t override;
+        using Debugger::read_memory;
+        using Debugger::write_memory;
+
+        [[nodiscard]] auto registers() const -> std::span<const register_info> override;
+        void read_registers(std::span<u8> dst) override;
+        void read_register(size_t idx, std::span<u8> dst) override;
+        void write_register(size_t idx, std::span<const u8> src) override;
+        void write_registers(std::span<const u8> src) override;
+
+        [[nodiscard]] auto architecture() const -> std::string_view override
+        {
+            return "i386:x86-64";
+        }
+        /**
+         * @brief Just the mapped file, as ram.
+         */
+        [[nodiscard]] auto memory_map() const -> std::span<const memory_region> override
+        {
+            return {&this->region, 1};
+        }
+
+        [[nodiscard]] auto last_stop() const -> stop_reason override;
+        void resume(resume_mode mode, stop_handler on_stop) override;
+        void request_break() override;
+
+        /**
+         * @brief Stop a running target with `reason`, as if it had e.g. hit a breakpoint. Does nothing if it is not running.
+         */
+        void halt(stop_reason reason);
+
+        /**
+         * @brief Execute up to `steps` instructions of a running target (each just advancing the pc by one), stopping with `SIGTRAP` at the first breakpoint.
+         * Does nothing if the target is not running.
+         * @return Whether a breakpoint was hit.
+         */
+        auto run(size_t steps) -> bool;
+
+        [[nodiscard]] auto is_running() const -> bool;
+
+        /**
+         * @brief The mapped memory, for inspecting it directly.
+         */
+        [[nodiscard]] auto memory() const -> std::span<u8>
+        {
+            return {this->mapping, this->size};
+        }
+
+        [[nodiscard]] auto pc() const -> u64;
+        void set_pc(u64 value);
+
+    private:
+        /**
+         * @brief Offset of register `idx` in `regs`.
+         */
+        static auto register_offset(size_t idx) -> size_t;
+
+        size_t base;
+        size_t size;
+        int fd = -1;
+        u8* mapping = nullptr;
+        memory_region region;
+
+        mutable std::mutex lock;
+        std::array<u8, 8 * 17 + 4 * 7> regs {};
+        stop_reason stopped;
+        stop_handler pending;
+    };
+} // namespace tasarch::test::gdb
+
+#endif /* __TEST_MOCK_TARGET_H */
@@ -0,0 +1,135 @@
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <ut/ut.hpp>
+#include "alloc_counter.h"
+#include "config/config.h"
+#include "gdb/buffer.h"
+#include "gdb/packet_format.h"
+#include "log/logging.h"
+
+namespace ut = boost::ut;
+
+ut::suite packet_format_tests = []{
+    using namespace ut;
+    using namespace tasarch::gdb;
+
+    auto config_val = tasarch::config::parse_toml("logging.test.gdb.level = 'trace'\nlogging.gdb.level = 'trace'");
+    tasarch::config::conf()->load_from(config_val);
+
+    auto create_buf = [](std::string_view s){
+        buffer buf(0x1000);
+        buf.append_buf(s);
+        return buf;
+    };
+
+    static_assert(std::is_same_v<format::args_t<"%x,%x:%b">, std::tuple<size_t, size_t, payload_bytes>>);
+    static_assert(std::is_same_v<format::args_t<"%x,%x:%r">, std::tuple<size_t, size_t, std::span<const u8>>>);
+    static_assert(std::is_same_v<format::args_t<"%i[,%x[,%s[;%s]]]">, std::tuple<int64_t, std::optional<size_t>, std::optional<std::string_view>, std::optional<std::string_view>>>);
+    static_assert(format::tokens<"100%%">.size() == 4);
+
+    "memory packets test"_test = [&]{
+        bool called = false;
+        auto buf = create_buf("1337,4:deadBEEF");
+        parse_packet<"%x,%x:%b">(buf, [&](size_t addr, size_t len, payload_bytes data) {
+            called = true;
+            expect(addr == 0x1337UL && len == 4UL);
+            expect(data == payload_bytes{0xde, 0xad, 0xbe, 0xef});
+        });
+        expect(called);
+        expect(buf.read_size() == 0_ul);
+
+        auto bin = create_buf(std::string_view("10,3:\x00#}", 8));
+        const u8* payload = bin.read_data() + 5;
+        parse_packet<"%x,%x:%r">(bin, [&](size_t addr, size_t len, std::span<const u8> data) {
+            expect(addr == 0x10UL && len == 3UL);
+            expect(data.data() == payload && data.size() == 3UL) << "raw data should not be copied";
+        });
+    };
+
+    "optional parts test"_test = [&]{
+        struct sample
+        {
+            std::string_view packet;
+            int64_t retcode;
+            std::optional<size_t> errorno;
+            std::optional<std::string_view> ctrlc;
+            std::optional<std::string_view> attachment;
+        };
+        for (const auto& smp : {
+            sample { "5", 5, std::nullopt, std::nullopt, std::nullopt },
+            sample { "-1,16", -1, 0x16, std::nullopt, std::nullopt },
+            sample { "-1,4,C", -1, 4, "C", std::nullopt },
+            sample { "20,0,;data", 0x20, 0, "", "data" },
+        }) {
+            bool called = false;
+            auto buf = create_buf(smp.packet);
+            parse_packet<"%i[,%x[,%s[;%s]]]">(buf, [&](int64_t ret, std::optional<size_t> err, std::optional<std::string_view> ctrlc, std::optional<std::string_view> attachment) {
+                called = true;
+                expect(ret == smp.retcode) << smp.packet;
+                expect(err == smp.errorno && ctrlc == smp.ctrlc && attachment == smp.attachment) << smp.packet;
+            });
+            expect(called) << smp.packet;
+        }
+    };
+
+    "parse errors test"_test = [&]{
+        struct sample
+        {
+            std::string_view packet;
+            size_t offset;
+        };
+        for (const auto& smp : {
+            sample { "12", 2 },
+            sample { "12,", 3 },
+            sample { ",3", 0 },
+            sample { "1g,3", 1 },
+            sample { "12,3x", 4 },
+            sample { "1,2:abc", 4 },
+            sample { "1,2:abzz", 6 },
+            sample { "11111111111111111,1", 0 },
+        }) {
+            auto buf = create_buf(smp.packet);
+            size_t offset = 0;
+            try {
+                parse_packet<"%x,%x[:%b]">(buf, [](size_t /*addr*/, size_t /*len*/, std::optional<payload_bytes> /*data*/) {});
+            } catch (packet_parse_error& e) {
+                offset = e.offset;
+                expect(e.code == malformed_packet);
+            }
+            expect(offset == smp.offset) << smp.packet << "failed at" << offset;
+        }
+    };
+
+    "zero allocation parsing test"_test = [&]{
+        using tasarch::test::count_allocations;
+        buffer buf(0x1000);
+        size_t addr = 0;
+        size_t len = 0;
+        buf.append_buf(std::string_view("deadbeef,40"));
+        expect(count_allocations([&]{
+            parse_packet<"%x,%x">(buf, [&](size_t a, size_t l) { addr = a; len = l; });
+        }) == 0_ul);
+        expect(addr == 0xdeadbeefUL && len == 0x40UL);
+
+        buf.reset();
+        buf.append_buf(std::string_view("1337,3:abc"));
+        expect(count_allocations([&]{
+            parse_packet<"%x,%x:%r">(buf, [&](size_t a, size_t l, std::span<const u8> /*data*/) { addr = a; len = l; });
+        }) == 0_ul);
+        expect(addr == 0x1337UL && len == 3UL);
+
+        // Small memory writes are decoded inline and moved into the callback.
+        bool was_inline = false;
+        buf.reset();
+        buf.append_buf(std::string_view("1337,4:deadbeef"));
+        expect(count_allocations([&]{
+            parse_packet<"%x,%x:%b">(buf, [&](size_t a, size_t l, payload_bytes data) { addr = a; len = l; was_inline = data.is_inline(); });
+        }) == 0_ul);
+        expect(was_inline);
+    };
+};
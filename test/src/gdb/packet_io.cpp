@@ -1,10 +1,13 @@
+#include <algorithm>
 #include <array>
 #include <ostream>
 #include <stdexcept>
+#include <tuple>
 #include "gdb/common.h"
 #include "gdb/packet_io.h"
 #include "tcp_server_client_test.h"
 #include <asio/awaitable.hpp>
+#include <asio/co_spawn.hpp>
 #include <asio/use_awaitable.hpp>
 #include <asio/write.hpp>
 #include <ut/ut.hpp>
@@ -12,6 +15,7 @@
 #include "async_test.h"
 #include <asio/basic_waitable_timer.hpp>
 #include "gdb/buffer.h"
+#include "gdb/packet_codec.h"
 
 namespace ut = boost::ut;
 namespace gdb = tasarch::test::gdb;
@@ -56,7 +60,93 @@ abcdefghijklmnopqrstuvwxyz{|}~
     // the output for a request is slightly different, since * is not encoded!
     std::string encoded_mean_data_req = "\x24\x46\x31\x62\x39\x3b\x54\x68\x69\x73\x20\x74\x65\x78\x74\x20\x66\x69\x6c\x65\x20\x69\x73\x20\x61\x20\x74\x65\x73\x74\x20\x69\x6e\x70\x75\x74\x20\x66\x6f\x72\x20\x47\x44\x42\x27\x73\x20\x66\x69\x6c\x65\x20\x74\x72\x61\x6e\x73\x66\x65\x72\x20\x63\x6f\x6d\x6d\x61\x6e\x64\x73\x2e\x20\x20\x49\x74\x0a\x63\x6f\x6e\x74\x61\x69\x6e\x73\x20\x73\x6f\x6d\x65\x20\x63\x68\x61\x72\x61\x63\x74\x65\x72\x73\x20\x77\x68\x69\x63\x68\x20\x6e\x65\x65\x64\x20\x74\x6f\x20\x62\x65\x20\x65\x73\x63\x61\x70\x65\x64\x20\x69\x6e\x20\x72\x65\x6d\x6f\x74\x65\x20\x70\x72\x6f\x74\x6f\x63\x6f\x6c\x0a\x70\x61\x63\x6b\x65\x74\x73\x2c\x20\x6c\x69\x6b\x65\x20\x22\x2a\x22\x20\x61\x6e\x64\x20\x22\x7d\x5d\x22\x20\x61\x6e\x64\x20\x22\x7d\x04\x22\x20\x61\x6e\x64\x20\x22\x7d\x03\x22\x2e\x20\x20\x41\x63\x74\x75\x61\x6c\x6c\x79\x2c\x20\x69\x74\x20\x63\x6f\x6e\x74\x61\x69\x6e\x73\x0a\x61\x20\x67\x6f\x6f\x64\x20\x73\x61\x6d\x70\x6c\x69\x6e\x67\x20\x6f\x66\x20\x70\x72\x69\x6e\x74\x61\x62\x6c\x65\x20\x63\x68\x61\x72\x61\x63\x74\x65\x72\x73\x3a\x0a\x0a\x21\x22\x7d\x03\x7d\x04\x25\x26\x27\x28\x29\x2a\x2b\x2c\x2d\x2e\x2f\x30\x31\x32\x33\x34\x35\x36\x37\x38\x39\x3a\x3b\x3c\x3d\x3e\x3f\x40\x0a\x41\x42\x43\x44\x45\x46\x47\x48\x49\x4a\x4b\x4c\x4d\x4e\x4f\x50\x51\x52\x53\x54\x55\x56\x57\x58\x59\x5a\x5b\x5c\x5d\x5e\x5f\x60\x0a\x61\x62\x63\x64\x65\x66\x67\x68\x69\x6a\x6b\x6c\x6d\x6e\x6f\x70\x71\x72\x73\x74\x75\x76\x77\x78\x79\x7a\x7b\x7c\x7d\x5d\x7e\x0a\x0a\x21\x22\x7d\x03\x7d\x04\x25\x26\x27\x28\x29\x2a\x2b\x2c\x2d\x2e\x2f\x30\x31\x32\x33\x34\x35\x36\x37\x38\x39\x3a\x3b\x3c\x3d\x3e\x3f\x40\x0a\x41\x42\x43\x44\x45\x46\x47\x48\x49\x4a\x4b\x4c\x4d\x4e\x4f\x50\x51\x52\x53\x54\x55\x56\x57\x58\x59\x5a\x5b\x5c\x5d\x5e\x5f\x60\x0a\x61\x62\x63\x64\x65\x66\x67\x68\x69\x6a\x6b\x6c\x6d\x6e\x6f\x70\x71\x72\x73\x74\x75\x76\x77\x78\x79\x7a\x7b\x7c\x7d\x5d\x7e\x0a\x23\x35\x30";
 
-    auto recv_string = [](tcp::socket& sock) -> asio::awaitable<std::string>{
+    "escape kernels match gdb encoding"_test = [&]{
+        using tasarch::cpu::simd_level;
+        // strip $ in front and #cs at the end.
+        std::string expected = encoded_mean_data.substr(1, encoded_mean_data.size() - 4);
+        u8 expected_checksum = static_cast<u8>(std::stoul(encoded_mean_data.substr(encoded_mean_data.size() - 2), nullptr, 16));
+        for (auto level : {simd_level::scalar, simd_level::sse2, simd_level::avx2}) {
+            if (!tasarch::cpu::simd_supported(level)) {
+                continue;
+            }
+            std::string out;
+            out.resize(2 * file_mean_data.size());
+            auto res = codec::escape_response(reinterpret_cast<const u8*>(file_mean_data.data()), file_mean_data.size(), reinterpret_cast<u8*>(out.data()), level);
+            out.resize(res.size);
+            expect(out == expected) << "kernel" << tasarch::cpu::simd_name(level) << "escaped incorrectly";
+            expect(res.checksum == expected_checksum) << "kernel" << tasarch::cpu::simd_name(level) << "has wrong checksum";
+        }
+    };
+
+    "scan kernels stop at end and escape"_test = [&]{
+        using tasarch::cpu::simd_level;
+        const auto* data = reinterpret_cast<const u8*>(encoded_mean_data_req.data());
+        auto expected = codec::scan_request(data + 1, encoded_mean_data_req.size() - 1, simd_level::scalar);
+        // first `}` comes right after 'like "*" and "'
+        expect(encoded_mean_data_req[1 + expected.size] == '}');
+        for (auto level : {simd_level::sse2, simd_level::avx2}) {
+            if (!tasarch::cpu::simd_supported(level)) {
+                continue;
+            }
+            auto res = codec::scan_request(data + 1, encoded_mean_data_req.size() - 1, level);
+            expect(res.size == expected.size && res.checksum == expected.checksum) << "kernel" << tasarch::cpu::simd_name(level) << "disagrees with scalar";
+        }
+    };
+
+    "response scan finds first encoded byte"_test = [&]{
+        using tasarch::cpu::simd_level;
+        const auto* data = reinterpret_cast<const u8*>(file_mean_data.data());
+        size_t len = file_mean_data.size();
+        for (bool rle : {false, true}) {
+            auto expected = codec::scan_response(data, len, rle, simd_level::scalar);
+            // first thing needing an escape is the `*` in `like "*"`.
+            expect(file_mean_data[expected.size] == '*');
+            for (auto level : {simd_level::sse2, simd_level::avx2}) {
+                if (!tasarch::cpu::simd_supported(level)) {
+                    continue;
+                }
+                auto res = codec::scan_response(data, len, rle, level);
+                expect(res.size == expected.size && res.checksum == expected.checksum) << "kernel" << tasarch::cpu::simd_name(level) << "disagrees with scalar";
+            }
+        }
+
+        // runs only stop the scan with rle enabled.
+        std::string zeroes = "ab" + std::string(16, '0');
+        const auto* zero_data = reinterpret_cast<const u8*>(zeroes.data());
+        expect(codec::scan_response(zero_data, zeroes.size(), false).size == zeroes.size());
+        expect(codec::scan_response(zero_data, zeroes.size(), true).size == 2_ul);
+    };
+
+    "rle kernels follow gdb rules"_test = [&]{
+        using tasarch::cpu::simd_level;
+        auto encode = [](const std::string& inp, simd_level level) {
+            std::string out;
+            out.resize(2 * inp.size());
+            auto res = codec::escape_rle_response(reinterpret_cast<const u8*>(inp.data()), inp.size(), reinterpret_cast<u8*>(out.data()), level);
+            out.resize(res.size);
+            return out;
+        };
+        for (auto level : {simd_level::scalar, simd_level::sse2, simd_level::avx2}) {
+            if (!tasarch::cpu::simd_supported(level)) {
+                continue;
+            }
+            // too short to be worth it
+            expect(encode("000", level) == "000");
+            expect(encode("0000", level) == "0* ");
+            // 6 and 7 repeats would be encoded as '#' and '$', so use 5 repeats instead.
+            expect(encode("0000000", level) == "0*\"0");
+            expect(encode("00000000", level) == "0*\"00");
+            expect(encode(std::string(10, '0'), level) == "0*&");
+            // at most 97 repeats fit into a single printable character
+            expect(encode(std::string(99, '0'), level) == "0*~0");
+            // characters needing escaping are never run length encoded
+            expect(encode("****", level) == "}\x0a}\x0a}\x0a}\x0a");
+            // the mean data does not contain any runs
+            expect(encode(file_mean_data, level) == encoded_mean_data.substr(1, encoded_mean_data.size() - 4));
+        }
+    };
+
+    auto recv_string = [](transport& sock) -> asio::awaitable<std::string>{
         std::string inp;
         inp.resize(tasarch::gdb::gdb_packet_buffer_size);
         size_t size = co_await sock.async_receive(asio::buffer(inp), asio::use_awaitable);
@@ -64,7 +154,7 @@ abcdefghijklmnopqrstuvwxyz{|}~
         co_return inp;
     };
 
-    "simple packets test"_test = gdb::create_socket_test([&](tcp::socket remote, tcp::socket local) -> asio::awaitable<void>{
+    auto simple_packets = [&](transport remote, transport local) -> asio::awaitable<void>{
         tasarch::gdb::PacketIO io(remote);
         // for simple tests, no ack for now
         io.set_no_ack();
@@ -87,14 +177,92 @@ abcdefghijklmnopqrstuvwxyz{|}~
         file_mean_f.open("file_mean_f.txt", std::ios::binary | std::ios::out | std::ios::trunc);
         file_mean_f << file_mean_data;
         file_mean_f.close();
+    };
+
+    "simple packets test"_test = gdb::create_socket_test(simple_packets);
+    "simple packets over tcp test"_test = gdb::create_socket_test(simple_packets, 5000ms, gdb::socket_kind::tcp);
+    "simple packets over unix socket test"_test = gdb::create_socket_test(simple_packets, 5000ms, gdb::socket_kind::unix_socket);
+
+    "send with rle test"_test = gdb::create_socket_test([&](transport remote, transport local) -> asio::awaitable<void>{
+        tasarch::gdb::PacketIO io(remote);
+        io.set_no_ack();
+        io.set_rle(true);
+
+        buffer zeroes(gdb_packet_buffer_size);
+        std::string zero_str = "ab" + std::string(16, '0');
+        zeroes.append_buf(zero_str);
+        co_await io.send_packet(zeroes);
+        std::string recvd_str = co_await recv_string(local);
+        // 15 repeats -> 15 + 29 = ','
+        expect(recvd_str == "$ab0*,#49") << "got" << recvd_str;
+    });
+
+    "send clean packet test"_test = gdb::create_socket_test([&](transport remote, transport local) -> asio::awaitable<void>{
+        tasarch::gdb::PacketIO io(remote);
+        io.set_no_ack();
+
+        // nothing to escape, so this goes out without staging.
+        buffer clean(gdb_packet_buffer_size);
+        std::string ok = "OK";
+        clean.append_buf(ok);
+        co_await io.send_packet(clean);
+        expect(clean.read_size() == 0_ul) << "send_packet should consume the send buffer";
+        std::string recvd_str = co_await recv_string(local);
+        expect(recvd_str == "$OK#9a") << "got" << recvd_str;
+    });
+
+    struct string_source : packet_source
+    {
+        std::string data;
+        size_t offset = 0;
+        size_t rewinds = 0;
+
+        void rewind() override
+        {
+            offset = 0;
+            rewinds++;
+        }
+
+        auto next(buffer& chunk) -> bool override
+        {
+            size_t num = std::min(chunk.write_size(), data.size() - offset);
+            std::string piece = data.substr(offset, num);
+            chunk.append_buf(piece);
+            offset += num;
+            return offset < data.size();
+        }
+    };
+
+    "streamed send test"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
+        tasarch::gdb::PacketIO io(remote);
+        string_source source;
+        source.data = file_mean_data;
+        // odd size, so escapes and the checksum span several pieces
+        buffer chunk(7);
+        bool did_break = co_await io.send_streamed(source, chunk);
+        expect(!did_break) << "did not expect a break!";
+        expect(source.rewinds == 2_ul) << "expected one retransmit";
+    }, [&](transport local) -> asio::awaitable<void>{
+        std::string recvd;
+        while (recvd.size() < encoded_mean_data.size()) {
+            recvd += co_await recv_string(local);
+        }
+        expect(recvd == encoded_mean_data);
+        co_await local.async_send(asio::buffer(nack), asio::use_awaitable);
+        recvd.clear();
+        while (recvd.size() < encoded_mean_data.size()) {
+            recvd += co_await recv_string(local);
+        }
+        expect(recvd == encoded_mean_data);
+        co_await local.async_send(asio::buffer(ack), asio::use_awaitable);
     });
 
-    "simple send with ack test"_test = gdb::create_dual_socket_test([&](tcp::socket remote) -> asio::awaitable<void>{
+    "simple send with ack test"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
         tasarch::gdb::PacketIO io(remote);
         rst_buf();
         bool did_break = co_await io.send_packet(mean_buffer);
         expect(!did_break) << "did not expect a break!";
-    }, [&](tcp::socket local) -> asio::awaitable<void>{
+    }, [&](transport local) -> asio::awaitable<void>{
         // we should have received already
         std::string recvd_str = co_await recv_string(local);
         expect(recvd_str == encoded_mean_data);
@@ -102,7 +270,7 @@ abcdefghijklmnopqrstuvwxyz{|}~
         co_await local.async_send(asio::buffer(ack), asio::use_awaitable);
     });
 
-    "simple recv with ack test"_test = gdb::create_dual_socket_test([&](tcp::socket remote) -> asio::awaitable<void>{
+    "simple recv with ack test"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
         tasarch::gdb::PacketIO io(remote);
 
         buffer recv_buf(gdb_packet_buffer_size);
@@ -111,18 +279,18 @@ abcdefghijklmnopqrstuvwxyz{|}~
         
         expect(recv_buf.get_str() == file_mean_data);
 
-    }, [&](tcp::socket local) -> asio::awaitable<void>{
+    }, [&](transport local) -> asio::awaitable<void>{
         co_await local.async_send(asio::buffer(encoded_mean_data), asio::use_awaitable);
         // check for ack
         std::string recvd_str = co_await recv_string(local);
         expect(recvd_str == ack);
     });
 
-    "simple send with no ack test"_test = gdb::create_dual_socket_test([&](tcp::socket remote) -> asio::awaitable<void>{
+    "simple send with no ack test"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
         tasarch::gdb::PacketIO io(remote);
         rst_buf();
         co_await io.send_packet(mean_buffer);
-    }, [&](tcp::socket local) -> asio::awaitable<void>{
+    }, [&](transport local) -> asio::awaitable<void>{
         // we should have received already
         std::string recvd_str = co_await recv_string(local);
         expect(recvd_str == encoded_mean_data);
@@ -135,14 +303,14 @@ abcdefghijklmnopqrstuvwxyz{|}~
         co_await local.async_send(asio::buffer(ack), asio::use_awaitable);
     });
 
-    "simple recv with no ack test"_test = gdb::create_dual_socket_test([&](tcp::socket remote) -> asio::awaitable<void>{
+    "simple recv with no ack test"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
         tasarch::gdb::PacketIO io(remote);
 
         buffer recv_buf(gdb_packet_buffer_size);
         co_await io.receive_packet(recv_buf);
         std::string rcvd = recv_buf.get_str();
         expect(rcvd == file_mean_data);
-    }, [&](tcp::socket local) -> asio::awaitable<void>{
+    }, [&](transport local) -> asio::awaitable<void>{
         std::string wrong_cksum = encoded_mean_data.substr(0, encoded_mean_data.size() - 1) + "f";
         co_await local.async_send(asio::buffer(wrong_cksum), asio::use_awaitable);
         // check for ack
@@ -156,30 +324,162 @@ abcdefghijklmnopqrstuvwxyz{|}~
         expect(recvd_str2 == ack);
     });
 
-    "check error on too large packet"_test = gdb::create_dual_socket_test([&](tcp::socket remote) -> asio::awaitable<void>{
+    "recv and send in no ack mode"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
+        tasarch::gdb::PacketIO io(remote);
+        io.set_no_ack();
+
+        buffer recv_buf(gdb_packet_buffer_size);
+        co_await io.receive_packet(recv_buf);
+        expect(recv_buf.get_str() == file_mean_data);
+
+        // must not wait for an ack, otherwise this would time out.
+        buffer ok_buf(gdb_packet_buffer_size);
+        std::string ok = "OK";
+        ok_buf.append_buf(ok);
+        co_await io.send_packet(ok_buf);
+    }, [&](transport local) -> asio::awaitable<void>{
+        // checksum is not checked anymore
+        std::string wrong_cksum = encoded_mean_data.substr(0, encoded_mean_data.size() - 1) + "f";
+        co_await local.async_send(asio::buffer(wrong_cksum), asio::use_awaitable);
+        // no ack in front of the response
+        std::string recvd_str = co_await recv_string(local);
+        expect(recvd_str == "$OK#9a") << "got" << recvd_str;
+    }, 1000ms);
+
+    "send and recv with dedicated reader"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
+        tasarch::gdb::PacketIO io(remote);
+        io.set_dedicated_reader(true);
+        rst_buf();
+        buffer recv_buf(gdb_packet_buffer_size);
+
+        // reader and sender have to share a strand.
+        auto strand = asio::make_strand(io.socket.get_executor());
+        auto [send_break, recv_break] = co_await asio::co_spawn(strand, [&]() -> asio::awaitable<std::tuple<bool, bool>>{
+            co_return co_await (io.send_packet(mean_buffer) && io.receive_packet(recv_buf));
+        }, asio::use_awaitable);
+        expect(!send_break && !recv_break) << "did not expect a break!";
+        expect(recv_buf.get_str() == file_mean_data);
+    }, [&](transport local) -> asio::awaitable<void>{
+        std::string recvd_str = co_await recv_string(local);
+        expect(recvd_str == encoded_mean_data);
+        // the reader has to forward this to the sender, so it retransmits.
+        co_await local.async_send(asio::buffer(nack), asio::use_awaitable);
+        std::string recvd_str2 = co_await recv_string(local);
+        expect(recvd_str2 == encoded_mean_data);
+        // ack and the next request in one go
+        co_await local.async_send(asio::buffer(ack + encoded_mean_data), asio::use_awaitable);
+        std::string recvd_str3 = co_await recv_string(local);
+        expect(recvd_str3 == ack);
+    });
+
+    "acks and breaks without a buffer"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
+        tasarch::gdb::PacketIO io(remote);
+        io.set_dedicated_reader(true);
+        rst_buf();
+        buffer recv_buf(gdb_packet_buffer_size);
+
+        // Like a reader with all of its buffers in use: the ack still reaches the sender, the next packet is left alone.
+        auto strand = asio::make_strand(io.socket.get_executor());
+        auto read_control = [&]() -> asio::awaitable<std::tuple<bool, bool>> {
+            bool first = co_await io.receive_control();
+            bool second = co_await io.receive_control();
+            co_return std::make_tuple(first, second);
+        };
+        auto [send_break, control] = co_await asio::co_spawn(strand, [&]() -> asio::awaitable<std::tuple<bool, std::tuple<bool, bool>>>{
+            co_return co_await (io.send_packet(mean_buffer) && read_control());
+        }, asio::use_awaitable);
+        expect(!send_break);
+        expect(std::get<0>(control)) << "expected the break character!";
+        expect(!std::get<1>(control)) << "expected the start of a packet!";
+        co_await io.receive_packet(recv_buf);
+        expect(recv_buf.get_str() == file_mean_data);
+    }, [&](transport local) -> asio::awaitable<void>{
+        std::string recvd_str = co_await recv_string(local);
+        expect(recvd_str == encoded_mean_data);
+        co_await local.async_send(asio::buffer(ack + "\x03" + encoded_mean_data), asio::use_awaitable);
+        std::string recvd_str2 = co_await recv_string(local);
+        expect(recvd_str2 == ack);
+    });
+
+    "ack for a pipelined request while streaming"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
+        using namespace tasarch::literals;
+        tasarch::gdb::PacketIO io(remote);
+        io.set_dedicated_reader(true);
+        string_source source;
+        // way more than the socket buffers, so the writes are still in flight when the request arrives.
+        source.data = std::string(512_KB, 'a');
+        buffer chunk(4_KB);
+        buffer recv_buf(gdb_packet_buffer_size);
+
+        auto strand = asio::make_strand(io.socket.get_executor());
+        auto read_side = [&]() -> asio::awaitable<bool> {
+            co_await io.receive_packet(recv_buf);
+            // forwards the ack for our response, then stops at the break.
+            co_return co_await io.receive_control();
+        };
+        auto [send_break, did_break] = co_await asio::co_spawn(strand, [&]() -> asio::awaitable<std::tuple<bool, bool>>{
+            co_return co_await (io.send_streamed(source, chunk) && read_side());
+        }, asio::use_awaitable);
+        expect(!send_break);
+        expect(did_break) << "expected the break character!";
+        expect(source.rewinds == 1_ul) << "did not expect a retransmit";
+        expect(recv_buf.get_str() == file_mean_data);
+    }, [&](transport local) -> asio::awaitable<void>{
+        using namespace tasarch::literals;
+        // pipelined, i.e. before we read anything of the response.
+        co_await local.async_send(asio::buffer(encoded_mean_data), asio::use_awaitable);
+        // 512K of 'a' sum up to 0, the ack for our request has to come after the packet, not somewhere inside.
+        std::string expected = "$" + std::string(512_KB, 'a') + "#00" + ack;
+        std::string recvd;
+        while (recvd.size() < expected.size()) {
+            recvd += co_await recv_string(local);
+        }
+        expect(recvd.size() == expected.size());
+        expect(recvd == expected) << "ack ended up inside the streamed packet at" << recvd.find(ack);
+        co_await local.async_send(asio::buffer(ack + "\x03"), asio::use_awaitable);
+    });
+
+    "fragmented recv test"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
+        tasarch::gdb::PacketIO io(remote);
+        io.set_no_ack();
+
+        buffer recv_buf(gdb_packet_buffer_size);
+        co_await io.receive_packet(recv_buf);
+        expect(recv_buf.get_str() == file_mean_data);
+    }, [&](transport local) -> asio::awaitable<void>{
+        // odd sized chunks, so that escapes and the checksum end up split across reads.
+        asio::steady_timer timer(local.get_executor());
+        for (size_t off = 0; off < encoded_mean_data.size(); off += 7) {
+            co_await local.async_send(asio::buffer(encoded_mean_data.substr(off, 7)), asio::use_awaitable);
+            timer.expires_after(1ms);
+            co_await timer.async_wait(asio::use_awaitable);
+        }
+    });
+
+    "check error on too large packet"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
         tasarch::gdb::PacketIO io(remote);
         // this buf should be way too small!
         buffer recv_buf(10);
         throws_async_ex(io.receive_packet(recv_buf), tasarch::gdb::buffer_too_small);
-    }, [&](tcp::socket local) -> asio::awaitable<void>{
+    }, [&](transport local) -> asio::awaitable<void>{
         co_await local.async_send(asio::buffer(encoded_mean_data), asio::use_awaitable);
     });
 
-    "break character on read"_test = gdb::create_dual_socket_test([&](tcp::socket remote) -> asio::awaitable<void>{
+    "break character on read"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
         tasarch::gdb::PacketIO io(remote);
         buffer recv_buf(gdb_packet_buffer_size);
         bool did_break = co_await io.receive_packet(recv_buf);
         expect(did_break) << "expected a break character!";
-    }, [&](tcp::socket local) -> asio::awaitable<void>{
+    }, [&](transport local) -> asio::awaitable<void>{
         co_await local.async_send(asio::buffer("\x03"), asio::use_awaitable);
     });
 
-    "break character on write"_test = gdb::create_dual_socket_test([&](tcp::socket remote) -> asio::awaitable<void>{
+    "break character on write"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
         tasarch::gdb::PacketIO io(remote);
         rst_buf();
         bool did_break = co_await io.send_packet(mean_buffer);
         expect(did_break) << "expected a break character!";
-    }, [&](tcp::socket local) -> asio::awaitable<void>{
+    }, [&](transport local) -> asio::awaitable<void>{
         // we should have received already
         std::string recvd_str = co_await recv_string(local);
         expect(recvd_str == encoded_mean_data);
@@ -187,14 +487,14 @@ abcdefghijklmnopqrstuvwxyz{|}~
         co_await local.async_send(asio::buffer("\x03"+ack), asio::use_awaitable);
     });
 
-    "timeout on local close"_test = gdb::create_dual_socket_test([&](tcp::socket remote) -> asio::awaitable<void>{
+    "timeout on local close"_test = gdb::create_dual_socket_test([&](transport remote) -> asio::awaitable<void>{
         tasarch::gdb::PacketIO io(remote);
         // shorter timeout, so testing doesnt take as long!
         io.timeout = 500ms;
         buffer recv_buf(gdb_packet_buffer_size);
         throws_async_ex(io.receive_packet(recv_buf), tasarch::gdb::timed_out);
-    }, [&](tcp::socket local) -> asio::awaitable<void>{
+    }, [&](transport local) -> asio::awaitable<void>{
         local.close();
         co_return;
-    });
+    }, 5000ms, gdb::socket_kind::tcp);
 };
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include <array>
+#include <string_view>
+#include <ut/ut.hpp>
+#include "alloc_counter.h"
+#include "gdb/query_handler.h"
+#include "util/function_ref.h"
+
+namespace ut = boost::ut;
+
+namespace {
+    struct query_context
+    {
+        std::string_view called;
+        bool has_features = false;
+    };
+
+    void get_xfer(query_context* ctx) { ctx->called = "get Xfer"; }
+    void get_xfer_features(query_context* ctx) { ctx->called = "get Xfer:features:read"; }
+    void set_no_ack(query_context* ctx) { ctx->called = "set StartNoAckMode"; }
+    void set_nonstop(query_context* ctx) { ctx->called = "set NonStop"; }
+    auto features_available(query_context* ctx) -> bool { return ctx->has_features; }
+
+    using entry = tasarch::gdb::query_handler<query_context>;
+    constexpr auto entries = std::to_array<entry>({
+        entry { .name = "Xfer", .get_handler = tasarch::nontype<&get_xfer> },
+        entry { .name = "Xfer:features:read", .get_handler = tasarch::nontype<&get_xfer_features>, .advertise = true, .available = tasarch::nontype<&features_available> },
+        entry { .name = "StartNoAckMode", .separator = '\0', .set_handler = tasarch::nontype<&set_no_ack>, .advertise = true },
+        entry { .name = "NonStop", .set_handler = tasarch::nontype<&set_nonstop> },
+    });
+    constexpr auto nodes = tasarch::gdb::build_query_trie<tasarch::gdb::query_trie_size(entries)>(entries);
+    constexpr auto table = tasarch::gdb::make_query_table(entries, nodes);
+} // namespace
+
+ut::suite query_handler_tests = []{
+    using namespace ut;
+    using namespace tasarch::gdb;
+
+    "function ref test"_test = []{
+        int calls = 0;
+        auto add = [&calls](int val) { calls += val; return calls; };
+        tasarch::function_ref<int(int)> ref = add;
+        expect(ref(2) == 2_i);
+        expect(ref(3) == 5_i);
+
+        constexpr tasarch::function_ref<void(query_context*)> fixed = tasarch::nontype<&set_nonstop>;
+        query_context ctx;
+        fixed(&ctx);
+        expect(ctx.called == "set NonStop");
+    };
+
+    "query table lookup test"_test = []{
+        static_assert(query_trie_size(entries) == 1 + 18 + 14 + 7);
+        static_assert(table.find("Xfer:foo").handler == &entries[0]);
+        static_assert(table.find("Xfer:features:read:target.xml:0,fff").consumed == 19);
+
+        auto check = [](std::string_view packet, std::string_view name, size_t consumed) {
+            auto [handler, len] = table.find(packet);
+            expect(handler != nullptr) << packet;
+            expect(handler != nullptr && handler->name == name) << packet;
+            expect(len == consumed) << packet;
+        };
+        check("Xfer:memory-map:read::0,fff", "Xfer", 5);
+        check("Xfer:features:read:target.xml:0,fff", "Xfer:features:read", 19);
+        check("StartNoAckMode", "StartNoAckMode", 14);
+        check("NonStop:1", "NonStop", 8);
+
+        // Wrong or missing separators do not match.
+        expect(table.find("StartNoAckMode:1").handler == nullptr);
+        expect(table.find("NonStop").handler == nullptr);
+        expect(table.find("Xfe").handler == nullptr);
+        expect(table.find("Supported:foo").handler == nullptr);
+        expect(table.find("").handler == nullptr);
+    };
+
+    "query table dispatch test"_test = []{
+        query_context ctx;
+        auto allocs = tasarch::test::count_allocations([&]{
+            auto [handler, len] = table.find("Xfer:features:read:target.xml:0,fff");
+            (*handler->get_handler)(&ctx);
+        });
+        expect(allocs == 0_ul);
+        expect(ctx.called == "get Xfer:features:read");
+
+        expect(table.find("StartNoAckMode").handler->type() == set_val);
+        expect(table.find("Xfer:").handler->type() == get_val);
+        expect(table.all().size() == 4_ul);
+
+        const auto& features = *table.find("Xfer:features:read:").handler;
+        expect(features.available.has_value() && !(*features.available)(&ctx));
+        ctx.has_features = true;
+        expect((*features.available)(&ctx));
+        expect(!table.find("NonStop:1").handler->available.has_value());
+    };
+};
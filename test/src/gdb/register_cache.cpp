@@ -0,0 +1,112 @@
+#include <array>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fmt/core.h>
+#include <ut/ut.hpp>
+#include "gdb/register_cache.h"
+#include "mock_target.h"
+
+namespace ut = boost::ut;
+
+namespace {
+    /**
+     * @brief Counts how often registers actually go to / come from the target.
+     */
+    class counting_target : public tasarch::test::gdb::mock_target
+    {
+    public:
+        using mock_target::mock_target;
+
+        void read_registers(std::span<u8> dst) override
+        {
+            this->bulk_reads++;
+            mock_target::read_registers(dst);
+        }
+
+        void write_register(size_t idx, std::span<const u8> src) override
+        {
+            this->single_writes++;
+            mock_target::write_register(idx, src);
+        }
+
+        void write_registers(std::span<const u8> src) override
+        {
+            this->bulk_writes++;
+            mock_target::write_registers(src);
+        }
+
+        size_t bulk_reads = 0;
+        size_t single_writes = 0;
+        size_t bulk_writes = 0;
+    };
+} // namespace
+
+ut::suite register_cache_tests = []{
+    using namespace ut;
+    using namespace tasarch::gdb;
+    using tasarch::test::gdb::mock_target;
+
+    auto path = std::filesystem::temp_directory_path() / fmt::format("tasarch_register_cache_{}.bin", ::getpid());
+
+    "register cache reads once per stop test"_test = [&]{
+        counting_target target(path, 0x1000, 0x1000);
+        target.set_pc(0x1234);
+        register_cache cache(target);
+        expect(!cache.valid());
+
+        auto all = cache.hex();
+        expect(all.size() == 2 * target.register_block_size());
+        // rip is register 16, little endian.
+        expect(cache.hex(mock_target::pc_register) == "3412000000000000");
+        expect(all.substr(2 * 16 * 8, 16) == "3412000000000000");
+        for (size_t i = 0; i < target.registers().size(); i++) {
+            cache.hex(i);
+        }
+        expect(target.bulk_reads == 1_ul);
+        expect(cache.fills() == 1_ul);
+        expect(throws<std::out_of_range>([&]{ cache.hex(target.registers().size()); }));
+
+        cache.invalidate();
+        target.set_pc(0x5678);
+        expect(cache.hex(mock_target::pc_register) == "7856000000000000");
+        expect(target.bulk_reads == 2_ul);
+        std::filesystem::remove(path);
+    };
+
+    "register cache write back test"_test = [&]{
+        counting_target target(path, 0x1000, 0x1000);
+        register_cache cache(target);
+
+        std::array<u8, 8> rax {0xef, 0xbe, 0xad, 0xde};
+        cache.write(0, rax);
+        cache.write(mock_target::pc_register, rax);
+        expect(cache.hex(0) == "efbeadde00000000");
+        expect(cache.dirty_count() == 2_ul);
+        // Nothing reaches the target before resuming.
+        expect(target.single_writes == 0_ul);
+        expect(target.pc() == 0_ul);
+
+        cache.invalidate();
+        expect(target.single_writes == 2_ul);
+        expect(target.bulk_writes == 0_ul);
+        expect(target.pc() == 0xdeadbeefUL);
+        expect(cache.dirty_count() == 0_ul);
+
+        // Writing everything goes back in one go and needs no read.
+        size_t reads = target.bulk_reads;
+        std::vector<u8> all(target.register_block_size(), 0x11);
+        cache.write(all);
+        expect(cache.hex(1) == "1111111111111111");
+        expect(target.bulk_reads == reads);
+        cache.flush();
+        expect(target.bulk_writes == 1_ul);
+        expect(target.single_writes == 2_ul);
+
+        expect(throws<std::invalid_argument>([&]{ cache.write(0, std::span<const u8>(rax).first(4)); }));
+        expect(throws<std::invalid_argument>([&]{ cache.write(std::span<const u8>(all).first(8)); }));
+        std::filesystem::remove(path);
+    };
+};
@@ -1,5 +1,6 @@
 #include <chrono>
 #include <exception>
+#include <filesystem>
 #include <functional>
 #include <future>
 #include <memory>
@@ -7,6 +8,7 @@
 #include <optional>
 #include <stdexcept>
 #include <utility>
+#include <unistd.h>
 #include "gdb/asio.h"
 #include <asio/awaitable.hpp>
 #include <asio/co_spawn.hpp>
@@ -21,18 +23,18 @@
 
 namespace tasarch::test::gdb {
 
-    auto create_socket_test(std::function<asio::awaitable<void> (tcp_socket, tcp_socket)> test, std::chrono::milliseconds timeout) -> std::function<void()>
+    auto create_socket_test(std::function<asio::awaitable<void> (transport, transport)> test, std::chrono::milliseconds timeout, socket_kind kind) -> std::function<void()>
     {
         return [=]{
             auto logger = log::get("test.tcp");
-            auto *exec = new tcp_server_client_test();
+            auto *exec = new tcp_server_client_test(kind);
             exec->timeout = timeout;
             logger->trace("starting tcp_server_client_test");
             exec->start();
 
             logger->trace("creating socket pair...");
             auto pair = exec->create_pair();
-            logger->debug("created socket pair {}, {}", pair.first.local_endpoint(), pair.second.local_endpoint());
+            logger->debug("created socket pair {}, {}", tasarch::gdb::describe_endpoint(pair.first.local_endpoint()), tasarch::gdb::describe_endpoint(pair.second.local_endpoint()));
             std::future<void> fut = asio::co_spawn(::tasarch::gdb::bg_executor::instance().io_context, [&, timeout]() -> asio::awaitable<void>{
                 logger->trace("executing test lambda");
                 co_await tasarch::gdb::awaitable_with_timeout(test(std::move(pair.first), std::move(pair.second)), timeout);
@@ -47,18 +49,18 @@ namespace tasarch::test::gdb {
         };
     }
 
-    auto create_dual_socket_test(std::function<asio::awaitable<void> (tcp_socket)> remote_test, std::function<asio::awaitable<void> (tcp_socket)> local_test, std::chrono::milliseconds timeout) -> std::function<void()>
+    auto create_dual_socket_test(std::function<asio::awaitable<void> (transport)> remote_test, std::function<asio::awaitable<void> (transport)> local_test, std::chrono::milliseconds timeout, socket_kind kind) -> std::function<void()>
     {
         return [=]{
             auto logger = log::get("test.tcp");
-            auto *exec = new tcp_server_client_test();
+            auto *exec = new tcp_server_client_test(kind);
             exec->timeout = timeout;
             logger->trace("starting tcp_server_client_test");
             exec->start();
 
             logger->trace("creating socket pair...");
             auto pair = exec->create_pair();
-            logger->debug("created socket pair {}, {}", pair.first.local_endpoint(), pair.second.local_endpoint());
+            logger->debug("created socket pair {}, {}", tasarch::gdb::describe_endpoint(pair.first.local_endpoint()), tasarch::gdb::describe_endpoint(pair.second.local_endpoint()));
             std::future<void> fut = asio::co_spawn(::tasarch::gdb::bg_executor::instance().io_context, [&, timeout]() -> asio::awaitable<void>{
                 logger->trace("executing test lambda");
                 co_await tasarch::gdb::awaitable_with_timeout((remote_test(std::move(pair.first)) && local_test(std::move(pair.second))), timeout);
@@ -74,19 +76,34 @@ namespace tasarch::test::gdb {
         };
     }
 
+    tcp_server_client_test::tcp_server_client_test(socket_kind kind) : log::WithLogger("test.tcp"), kind(kind)
+    {
+        if (kind == socket_kind::unix_socket) {
+            this->address = tasarch::gdb::listen_address::parse(fmt::format("unix:/tmp/tasarch_test_{}.sock", ::getpid()));
+        } else {
+            this->address = tasarch::gdb::listen_address::parse("tcp:5555");
+        }
+    }
+
     void tcp_server_client_test::start()
     {
+        if (this->kind == socket_kind::pipe) {
+            return;
+        }
         if (this->acceptor != nullptr) {
             logger->warn("already started!");
             return;
         }
-        logger->info("Creating tcp acceptor on port {}", this->port);
-        tcp_acceptor acceptor(::tasarch::gdb::bg_executor::instance().io_context, {asio::ip::tcp::v4(), this->port});
-        this->acceptor = std::make_shared<tcp_acceptor>(std::move(acceptor));
+        logger->info("Creating acceptor on {}", this->address.to_string());
+        auto acceptor = tasarch::gdb::make_acceptor(::tasarch::gdb::bg_executor::instance().io_context, this->address);
+        this->acceptor = std::make_shared<tasarch::gdb::transport_acceptor>(std::move(acceptor));
     }
 
     void tcp_server_client_test::stop()
     {
+        if (this->kind == socket_kind::pipe) {
+            return;
+        }
         if (this->acceptor == nullptr) {
             logger->warn("Never started!");
             return;
@@ -94,31 +111,39 @@ namespace tasarch::test::gdb {
 
         this->acceptor->close();
         this->acceptor = nullptr;
+        if (this->kind == socket_kind::unix_socket) {
+            std::error_code ec;
+            std::filesystem::remove(this->address.path, ec);
+        }
     }
 
-    auto tcp_server_client_test::create_pair_async() -> asio::awaitable<std::pair<tcp_socket, tcp_socket>>
+    auto tcp_server_client_test::create_pair_async() -> asio::awaitable<std::pair<transport, transport>>
     {
         std::lock_guard lk(this->mutex);
-        tcp_socket local(::tasarch::gdb::bg_executor::instance().io_context);
+        transport local(::tasarch::gdb::bg_executor::instance().io_context);
         logger->debug("Launching client connection coroutine");
-        asio::awaitable<void> local_conn = local.async_connect({asio::ip::tcp::v4(), this->port}, asio::use_awaitable);
+        asio::awaitable<void> local_conn = local.async_connect(this->address.endpoint(), asio::use_awaitable);
         logger->debug("Launching server accept coroutine");
-        asio::awaitable<tcp_socket> remote_conn = this->acceptor->async_accept();
+        asio::awaitable<transport> remote_conn = this->acceptor->async_accept(asio::use_awaitable);
         logger->debug("Waiting on both to finish");
-        tcp_socket remote = co_await (std::move(local_conn) && std::move(remote_conn));
+        transport remote = co_await (std::move(local_conn) && std::move(remote_conn));
         co_return std::make_pair(std::move(local), std::move(remote));
     }
 
-    auto tcp_server_client_test::create_pair() -> std::pair<tcp_socket, tcp_socket>
+    auto tcp_server_client_test::create_pair() -> std::pair<transport, transport>
     {
+        if (this->kind == socket_kind::pipe) {
+            return tasarch::gdb::make_pipe(::tasarch::gdb::bg_executor::instance().io_context);
+        }
+
         /**
          * @brief We need to do the song and dance with `std::shared_ptr` here, since `asio::co_spawn` wants to be able to default initialize the result, in case of errors.
          * Don't ask me why, that seems kinda like a bad design, but whatever, it's not too bad.
          * 
          */
-        std::future<std::pair<std::shared_ptr<tcp_socket>, std::shared_ptr<tcp_socket>>> fut = asio::co_spawn(::tasarch::gdb::bg_executor::instance().io_context, [&]() -> asio::awaitable<std::pair<std::shared_ptr<tcp_socket>, std::shared_ptr<tcp_socket>>>{
-            std::pair<tcp_socket, tcp_socket> res = co_await ::tasarch::gdb::awaitable_with_timeout(this->create_pair_async(), this->timeout);
-            co_return std::make_pair(std::make_shared<tcp_socket>(std::move(res.first)), std::make_shared<tcp_socket>(std::move(res.second)));
+        std::future<std::pair<std::shared_ptr<transport>, std::shared_ptr<transport>>> fut = asio::co_spawn(::tasarch::gdb::bg_executor::instance().io_context, [&]() -> asio::awaitable<std::pair<std::shared_ptr<transport>, std::shared_ptr<transport>>>{
+            std::pair<transport, transport> res = co_await ::tasarch::gdb::awaitable_with_timeout(this->create_pair_async(), this->timeout);
+            co_return std::make_pair(std::make_shared<transport>(std::move(res.first)), std::make_shared<transport>(std::move(res.second)));
             // co_return std::move(res);
         }, asio::use_future);
         fut.wait();
@@ -132,12 +157,13 @@ namespace gdb = tasarch::test::gdb;
 
 ut::suite tcp_tests = []{
     using namespace ut;
-    using asio::ip::tcp;
+    using tasarch::gdb::transport;
+    using gdb::socket_kind;
 
     auto config_val = tasarch::config::parse_toml("logging.test.gdb.level = 'trace'\nlogging.bgexec.level = 'trace'");
     tasarch::config::conf()->load_from(config_val);
 
-    "simple tcp test"_test = gdb::create_socket_test([](tcp::socket remote, tcp::socket local) -> asio::awaitable<void>{
+    auto echo_test = [](transport remote, transport local) -> asio::awaitable<void>{
         std::string rem_to_loc = "asdf";
         auto res = co_await remote.async_send(asio::buffer(rem_to_loc), asio::use_awaitable);
         std::string rem_msg;
@@ -155,9 +181,13 @@ ut::suite tcp_tests = []{
         loc_msg.resize(res);
         expect(loc_msg == loc_to_rem) << "local was" << loc_msg << "but expected fdsa";
         co_return;
-    });
+    };
+
+    "simple tcp test"_test = gdb::create_socket_test(echo_test, 5000ms, socket_kind::tcp);
+    "simple unix socket test"_test = gdb::create_socket_test(echo_test, 5000ms, socket_kind::unix_socket);
+    "simple pipe test"_test = gdb::create_socket_test(echo_test);
 
-    "timeout test"_test = gdb::create_socket_test([](tcp::socket remote, tcp::socket local) -> asio::awaitable<void>{
+    "timeout test"_test = gdb::create_socket_test([](transport remote, transport local) -> asio::awaitable<void>{
         std::string rem_to_loc = "asdf";
 
         // no exception here
@@ -171,5 +201,43 @@ ut::suite tcp_tests = []{
 
         throws_async_ex(tasarch::gdb::awaitable_with_timeout(remote.async_send(asio::buffer(rem_to_loc), asio::use_awaitable), 1000ms), tasarch::gdb::timed_out);
         co_return;
+    }, 5000ms, socket_kind::tcp);
+
+    "deadline test"_test = gdb::create_socket_test([](transport remote, transport local) -> asio::awaitable<void>{
+        tasarch::gdb::deadline dl(remote.get_executor());
+        std::string msg;
+        msg.resize(16);
+
+        // nothing was sent, so this has to be cancelled.
+        throws_async_ex(dl.run([&](auto token) { return remote.async_receive(asio::buffer(msg), token); }, 100ms), tasarch::gdb::timed_out);
+
+        // the same deadline can be reused, and does not fire for operations completing in time.
+        std::string loc_to_rem = "fdsa";
+        co_await local.async_send(asio::buffer(loc_to_rem), asio::use_awaitable);
+        size_t res = co_await dl.run([&](auto token) { return remote.async_receive(asio::buffer(msg), token); }, 100ms);
+        msg.resize(res);
+        expect(msg == loc_to_rem);
     });
+
+    "listen address parsing"_test = []{
+        using tasarch::gdb::listen_address;
+        auto unix_addr = listen_address::parse("unix:/run/tasarch.sock");
+        expect(unix_addr.type == listen_address::kind::unix_socket);
+        expect(unix_addr.path == "/run/tasarch.sock");
+        expect(unix_addr.to_string() == "unix:/run/tasarch.sock");
+
+        auto tcp_addr = listen_address::parse("tcp:127.0.0.1:1234");
+        expect(tcp_addr.type == listen_address::kind::tcp);
+        expect(tcp_addr.tcp_endpoint.port() == 1234);
+        expect(tcp_addr.to_string() == "tcp:127.0.0.1:1234");
+
+        expect(listen_address::parse("tcp:[::1]:1234").to_string() == "tcp:[::1]:1234");
+        expect(listen_address::parse("5555").to_string() == "tcp:0.0.0.0:5555");
+        expect(listen_address::parse("tcp:5555").to_string() == "tcp:0.0.0.0:5555");
+
+        expect(throws<std::invalid_argument>([]{ listen_address::parse("unix:"); }));
+        expect(throws<std::invalid_argument>([]{ listen_address::parse("tcp:localhost:notaport"); }));
+        expect(throws<std::invalid_argument>([]{ listen_address::parse("tcp:999999"); }));
+        expect(throws<std::invalid_argument>([]{ listen_address::parse("tcp:not.an.ip:1234"); }));
+    };
 };
@@ -15,32 +15,50 @@
 #include <asio/execution_context.hpp>
 #include <asio/ip/basic_endpoint.hpp>
 #include "gdb/common.h"
+#include "gdb/transport.h"
 #include "async_test.h"
 
 using namespace std::chrono_literals;
 
 namespace tasarch::test::gdb {
+    using tasarch::gdb::transport;
 
-    auto create_socket_test(std::function<asio::awaitable<void>(tcp_socket, tcp_socket)> test, std::chrono::milliseconds timeout = 5000ms) -> std::function<void()>;
-    auto create_dual_socket_test(std::function<asio::awaitable<void>(tcp_socket)> remote_test, std::function<asio::awaitable<void>(tcp_socket)> local_test, std::chrono::milliseconds timeout = 5000ms)  -> std::function<void()>;
+    /**
+     * @brief What kind of connection the socket tests run over.
+     * Defaults to `pipe`, so that most tests do not need to bind a port.
+     */
+    enum class socket_kind
+    {
+        pipe,
+        unix_socket,
+        tcp,
+    };
+
+    auto create_socket_test(std::function<asio::awaitable<void>(transport, transport)> test, std::chrono::milliseconds timeout = 5000ms, socket_kind kind = socket_kind::pipe) -> std::function<void()>;
+    auto create_dual_socket_test(std::function<asio::awaitable<void>(transport)> remote_test, std::function<asio::awaitable<void>(transport)> local_test, std::chrono::milliseconds timeout = 5000ms, socket_kind kind = socket_kind::pipe)  -> std::function<void()>;
 
     class tcp_server_client_test : log::WithLogger
     {
     public:
-        explicit tcp_server_client_test() : log::WithLogger("test.tcp") {}
+        explicit tcp_server_client_test(socket_kind kind = socket_kind::tcp);
+
+        socket_kind kind;
 
-        asio::ip::port_type port = 5555;
+        /**
+         * @brief Where we listen, unused for `socket_kind::pipe`.
+         */
+        tasarch::gdb::listen_address address;
 
         std::chrono::milliseconds timeout = 5000ms;
 
         void start();
         void stop();
 
-        auto create_pair() -> std::pair<tcp_socket, tcp_socket>;
-        auto create_pair_async() -> asio::awaitable<std::pair<tcp_socket, tcp_socket>>;
+        auto create_pair() -> std::pair<transport, transport>;
+        auto create_pair_async() -> asio::awaitable<std::pair<transport, transport>>;
 
     private:
-        std::shared_ptr<tcp_acceptor> acceptor;
+        std::shared_ptr<tasarch::gdb::transport_acceptor> acceptor;
         std::mutex mutex;
     };
 } // namespace tasarch::test::gdb